@@ -0,0 +1,698 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+// Micro-benchmarks of the RAM, ROM and screen.
+//
+// BM_TraceReplay replays the trace file given by the MEMORY_BENCH_TRACE
+// environment variable (see ram_trace_start()), or a synthetic one:
+//   MEMORY_BENCH_TRACE=program.trace memory_bench --benchmark_filter=Trace
+//
+// Results can be exported in a machine-readable format with the usual Google
+// Benchmark options, for example:
+//   memory_bench --benchmark_format=json --benchmark_out=results.json
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <fcntl.h>
+#include <unistd.h>
+#define BENCH_IS_POSIX 1
+#else
+#define BENCH_IS_POSIX 0
+#endif
+
+#include "memory.h"
+#include "memory.hpp"
+#include "screen.h"
+#include "trace.h"
+
+namespace {
+
+// Count of addresses accessed by each access pattern (and of distinct words
+// for the sequential one).
+constexpr size_t ADDRESS_COUNT = 1 << 16;
+
+enum AccessPattern {
+  // Consecutive addresses, stays in the same page for a while.
+  SEQUENTIAL,
+  // A new page at each access (the stride is a bit more than a page).
+  STRIDED,
+  // Uniformly random addresses in a 16 megawords region.
+  RANDOM,
+  // Uniformly random addresses in the whole address space, so almost each
+  // access is to a different page.
+  SPARSE_HIGH,
+};
+
+std::vector<addr_t> make_addresses(AccessPattern pattern) {
+  std::vector<addr_t> addresses(ADDRESS_COUNT);
+  std::mt19937 rng(42);
+  for (size_t i = 0; i < ADDRESS_COUNT; ++i) {
+    switch (pattern) {
+    case SEQUENTIAL:
+      addresses[i] = (addr_t)i;
+      break;
+    case STRIDED:
+      addresses[i] = (addr_t)(i * 1031);
+      break;
+    case RANDOM:
+      addresses[i] = rng() & 0xffffff;
+      break;
+    case SPARSE_HIGH:
+      addresses[i] = rng();
+      break;
+    }
+  }
+  return addresses;
+}
+
+void dummy_read_listener(ram_t *, addr_t) {}
+void dummy_write_listener(ram_t *, addr_t, word_t) {}
+
+// Creates a RAM with all the pages used by the given addresses already
+// created and listener_count read and write listeners. The listeners cover a
+// region far from the accessed addresses, like a RAM-mapped device.
+ram_t *make_ram(const std::vector<addr_t> &addresses, int listener_count) {
+  ram_t *ram = ram_create();
+  for (addr_t addr : addresses) {
+    ram_set(ram, addr, addr);
+  }
+
+  const addr_t listeners_base = 0xfff00000;
+  for (int i = 0; i < listener_count; ++i) {
+    const addr_t addr = listeners_base + (addr_t)i * 16;
+#ifndef RAM_NO_READ_LISTENER
+    ram_install_read_listener(ram, addr, addr + 7, &dummy_read_listener);
+#endif // !RAM_NO_READ_LISTENER
+#ifndef RAM_NO_WRITE_LISTENER
+    ram_install_write_listener(ram, addr, addr + 7, &dummy_write_listener);
+#endif // !RAM_NO_WRITE_LISTENER
+  }
+  return ram;
+}
+
+// Reports the time per access next to the accesses throughput.
+void set_access_counters(benchmark::State &state) {
+  state.SetItemsProcessed((int64_t)state.iterations() * ADDRESS_COUNT);
+  state.counters["time_per_access"] = benchmark::Counter(
+      (double)ADDRESS_COUNT, benchmark::Counter::kIsIterationInvariantRate |
+                                 benchmark::Counter::kInvert);
+}
+
+void BM_RamGet(benchmark::State &state) {
+  const auto addresses = make_addresses((AccessPattern)state.range(0));
+  ram_t *ram = make_ram(addresses, (int)state.range(1));
+
+  for (auto _ : state) {
+    word_t sum = 0;
+    for (addr_t addr : addresses) {
+      sum += ram_get(ram, addr);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  set_access_counters(state);
+  ram_destroy(ram);
+}
+
+void BM_RamSet(benchmark::State &state) {
+  const auto addresses = make_addresses((AccessPattern)state.range(0));
+  ram_t *ram = make_ram(addresses, (int)state.range(1));
+
+  for (auto _ : state) {
+    for (addr_t addr : addresses) {
+      ram_set(ram, addr, addr + 1);
+    }
+    benchmark::ClobberMemory();
+  }
+
+  set_access_counters(state);
+  ram_destroy(ram);
+}
+
+void BM_RamGetSet(benchmark::State &state) {
+  const auto addresses = make_addresses((AccessPattern)state.range(0));
+  ram_t *ram = make_ram(addresses, (int)state.range(1));
+
+  for (auto _ : state) {
+    word_t sum = 0;
+    for (addr_t addr : addresses) {
+      sum += ram_get_set(ram, addr, addr + 1);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  set_access_counters(state);
+  ram_destroy(ram);
+}
+
+// Same as BM_RamGet and BM_RamSet but with a single batched call.
+void BM_RamGather(benchmark::State &state) {
+  const auto addresses = make_addresses((AccessPattern)state.range(0));
+  ram_t *ram = make_ram(addresses, (int)state.range(1));
+  std::vector<word_t> out(addresses.size());
+
+  for (auto _ : state) {
+    ram_gather(ram, addresses.data(), out.data(), addresses.size());
+    benchmark::DoNotOptimize(out.data());
+  }
+
+  set_access_counters(state);
+  ram_destroy(ram);
+}
+
+void BM_RamScatter(benchmark::State &state) {
+  const auto addresses = make_addresses((AccessPattern)state.range(0));
+  ram_t *ram = make_ram(addresses, (int)state.range(1));
+
+  for (auto _ : state) {
+    ram_scatter(ram, addresses.data(), addresses.data(), addresses.size());
+    benchmark::ClobberMemory();
+  }
+
+  set_access_counters(state);
+  ram_destroy(ram);
+}
+
+// Random reads among the given count of used pages (of 4 words), so almost
+// each access misses the page caches and does a page table lookup.
+void BM_RamGetManyPages(benchmark::State &state) {
+  const size_t page_count = (size_t)state.range(0);
+  ram_config_t config = ram_default_config();
+  config.backend = (ram_backend_t)state.range(1);
+  config.page_size = 4;
+  ram_t *ram = ram_create_ex(&config);
+  std::mt19937 rng(42);
+  std::vector<addr_t> addresses(ADDRESS_COUNT);
+  for (size_t i = 0; i < page_count; ++i) {
+    ram_set(ram, (addr_t)(i * 4 * 37), (word_t)i);
+  }
+  for (addr_t &addr : addresses) {
+    addr = (addr_t)((rng() % page_count) * 4 * 37);
+  }
+
+  for (auto _ : state) {
+    word_t sum = 0;
+    for (addr_t addr : addresses) {
+      sum += ram_get(ram, addr);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  set_access_counters(state);
+  ram_destroy(ram);
+}
+
+BENCHMARK(BM_RamGetManyPages)
+    ->ArgNames({"pages", "backend"})
+    ->ArgsProduct({{1 << 16, 1 << 20, (1 << 21) - (1 << 14), 1 << 22},
+                   {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}});
+
+// Creates the given count of pages (of 4 words) in a new RAM block, timing
+// each write to report the longest one, which includes the hash table resizes.
+void BM_RamCreatePages(benchmark::State &state) {
+  const size_t page_count = (size_t)state.range(0);
+  ram_config_t config = ram_default_config();
+  config.backend = (ram_backend_t)state.range(1);
+  config.page_size = 4;
+  std::chrono::steady_clock::duration max_set_time{};
+  for (auto _ : state) {
+    ram_t *ram = ram_create_ex(&config);
+    for (size_t i = 0; i < page_count; ++i) {
+      const auto begin = std::chrono::steady_clock::now();
+      ram_set(ram, (addr_t)(i * 4 * 37), (word_t)i);
+      max_set_time = std::max(max_set_time, std::chrono::steady_clock::now() - begin);
+    }
+    ram_destroy(ram);
+  }
+
+  state.SetItemsProcessed((int64_t)(state.iterations() * page_count));
+  state.counters["max_set_ns"] =
+      (double)std::chrono::duration_cast<std::chrono::nanoseconds>(max_set_time).count();
+}
+
+BENCHMARK(BM_RamCreatePages)
+    ->ArgNames({"pages", "backend"})
+    ->ArgsProduct({{1 << 16, 1 << 20, 1 << 22}, {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}})
+    ->Unit(benchmark::kMillisecond);
+
+// Arguments: access pattern, listener count.
+void access_arguments(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgNames({"pattern", "listeners"});
+  for (int pattern : {SEQUENTIAL, STRIDED, RANDOM, SPARSE_HIGH}) {
+    for (int listener_count : {0, 1, 16}) {
+      benchmark->Args({pattern, listener_count});
+    }
+  }
+}
+
+BENCHMARK(BM_RamGet)->Apply(access_arguments);
+BENCHMARK(BM_RamSet)->Apply(access_arguments);
+BENCHMARK(BM_RamGetSet)->Apply(access_arguments);
+BENCHMARK(BM_RamGather)->Apply(access_arguments);
+BENCHMARK(BM_RamScatter)->Apply(access_arguments);
+
+// Same as BM_RamGet and BM_RamSet (without listeners) with the inlined
+// accessors of sparse::Ram.
+void BM_CppRamGet(benchmark::State &state) {
+  const auto addresses = make_addresses((AccessPattern)state.range(0));
+  sparse::Ram<> ram;
+  for (addr_t addr : addresses) {
+    ram.set(addr, addr);
+  }
+
+  for (auto _ : state) {
+    word_t sum = 0;
+    for (addr_t addr : addresses) {
+      sum += ram.get(addr);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  set_access_counters(state);
+}
+
+void BM_CppRamSet(benchmark::State &state) {
+  const auto addresses = make_addresses((AccessPattern)state.range(0));
+  sparse::Ram<> ram;
+  for (addr_t addr : addresses) {
+    ram.set(addr, addr);
+  }
+
+  for (auto _ : state) {
+    for (addr_t addr : addresses) {
+      ram.set(addr, addr + 1);
+    }
+    benchmark::ClobberMemory();
+  }
+
+  set_access_counters(state);
+}
+
+BENCHMARK(BM_CppRamGet)->ArgName("pattern")->DenseRange(SEQUENTIAL, SPARSE_HIGH);
+BENCHMARK(BM_CppRamSet)->ArgName("pattern")->DenseRange(SEQUENTIAL, SPARSE_HIGH);
+
+// Shared by the threads of the concurrent benchmarks, created and destroyed
+// by the first thread (Google Benchmark synchronizes the threads before and
+// after the measured loop).
+ram_t *concurrent_ram = nullptr;
+
+// Each thread accesses its own region of a concurrent RAM block.
+void BM_ConcurrentRamSet(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    ram_config_t config = ram_default_config();
+    config.concurrent = 1;
+    concurrent_ram = ram_create_ex(&config);
+  }
+
+  const addr_t base = (addr_t)state.thread_index() * ADDRESS_COUNT * 4;
+  for (auto _ : state) {
+    for (addr_t i = 0; i < ADDRESS_COUNT; ++i) {
+      ram_set(concurrent_ram, base + i, i);
+    }
+  }
+
+  set_access_counters(state);
+  if (state.thread_index() == 0) {
+    ram_destroy(concurrent_ram);
+  }
+}
+
+void BM_ConcurrentFetchAdd(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    ram_config_t config = ram_default_config();
+    config.concurrent = 1;
+    concurrent_ram = ram_create_ex(&config);
+  }
+
+  const addr_t base = (addr_t)state.thread_index() * ADDRESS_COUNT * 4;
+  for (auto _ : state) {
+    for (addr_t i = 0; i < ADDRESS_COUNT; ++i) {
+      ram_atomic_fetch_add(concurrent_ram, base + i, 1);
+    }
+  }
+
+  set_access_counters(state);
+  if (state.thread_index() == 0) {
+    ram_destroy(concurrent_ram);
+  }
+}
+
+// Same as BM_ConcurrentRamSet but through a private view per thread.
+void BM_ConcurrentViewSet(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    ram_config_t config = ram_default_config();
+    config.concurrent = 1;
+    concurrent_ram = ram_create_ex(&config);
+  }
+
+  // The view is created and destroyed in the measured loop, as the RAM only
+  // exists between the synchronization points of the threads.
+  const addr_t base = (addr_t)state.thread_index() * ADDRESS_COUNT * 4;
+  for (auto _ : state) {
+    ram_view_t *view = ram_view_create(concurrent_ram);
+    for (addr_t i = 0; i < ADDRESS_COUNT; ++i) {
+      ram_view_set(view, base + i, i);
+    }
+    ram_view_destroy(view);
+  }
+
+  set_access_counters(state);
+  if (state.thread_index() == 0) {
+    ram_destroy(concurrent_ram);
+  }
+}
+
+BENCHMARK(BM_ConcurrentRamSet)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_ConcurrentViewSet)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_ConcurrentFetchAdd)->ThreadRange(1, 8)->UseRealTime();
+
+// Writes an image of the given count of words in a temporary file and returns
+// its name.
+std::string write_image(size_t word_count) {
+  const std::string filename =
+      "memory_bench_" + std::to_string(word_count) + ".ram";
+  std::vector<word_t> data(word_count);
+  for (size_t i = 0; i < word_count; ++i) {
+    data[i] = (word_t)i;
+  }
+
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (file != nullptr) {
+    fwrite(data.data(), sizeof(word_t), data.size(), file);
+    fclose(file);
+  }
+  return filename;
+}
+
+void BM_RamFromFile(benchmark::State &state) {
+  const size_t word_count = (size_t)state.range(0);
+  const std::string filename = write_image(word_count);
+
+  for (auto _ : state) {
+    ram_t *ram = ram_from_file(filename.c_str());
+    benchmark::DoNotOptimize(ram_get(ram, (addr_t)(word_count - 1)));
+    ram_destroy(ram);
+  }
+
+  state.SetBytesProcessed((int64_t)state.iterations() * word_count *
+                          sizeof(word_t));
+  std::remove(filename.c_str());
+}
+
+// From 64 KiB to 64 MiB.
+BENCHMARK(BM_RamFromFile)->ArgName("words")->RangeMultiplier(16)->Range(
+    1 << 14, 1 << 24);
+
+// Snapshot then restore of a RAM block with the given count of used words,
+// after a write to each of its pages.
+void BM_RamSnapshotRestore(benchmark::State &state) {
+  const size_t word_count = (size_t)state.range(0);
+  ram_t *ram = ram_create();
+  for (size_t i = 0; i < word_count; i += 1024) {
+    ram_set(ram, (addr_t)i, (word_t)i);
+  }
+
+  for (auto _ : state) {
+    ram_snapshot_t *snapshot = ram_snapshot(ram);
+    ram_restore(ram, snapshot);
+    ram_snapshot_destroy(snapshot);
+  }
+
+  state.SetBytesProcessed((int64_t)state.iterations() * word_count *
+                          sizeof(word_t));
+  ram_destroy(ram);
+}
+
+BENCHMARK(BM_RamSnapshotRestore)->ArgName("words")->RangeMultiplier(16)->Range(
+    1 << 14, 1 << 24);
+
+// Comparison of two 1 GiB RAM blocks with the given count of (equal) used
+// pages, spread over the range.
+void BM_RamCompareSparse(benchmark::State &state) {
+  const addr_t word_count = (addr_t)1 << 28;
+  const addr_t used_pages = (addr_t)state.range(0);
+  ram_t *ram_a = ram_create();
+  ram_t *ram_b = ram_create();
+  for (addr_t i = 0; i < used_pages; ++i) {
+    const addr_t base = (word_count / used_pages) * i;
+    ram_fill(ram_a, base, i + 1, ram_page_size(ram_a));
+    ram_fill(ram_b, base, i + 1, ram_page_size(ram_b));
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ram_compare(ram_a, ram_b, 0, word_count));
+  }
+
+  ram_destroy(ram_a);
+  ram_destroy(ram_b);
+}
+
+BENCHMARK(BM_RamCompareSparse)->ArgName("pages")->Arg(16)->Arg(1024)->Unit(
+    benchmark::kMillisecond);
+
+// Search of a word at the end of a dense region, with ram_find_word() or a
+// ram_get() loop.
+void BM_RamFindWord(benchmark::State &state) {
+  const size_t word_count = 1 << 20;
+  ram_t *ram = ram_create();
+  ram_fill(ram, 0, 1, word_count);
+  ram_set(ram, (addr_t)(word_count - 1), 42);
+  const bool use_loop = state.range(0) != 0;
+
+  for (auto _ : state) {
+    size_t offset = 0;
+    if (use_loop) {
+      while (ram_get(ram, (addr_t)offset) != 42) {
+        ++offset;
+      }
+    } else {
+      offset = ram_find_word(ram, 0, word_count, 42);
+    }
+    benchmark::DoNotOptimize(offset);
+  }
+
+  state.SetBytesProcessed((int64_t)state.iterations() * word_count *
+                          sizeof(word_t));
+  ram_destroy(ram);
+}
+
+BENCHMARK(BM_RamFindWord)->ArgName("loop")->Arg(0)->Arg(1);
+
+#if !defined(RAM_NO_READ_LISTENER) && !defined(RAM_NO_WRITE_LISTENER)
+// Accesses of a small emulated program: instruction fetches in a loop, a few
+// stack pushes and pops, and loads and stores to a 1 megawords array.
+void run_synthetic_program(ram_t *ram, size_t instruction_count) {
+  std::mt19937 rng(42);
+  const addr_t code_base = 0x1000;
+  const addr_t stack_top = 0x00200000;
+  const addr_t data_base = 0x00400000;
+  addr_t pc = 0;
+  addr_t sp = stack_top;
+  for (size_t i = 0; i < instruction_count; ++i) {
+    const word_t instruction = ram_get(ram, code_base + pc);
+    pc = (pc + 1) % 256;
+    switch (rng() % 8) {
+    case 0:
+      ram_set(ram, --sp, instruction);
+      break;
+    case 1:
+      if (sp < stack_top) {
+        ram_get(ram, sp++);
+      }
+      break;
+    case 2:
+    case 3:
+      ram_get(ram, data_base + (rng() & 0xfffff));
+      break;
+    case 4:
+      ram_set(ram, data_base + (rng() & 0xfffff), (word_t)i);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+void collect_trace_record(void *user_data, const ram_trace_record_t *record) {
+  static_cast<std::vector<ram_trace_record_t> *>(user_data)->push_back(*record);
+}
+
+// The records of the trace file given by the MEMORY_BENCH_TRACE environment
+// variable or, without it, of run_synthetic_program().
+const std::vector<ram_trace_record_t> &benchmark_trace() {
+  static std::vector<ram_trace_record_t> records;
+  if (!records.empty()) {
+    return records;
+  }
+
+  const char *filename = std::getenv("MEMORY_BENCH_TRACE");
+  const std::string synthetic_filename = "memory_bench.trace";
+  if (filename == nullptr) {
+    ram_t *ram = ram_create();
+    ram_trace_t *trace = ram_trace_start(ram, synthetic_filename.c_str());
+    if (trace != nullptr) {
+      run_synthetic_program(ram, 1 << 20);
+      ram_trace_stop(trace);
+    }
+    ram_destroy(ram);
+    filename = synthetic_filename.c_str();
+  }
+
+  if (ram_trace_read(filename, &collect_trace_record, &records) < 0) {
+    std::fprintf(stderr, "error: failed to read trace file '%s'\n", filename);
+  }
+  std::remove(synthetic_filename.c_str());
+  return records;
+}
+
+// Cost of recording the accesses (the trace is written to the null device, or
+// to a file that is removed).
+void BM_TraceRecord(benchmark::State &state) {
+  const bool traced = state.range(0) != 0;
+  ram_t *ram = ram_create();
+  run_synthetic_program(ram, 1 << 16);
+
+#if BENCH_IS_POSIX
+  const std::string filename = "/dev/null";
+#else
+  const std::string filename = "memory_bench_record.trace";
+#endif
+  ram_trace_t *trace =
+      traced ? ram_trace_start(ram, filename.c_str()) : nullptr;
+  for (auto _ : state) {
+    run_synthetic_program(ram, ADDRESS_COUNT);
+  }
+  if (trace != nullptr) {
+    ram_trace_stop(trace);
+  }
+
+  state.SetItemsProcessed((int64_t)state.iterations() * ADDRESS_COUNT);
+  ram_destroy(ram);
+#if !BENCH_IS_POSIX
+  std::remove(filename.c_str());
+#endif
+}
+
+BENCHMARK(BM_TraceRecord)->ArgName("traced")->Arg(0)->Arg(1);
+
+// Replay of a recorded trace (see benchmark_trace()) on a RAM block of each
+// backend, as a more realistic mix of accesses than the patterns above.
+void BM_TraceReplay(benchmark::State &state) {
+  const std::vector<ram_trace_record_t> &records = benchmark_trace();
+  ram_t *ram = ram_create_with_backend((ram_backend_t)state.range(0));
+
+  for (auto _ : state) {
+    word_t sum = 0;
+    for (const ram_trace_record_t &record : records) {
+      if (record.op == RAM_TRACE_WRITE) {
+        ram_set(ram, record.addr, record.value);
+      } else {
+        sum += ram_get(ram, record.addr);
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  state.SetItemsProcessed((int64_t)state.iterations() * records.size());
+  state.counters["time_per_access"] = benchmark::Counter(
+      (double)records.size(), benchmark::Counter::kIsIterationInvariantRate |
+                                  benchmark::Counter::kInvert);
+  ram_destroy(ram);
+}
+
+BENCHMARK(BM_TraceReplay)
+    ->ArgName("backend")
+    ->Arg(RAM_BACKEND_HASH_TABLE)
+    ->Arg(RAM_BACKEND_RADIX_TABLE);
+#endif // !RAM_NO_READ_LISTENER && !RAM_NO_WRITE_LISTENER
+
+void BM_RomGet(benchmark::State &state) {
+  std::vector<word_t> data(ADDRESS_COUNT);
+  rom_t rom = rom_create(data.data(), data.size());
+
+  for (auto _ : state) {
+    word_t sum = 0;
+    for (addr_t addr = 0; addr < ADDRESS_COUNT; ++addr) {
+      sum += rom_get(rom, addr);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  set_access_counters(state);
+  rom_destroy(rom);
+}
+
+BENCHMARK(BM_RomGet);
+
+void BM_RomGetChecked(benchmark::State &state) {
+  std::vector<word_t> data(ADDRESS_COUNT);
+  rom_t rom = rom_create(data.data(), data.size());
+
+  for (auto _ : state) {
+    word_t sum = 0;
+    for (addr_t addr = 0; addr < ADDRESS_COUNT; ++addr) {
+      sum += rom_get_checked(rom, addr);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+
+  set_access_counters(state);
+  rom_destroy(rom);
+}
+
+BENCHMARK(BM_RomGetChecked);
+
+#if BENCH_IS_POSIX
+// Redirects the standard output to /dev/null while alive, so the screen
+// benchmarks do not flood the terminal (nor the benchmark results).
+class DiscardStdout {
+public:
+  DiscardStdout() {
+    fflush(stdout);
+    saved_fd = dup(STDOUT_FILENO);
+    const int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+  }
+
+  ~DiscardStdout() {
+    fflush(stdout);
+    dup2(saved_fd, STDOUT_FILENO);
+    close(saved_fd);
+  }
+
+private:
+  int saved_fd;
+};
+
+void BM_ScreenPutCharacter(benchmark::State &state) {
+  // Plain or styled (red text on a blue background, bold and underlined).
+  const word_t style =
+      state.range(0) ? ((2 << 8) | (5 << 13) | (1 << 18) | (1 << 21)) : 0;
+
+  DiscardStdout discard_stdout;
+  for (auto _ : state) {
+    for (addr_t y = 0; y < SCREEN_HEIGHT; ++y) {
+      for (addr_t x = 0; x < SCREEN_WIDTH; ++x) {
+        screen_put_character(x, y, ('a' + (x + y) % 26) | style);
+      }
+    }
+  }
+
+  state.SetItemsProcessed((int64_t)state.iterations() * SCREEN_SIZE);
+}
+
+BENCHMARK(BM_ScreenPutCharacter)->ArgName("styled")->Arg(0)->Arg(1);
+#endif // BENCH_IS_POSIX
+
+} // namespace
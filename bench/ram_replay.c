@@ -0,0 +1,146 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+// Replays a trace recorded with ram_trace_start() on a new RAM block and
+// reports the time per access, for example:
+//   ram_replay -r 10 -b radix -s program.trace
+
+#include "memory.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct replay_records_t
+{
+    ram_trace_record_t *records;
+    size_t count, capacity;
+    uint32_t thread_count;
+    size_t write_count;
+} replay_records_t;
+
+static void collect_record(void *user_data, const ram_trace_record_t *record)
+{
+    replay_records_t *records = (replay_records_t *)user_data;
+    if (records->count == records->capacity)
+    {
+        records->capacity = (records->capacity == 0) ? 4096 : records->capacity * 2;
+        records->records =
+            (ram_trace_record_t *)realloc(records->records, sizeof(ram_trace_record_t) * records->capacity);
+        check_alloc(records->records);
+    }
+
+    records->records[records->count++] = *record;
+    if (record->thread >= records->thread_count)
+        records->thread_count = record->thread + 1;
+    if (record->op == RAM_TRACE_WRITE)
+        ++records->write_count;
+}
+
+static double now_seconds(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-r REPEAT] [-b hash|radix] [-p PAGE_SIZE] [-s] TRACE\n", program);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned repeat = 1;
+    int dump_stats = 0;
+    ram_config_t config = ram_default_config();
+    const char *filename = NULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            repeat = (unsigned)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "hash") == 0)
+                config.backend = RAM_BACKEND_HASH_TABLE;
+            else if (strcmp(argv[i], "radix") == 0)
+                config.backend = RAM_BACKEND_RADIX_TABLE;
+            else
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+        {
+            config.page_size = (addr_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-s") == 0)
+        {
+            dump_stats = 1;
+        }
+        else if (argv[i][0] != '-' && filename == NULL)
+        {
+            filename = argv[i];
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+
+    if (filename == NULL || repeat == 0)
+        usage(argv[0]);
+
+    // The records are decoded once, so only the RAM accesses are timed.
+    replay_records_t records = {NULL, 0, 0, 0, 0};
+    if (ram_trace_read(filename, &collect_record, &records) < 0)
+    {
+        fprintf(stderr, "error: file '%s' is not a valid RAM trace\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu records (%zu reads, %zu writes) of %u threads\n", records.count, records.count - records.write_count,
+           records.write_count, records.thread_count);
+
+    // The first replay creates the pages, the next ones replay on the same
+    // RAM block (like a program run several times).
+    ram_t *ram = ram_create_ex(&config);
+    if (ram == NULL)
+    {
+        fprintf(stderr, "error: invalid page size %u\n", config.page_size);
+        free(records.records);
+        usage(argv[0]);
+    }
+    double best = 0;
+    word_t sum = 0;
+    for (unsigned r = 0; r < repeat; ++r)
+    {
+        const double start = now_seconds();
+        for (size_t i = 0; i < records.count; ++i)
+        {
+            const ram_trace_record_t *record = &records.records[i];
+            if (record->op == RAM_TRACE_WRITE)
+                ram_set(ram, record->addr, record->value);
+            else
+                sum += ram_get(ram, record->addr);
+        }
+        const double elapsed = now_seconds() - start;
+        printf("replay %u: %.3f ms, %.2f ns per access\n", r + 1, elapsed * 1e3,
+               (records.count != 0) ? elapsed * 1e9 / (double)records.count : 0.0);
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("best: %.3f ms (checksum %#x)\n", best * 1e3, sum);
+    if (dump_stats)
+        ram_dump_stats(ram, stdout);
+
+    ram_destroy(ram);
+    free(records.records);
+    return EXIT_SUCCESS;
+}
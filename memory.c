@@ -2,12 +2,157 @@
 // This file is part of SparseMemory which is released under the MIT license.
 // See file LICENSE.txt for full license details.
 
+// Needed for MAP_ANONYMOUS when compiling with a strict C standard.
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+// The swap files (see ram_config_t::max_resident_pages) may exceed 2 GB.
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+// Never replace the RAM accessors by their inline versions in this file.
+#define CPULM_MEMORY_IMPLEMENTATION
 #include "memory.h"
+#include "memory_core.h"
 
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
 
+// We need to detect POSIX (to know if we can include <unistd.h>).
+// GCC defines __unix__ on most POSIX systems except the Apple ones.
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#define IS_POSIX 1
+#else
+#define IS_POSIX 0
+#endif
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#elif IS_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The page scan kernels (see ram_fill()) use the best SIMD instruction set
+// enabled at compile time (the one of the page table lookups, see
+// memory_core.h), and scalar code otherwise.
+#if defined(RAM_HAS_AVX2)
+#define HAS_AVX2 1
+#elif defined(RAM_HAS_SSE2)
+#define HAS_SSE2 1
+#elif defined(RAM_HAS_NEON)
+#define HAS_NEON 1
+#endif
+
+/* Atomic operations, used by the concurrent RAM blocks (see ram_config_t) and
+ * by the data that may be shared between threads (page reference counts,
+ * radix table entries). Without compiler support, they are plain memory
+ * accesses and concurrent RAM blocks are not supported. */
+#if defined(__GNUC__) || defined(__clang__)
+#define HAS_ATOMICS 1
+#define ATOMIC_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#define ATOMIC_LOAD_RELAXED(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define ATOMIC_LOAD_SEQ_CST(ptr) __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE_RELAXED(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELAXED)
+#define ATOMIC_CAS(ptr, expected_ptr, desired)                                                                   \
+    __atomic_compare_exchange_n(ptr, expected_ptr, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#define ATOMIC_EXCHANGE(ptr, value) __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST)
+#define ATOMIC_FETCH_ADD(ptr, value) __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST)
+#define ATOMIC_FETCH_ADD_RELAXED(ptr, value) __atomic_fetch_add(ptr, value, __ATOMIC_RELAXED)
+#define ATOMIC_SUB_FETCH(ptr, value) __atomic_sub_fetch(ptr, value, __ATOMIC_SEQ_CST)
+#define ATOMIC_FETCH_OR(ptr, value) __atomic_fetch_or(ptr, value, __ATOMIC_SEQ_CST)
+#else
+#define HAS_ATOMICS 0
+#define ATOMIC_LOAD(ptr) (*(ptr))
+#define ATOMIC_STORE(ptr, value) (*(ptr) = (value))
+#define ATOMIC_LOAD_RELAXED(ptr) (*(ptr))
+#define ATOMIC_LOAD_SEQ_CST(ptr) (*(ptr))
+#define ATOMIC_STORE_RELAXED(ptr, value) (*(ptr) = (value))
+#define ATOMIC_CAS(ptr, expected_ptr, desired)                                                                   \
+    ((*(ptr) == *(expected_ptr)) ? (*(ptr) = (desired), 1) : (*(expected_ptr) = *(ptr), 0))
+#define ATOMIC_FETCH_ADD(ptr, value) ((*(ptr) += (value)) - (value))
+#define ATOMIC_FETCH_ADD_RELAXED(ptr, value) ATOMIC_FETCH_ADD(ptr, value)
+#define ATOMIC_SUB_FETCH(ptr, value) (*(ptr) -= (value))
+#define ATOMIC_FETCH_OR(ptr, value) (*(ptr) |= (value))
+#endif
+
+// A minimal spin lock, only used on rare paths (slab allocation, copy on
+// write of concurrent RAM blocks).
+typedef int spin_lock_t;
+
+static void spin_lock(spin_lock_t *lock)
+{
+#if HAS_ATOMICS
+    while (ATOMIC_EXCHANGE(lock, 1) != 0)
+    {
+        while (ATOMIC_LOAD_RELAXED(lock) != 0)
+            continue;
+    }
+#else
+    (void)lock;
+#endif
+}
+
+static void spin_unlock(spin_lock_t *lock)
+{
+#if HAS_ATOMICS
+    ATOMIC_STORE(lock, 0);
+#else
+    (void)lock;
+#endif
+}
+
+/* Instrumentation, see ram_stats_t. Without RAM_ENABLE_STATS, the RAM_STAT_*
+ * macros expand to nothing. The counters of concurrent RAM blocks are updated
+ * with relaxed atomic operations, the maximums are only used by the hash table
+ * backend (which is never concurrent). */
+#ifdef RAM_ENABLE_STATS
+#include <time.h>
+
+static void stat_add(int concurrent, uint64_t *counter, uint64_t value)
+{
+    if (concurrent)
+        ATOMIC_FETCH_ADD_RELAXED(counter, value);
+    else
+        *counter += value;
+}
+
+// Returns a monotonic time in nanoseconds.
+static uint64_t get_time_ns()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#elif IS_POSIX
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+#else
+    return (uint64_t)((double)clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
+#define RAM_STAT_ADD(ram, counter, value) stat_add((ram)->concurrent, &(ram)->stats.counter, (value))
+#define RAM_STAT_MAX(ram, counter, value)                                                                      \
+    do                                                                                                         \
+    {                                                                                                          \
+        if ((value) > (ram)->stats.counter)                                                                    \
+            (ram)->stats.counter = (value);                                                                    \
+    } while (0)
+#else
+#define RAM_STAT_ADD(ram, counter, value) ((void)0)
+#define RAM_STAT_MAX(ram, counter, value) ((void)0)
+#endif // RAM_ENABLE_STATS
+
 void check_alloc(void *ptr)
 {
     if (ptr == NULL)
@@ -55,6 +200,52 @@ error:
     return NULL;
 }
 
+// Maps the whole file filename read-only into memory (modifications of the
+// file after the call may or may not be visible). Returns NULL if the file
+// could not be mapped, in which case the caller should fall back to
+// read_file(). This includes empty files and unsupported platforms.
+static const word_t *map_file(const char *filename, size_t *data_len)
+{
+    assert(data_len != NULL);
+
+#if IS_POSIX
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0 || file_stat.st_size % sizeof(word_t) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping remains valid after the file is closed.
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    *data_len = (size_t)file_stat.st_size / sizeof(word_t);
+    return (const word_t *)data;
+#else
+    (void)filename;
+    return NULL;
+#endif
+}
+
+// Unmaps a file mapped by map_file().
+static void unmap_file(const word_t *data, size_t data_len)
+{
+#if IS_POSIX
+    munmap((void *)data, sizeof(word_t) * data_len);
+#else
+    (void)data;
+    (void)data_len;
+    assert(0 && "map_file() is not supported");
+#endif
+}
+
 #ifdef __GNUC__
 #define MEM_NORETURN __attribute__((__noreturn__))
 #elif defined(_MSC_VER)
@@ -69,6 +260,12 @@ MEM_NORETURN static void file_error(const char *filename)
     abort();
 }
 
+MEM_NORETURN static void file_format_error(const char *filename)
+{
+    fprintf(stderr, "error: file '%s' is not a valid RAM image\n", filename);
+    abort();
+}
+
 /*
  * RAM abstraction.
  */
@@ -80,32 +277,40 @@ MEM_NORETURN static void file_error(const char *filename)
  * same size as the real ones from the OS for performance reasons). When
  * accessing the RAM, we retrieve the corresponding memory page or create one on
  * the fly. The effective mapping between the addresses and the memory pages
- * (and real physical memory address) are done using a hash table. To remain
- * simple, the hash table uses open addressing (linear probing).
+ * (and real physical memory address) are done using a hash table (an open
+ * addressing one, see ram_core_ht_find()).
+ *
+ * Alternatively, as addresses are only 32-bits, the mapping can be done by a
+ * two-level radix page table (exactly like the x86 page tables): the upper bits
+ * of the page number index a directory of leaf tables and the lower bits index
+ * the leaf table. Lookups are then just two dependent loads, without any hashing,
+ * probing or rehashing, at the cost of a bit more memory for sparse RAMs.
  */
 
 // Initial RAM hast table bucket count. Must be a power of 2.
 #define INITIAL_RAM_HT_SIZE 64
+// Count of slots of the previous hash table whose pages are moved to the new
+// one at each page insertion during a resize, see ht_insert().
+#define RAM_HT_MIGRATION_STEP 64
 #define BASE_ADDR_MASK
 
+// A base address that no memory page can have (base addresses are always
+// multiples of the page size), used to mark empty page cache entries.
+#define INVALID_BASE_ADDR 1
+
+// Count of writes whose write listeners a RAM view can defer.
+#define RAM_VIEW_MAX_PENDING_WRITES 256
+
+// Count of addresses whose pages are looked up (and words prefetched) ahead of
+// their accesses by ram_gather() and ram_scatter().
+#define RAM_BATCH_SIZE 32
+// Count of entries of the page cache local to a batch. Must be a power of 2.
+#define RAM_BATCH_PAGE_CACHE_SIZE 16
+
 // There is some platform-specific code to retrieve the current configured
 // memory page size. The code is quite self-contained and has a default behavior
 // in case of an unsupported platform, so this is not too bad.
 
-// We need to detect POSIX (to know if we can include <unistd.h>).
-// GCC defines __unix__ on most POSIX systems except the Apple ones.
-#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
-#define IS_POSIX 1
-#else
-#define IS_POSIX 0
-#endif
-
-#ifdef _WIN32
-#include <Windows.h>
-#elif IS_POSIX
-#include <unistd.h>
-#endif
-
 /** Returns the currently used memory page of the underlying OS. */
 static size_t get_os_memory_page()
 {
@@ -120,320 +325,3971 @@ static size_t get_os_memory_page()
 #endif
 }
 
-#ifndef RAM_NO_READ_LISTENER
-struct ram_read_listener_t
+/*
+ * Memory page allocator.
+ */
+
+/* Memory pages are not allocated individually. Instead, they are carved from
+ * large slabs directly requested to the OS, and all the slabs of an allocator
+ * are freed at once when it is destroyed. This avoids the malloc metadata and
+ * fragmentation of many small allocations. Moreover, slabs are aligned on
+ * their size (so page data is aligned on the OS memory pages) and, on POSIX,
+ * are anonymous mappings which are lazily zeroed by the OS.
+ *
+ * Memory pages may be shared between RAM blocks and snapshots (see
+ * ram_snapshot()), so each page has a reference count. The reference counts
+ * of the pages of a slab are stored in a header at the start of the slab,
+ * which is found from the page data address thanks to the slab alignment.
+ * When the reference count of a page drops to zero, the page is pushed on a
+ * free list (its first bytes store the link) and reused by the next
+ * allocation. The pages discarded by ram_discard() and ram_compact() are
+ * instead given back to the OS when they cover whole OS memory pages, and
+ * kept apart on a stack (as their content is lost) to also be reused. */
+
+// Size, in bytes, of a page slab. Must be a power of 2.
+#define RAM_SLAB_SIZE (1024 * 1024)
+// Minimum size, in bytes, of a page slab backed by huge pages (the usual huge
+// page size). Must be a power of 2.
+#define RAM_HUGE_SLAB_SIZE (2 * 1024 * 1024)
+
+// Allocates size bytes of zeroed memory aligned on alignment bytes (a power of
+// 2), backed by huge pages if requested and possible. The returned memory must
+// be freed using os_free_aligned().
+static void *os_alloc_aligned(size_t size, size_t alignment, ram_huge_pages_t huge_pages)
 {
-    ram_read_listener_fn_t callback;
-    struct ram_read_listener_t *next;
-    addr_t addr_low, addr_high;
-};
-#endif // !RAM_NO_READ_LISTENER
+#ifdef _WIN32
+    // Large pages require a special privilege on Windows, they are ignored.
+    (void)huge_pages;
+    void *ptr = _aligned_malloc(size, alignment);
+    if (ptr != NULL)
+        memset(ptr, 0, size);
+    return ptr;
+#elif IS_POSIX
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+    // mmap() only guarantees an alignment on the OS memory page, so we map
+    // more than required then unmap the unaligned head and the tail.
+    const size_t mapped_size = size + alignment;
+    char *ptr = (char *)MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // The huge pages must have been reserved by the system administrator,
+    // otherwise this fails and we fall back to normal pages. The sizes are
+    // multiples of the huge page size, so the unmapped parts below are too.
+    if (huge_pages == RAM_HUGE_PAGES_HUGETLB)
+        ptr = (char *)mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (ptr == (char *)MAP_FAILED)
+        ptr = (char *)mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == (char *)MAP_FAILED)
+        return NULL;
 
-#ifndef RAM_NO_WRITE_LISTENER
-struct ram_write_listener_t
+    char *aligned_ptr = (char *)(((uintptr_t)ptr + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if (aligned_ptr != ptr)
+        munmap(ptr, aligned_ptr - ptr);
+    if (aligned_ptr + size != ptr + mapped_size)
+        munmap(aligned_ptr + size, (ptr + mapped_size) - (aligned_ptr + size));
+
+#ifdef MADV_HUGEPAGE
+    // Only a hint, transparent huge pages may be disabled.
+    if (huge_pages != RAM_HUGE_PAGES_NONE)
+        madvise(aligned_ptr, size, MADV_HUGEPAGE);
+#endif
+    return aligned_ptr;
+#else
+    (void)huge_pages;
+    void *ptr = aligned_alloc(alignment, size);
+    if (ptr != NULL)
+        memset(ptr, 0, size);
+    return ptr;
+#endif
+}
+
+static void os_free_aligned(void *ptr, size_t size)
 {
-    ram_write_listener_fn_t callback;
-    struct ram_write_listener_t *next;
-    addr_t addr_low, addr_high;
-};
-#endif // !RAM_NO_WRITE_LISTENER
+#ifdef _WIN32
+    (void)size;
+    _aligned_free(ptr);
+#elif IS_POSIX
+    munmap(ptr, size);
+#else
+    (void)size;
+    free(ptr);
+#endif
+}
 
-typedef struct ram_page_t
+typedef struct ram_page_allocator_t
 {
-    addr_t base_addr;
-    word_t *data;
-} ram_page_t;
+    // All the slabs allocated so far, the last one is the current one.
+    void **slabs;
+    size_t slab_count;
+    size_t slab_capacity;
+    size_t slab_size;
+    size_t page_bytes;
+    // Count of pages at the start of each slab used by its header.
+    size_t header_pages;
+    // The remaining free part of the current slab.
+    char *next_page;
+    char *slab_end;
+    // The released pages, linked through their first bytes.
+    void *free_pages;
+    // The released pages whose memory was given back to the OS.
+    void **decommitted_pages;
+    size_t decommitted_count;
+    size_t decommitted_capacity;
+    // If the pages can be given back to the OS.
+    int can_decommit;
+    ram_huge_pages_t huge_pages;
+    // The allocator may be used by several threads (concurrent RAM blocks and
+    // clones), so allocations and frees are protected by this lock.
+    spin_lock_t lock;
+} ram_page_allocator_t;
 
-struct ram_t
+static void page_allocator_init(ram_page_allocator_t *allocator, size_t page_bytes, ram_huge_pages_t huge_pages)
 {
-    ram_page_t *buckets;
-    // page_count must always be a power of 2.
-    addr_t bucket_count;
-    addr_t page_count;
+    assert(page_bytes >= sizeof(void *));
 
-#ifndef RAM_NO_READ_LISTENER
-    struct ram_read_listener_t *read_listener;
-#endif // !RAM_NO_READ_LISTENER
-#ifndef RAM_NO_WRITE_LISTENER
-    struct ram_write_listener_t *write_listener;
-#endif // !RAM_NO_WRITE_LISTENER
+    allocator->slabs = NULL;
+    allocator->slab_count = 0;
+    allocator->slab_capacity = 0;
+    allocator->page_bytes = page_bytes;
+    allocator->next_page = NULL;
+    allocator->slab_end = NULL;
+    allocator->free_pages = NULL;
+    allocator->decommitted_pages = NULL;
+    allocator->decommitted_count = 0;
+    allocator->decommitted_capacity = 0;
+    allocator->huge_pages = huge_pages;
+    allocator->lock = 0;
 
-    // Size, in words, of a RAM's page size.
-    addr_t page_size;
-};
+    // The OS memory pages are the granularity of madvise(). Huge pages are
+    // never given back, this would split them.
+#if IS_POSIX && defined(MADV_DONTNEED)
+    allocator->can_decommit = huge_pages == RAM_HUGE_PAGES_NONE && page_bytes % get_os_memory_page() == 0;
+#else
+    allocator->can_decommit = 0;
+#endif
 
-// Hash the given integer to have a better distribution.
-addr_t hash(addr_t x)
+    // A slab must contain at least one page after its header.
+    allocator->slab_size = (huge_pages != RAM_HUGE_PAGES_NONE) ? RAM_HUGE_SLAB_SIZE : RAM_SLAB_SIZE;
+    while (allocator->slab_size < 2 * page_bytes)
+        allocator->slab_size *= 2;
+
+    // The header is an array of one reference count per page of the slab.
+    const size_t header_bytes = sizeof(uint32_t) * (allocator->slab_size / page_bytes);
+    allocator->header_pages = (header_bytes + page_bytes - 1) / page_bytes;
+    assert(allocator->header_pages * page_bytes < allocator->slab_size);
+}
+
+// Returns the reference count of the given page, allocated by allocator.
+static uint32_t *page_refcount(const ram_page_allocator_t *allocator, const word_t *page)
 {
-    // From https://stackoverflow.com/a/12996028
-    // addr_t is assumed to be 32-bits
-    x = ((x >> 16) ^ x) * 0x45d9f3b;
-    x = ((x >> 16) ^ x) * 0x45d9f3b;
-    x = (x >> 16) ^ x;
-    return x;
+    const uintptr_t slab = (uintptr_t)page & ~(uintptr_t)(allocator->slab_size - 1);
+    const size_t page_index = ((uintptr_t)page - slab) / allocator->page_bytes;
+    return (uint32_t *)slab + page_index;
 }
 
-// Implements a hash table lookup where buckets and bucket_count is the hash
-// table's bucket array and base_addr is the key. The function returns the index
-// where the search slot should be. However, if the key is not present in the
-// hash table, then the returned index is one where the key should be inserted
-// (the first empty bucket that was found in the search algorithm).
-static addr_t ht_find(ram_page_t *buckets, addr_t bucket_count,
-                      addr_t base_addr)
+// Returns a new zeroed memory page, with a reference count of 1.
+static word_t *page_allocator_alloc(ram_page_allocator_t *allocator)
 {
-    // AND mask by (capacity - 1) to be sure that index is not out of bounds.
-    // This works because bucket count is always a power of two.
-    uint32_t index = hash(base_addr) & (bucket_count - 1);
+    spin_lock(&allocator->lock);
 
-    // We do a simple linear search in the hash table (open addressing).
-    while (buckets[index].data != NULL)
+    word_t *page;
+    if (allocator->free_pages != NULL)
+    {
+        // Reuse a released page.
+        page = (word_t *)allocator->free_pages;
+        allocator->free_pages = *(void **)page;
+        spin_unlock(&allocator->lock);
+        memset(page, 0, allocator->page_bytes);
+    }
+    else if (allocator->decommitted_count > 0)
     {
-        // If we found the memory page then access the correct memory cell and
-        // return it.
-        if (buckets[index].base_addr == base_addr)
+        // Reuse a page given back to the OS, which maps it again on its first
+        // access. Its content is not guaranteed to be zeros on every OS.
+        page = (word_t *)allocator->decommitted_pages[--allocator->decommitted_count];
+        spin_unlock(&allocator->lock);
+        memset(page, 0, allocator->page_bytes);
+    }
+    else
+    {
+        if (allocator->next_page == allocator->slab_end)
         {
-            return index;
+            // The current slab is full, allocate a new one.
+            if (allocator->slab_count == allocator->slab_capacity)
+            {
+                allocator->slab_capacity = (allocator->slab_capacity == 0) ? 16 : allocator->slab_capacity * 2;
+                allocator->slabs = (void **)realloc(allocator->slabs, sizeof(void *) * allocator->slab_capacity);
+                check_alloc(allocator->slabs);
+            }
+
+            char *slab = (char *)os_alloc_aligned(allocator->slab_size, allocator->slab_size, allocator->huge_pages);
+            check_alloc(slab);
+            allocator->slabs[allocator->slab_count++] = slab;
+            allocator->next_page = slab + allocator->header_pages * allocator->page_bytes;
+            allocator->slab_end = slab + allocator->slab_size;
         }
 
-        // If not, we continue to search.
-        index += 1;
-        if (index >= bucket_count)
-            index = 0;
+        page = (word_t *)allocator->next_page;
+        allocator->next_page += allocator->page_bytes;
+        spin_unlock(&allocator->lock);
     }
 
-    // Returns the place where it should belong if it was present.
-    return index;
+    ATOMIC_STORE(page_refcount(allocator, page), 1);
+    return page;
 }
 
-static void init_ram_page(ram_t *ram, ram_page_t *page, addr_t base_addr)
+// Adds a reference to the given page.
+static void page_retain(ram_page_allocator_t *allocator, word_t *page)
 {
-    page->base_addr = base_addr;
-    page->data = (word_t *)calloc(sizeof(word_t), ram->page_size);
-    check_alloc(page->data);
+    ATOMIC_FETCH_ADD(page_refcount(allocator, page), 1);
 }
 
-ram_t *ram_create()
+// Removes a reference to the given page, and frees it if it was the last one.
+static void page_release(ram_page_allocator_t *allocator, word_t *page)
 {
-    ram_t *ram = (ram_t *)malloc(sizeof(ram_t));
-    check_alloc(ram);
+    uint32_t *refcount = page_refcount(allocator, page);
+    assert(ATOMIC_LOAD(refcount) > 0);
+    if (ATOMIC_SUB_FETCH(refcount, 1) == 0)
+    {
+        spin_lock(&allocator->lock);
+        *(void **)page = allocator->free_pages;
+        allocator->free_pages = page;
+        spin_unlock(&allocator->lock);
+    }
+}
 
-#ifndef RAM_NO_READ_LISTENER
-    ram->read_listener = NULL;
-#endif // !RAM_NO_READ_LISTENER
-#ifndef RAM_NO_WRITE_LISTENER
-    ram->write_listener = NULL;
-#endif // !RAM_NO_WRITE_LISTENER
+// Same as page_release(), but if the page is freed, its memory is also given
+// back to the OS when possible.
+static void page_discard(ram_page_allocator_t *allocator, word_t *page)
+{
+    if (!allocator->can_decommit)
+    {
+        page_release(allocator, page);
+        return;
+    }
+
+    uint32_t *refcount = page_refcount(allocator, page);
+    assert(ATOMIC_LOAD(refcount) > 0);
+    if (ATOMIC_SUB_FETCH(refcount, 1) != 0)
+        return;
+
+#if IS_POSIX && defined(MADV_DONTNEED)
+    madvise(page, allocator->page_bytes, MADV_DONTNEED);
+#endif
+
+    spin_lock(&allocator->lock);
+    if (allocator->decommitted_count == allocator->decommitted_capacity)
+    {
+        allocator->decommitted_capacity =
+            (allocator->decommitted_capacity == 0) ? 64 : allocator->decommitted_capacity * 2;
+        allocator->decommitted_pages =
+            (void **)realloc(allocator->decommitted_pages, sizeof(void *) * allocator->decommitted_capacity);
+        check_alloc(allocator->decommitted_pages);
+    }
+    allocator->decommitted_pages[allocator->decommitted_count++] = page;
+    spin_unlock(&allocator->lock);
+}
+
+// Checks if the given page is referenced more than once. A page that is not
+// shared can only become shared by a snapshot or a clone.
+static int page_is_shared(const ram_page_allocator_t *allocator, const word_t *page)
+{
+    return ATOMIC_LOAD(page_refcount(allocator, page)) > 1;
+}
 
-    // Precompute the RAM's page size.
-    ram->page_size = get_os_memory_page() / sizeof(word_t);
+// Frees all the pages allocated by the given allocator at once.
+static void page_allocator_destroy(ram_page_allocator_t *allocator)
+{
+    for (size_t i = 0; i < allocator->slab_count; ++i)
+        os_free_aligned(allocator->slabs[i], allocator->slab_size);
+    free(allocator->slabs);
+    free(allocator->decommitted_pages);
+}
+
+/*
+ * RAM listeners.
+ */
 
-    ram->buckets = (ram_page_t *)calloc(INITIAL_RAM_HT_SIZE, sizeof(ram_page_t));
-    check_alloc(ram->buckets);
-    ram->bucket_count = INITIAL_RAM_HT_SIZE;
-    ram->page_count = 1;
+/* Listeners are stored in an array, in their installation order. To avoid
+ * checking each one of them at each RAM access, an index is built when a
+ * listener is installed: the address space is split into the sorted disjoint
+ * segments where the set of listeners to call is the same. Only the segments
+ * covered by at least one listener are stored, so finding the listeners to
+ * call is a binary search and addresses without listeners are quickly
+ * rejected. Installing a listener is rare, so rebuilding the whole index each
+ * time (with a sweep over the sorted listener boundaries) is fine.
+ *
+ * Moreover, the RAM page caches only ever contain pages without listeners (of
+ * the corresponding kind). So, a page cache hit means there is no listener to
+ * call at all, and a RAM without listeners is as fast as one compiled with
+ * RAM_NO_READ_LISTENER and RAM_NO_WRITE_LISTENER. */
 
-    // Initialize the first memory's page (the region [0..PAGE_SIZE)).
-    init_ram_page(ram, &ram->buckets[ht_find(ram->buckets, ram->bucket_count, 0)],
-                  0);
+// Generic listener callback type, casted back to ram_read_listener_fn_t or
+// ram_write_listener_fn_t before being called.
+typedef void (*ram_listener_fn_t)(void);
 
-    return ram;
+typedef struct ram_listener_t
+{
+    ram_listener_fn_t callback;
+    addr_t addr_low, addr_high;
+#ifdef RAM_ENABLE_STATS
+    // The count of calls of the listener.
+    uint64_t call_count;
+#endif
+} ram_listener_t;
+
+typedef struct ram_listener_segment_t
+{
+    addr_t addr_low, addr_high;
+    // The listeners to call are the segment_listeners[first..first+count).
+    uint32_t first, count;
+} ram_listener_segment_t;
+
+typedef struct ram_listener_set_t
+{
+    ram_listener_t *listeners;
+    uint32_t count, capacity;
+
+    // The index, sorted by address.
+    ram_listener_segment_t *segments;
+    uint32_t segment_count;
+    // Indices into listeners of the listeners of each segment.
+    uint32_t *segment_listeners;
+} ram_listener_set_t;
+
+static void listener_set_init(ram_listener_set_t *set)
+{
+    set->listeners = NULL;
+    set->count = 0;
+    set->capacity = 0;
+    set->segments = NULL;
+    set->segment_count = 0;
+    set->segment_listeners = NULL;
 }
 
-// Returns the memory's page corresponding to the given addr. This effectively
-// does a hash table lookup internally. However, this also adds the memory's
-// page if it was not already present (and therefore may resize the hash table).
-static ram_page_t *get_ram_page(ram_t *ram, addr_t addr)
+static void listener_set_destroy(ram_listener_set_t *set)
 {
-    // We clear the lower bits of the address to get the page's base address.
-    const addr_t base_addr = addr & ~(ram->page_size - 1);
+    free(set->listeners);
+    free(set->segments);
+    free(set->segment_listeners);
+}
+
+#if !defined(RAM_NO_READ_LISTENER) || !defined(RAM_NO_WRITE_LISTENER)
+// Reallocates the given array to count elements of the given size, aborting
+// like check_alloc() if it does not fit in memory (or in a size_t).
+static void *realloc_array(void *array, size_t count, size_t size)
+{
+    void *new_array = (count > SIZE_MAX / size) ? NULL : realloc(array, count * size);
+    check_alloc(new_array);
+    return new_array;
+}
+
+// A boundary of a listener for the index sweep: the first address of the
+// listener or one past its last address (a 64-bits integer as one past
+// 0xffffffff does not fit in addr_t).
+typedef struct ram_listener_boundary_t
+{
+    uint64_t addr;
+    uint32_t listener;
+    int is_end;
+} ram_listener_boundary_t;
 
-    // Try to find a corresponding memory's page.
-    addr_t index = ht_find(ram->buckets, ram->bucket_count, base_addr);
-    if (ram->buckets[index].base_addr == base_addr)
+static int compare_boundaries(const void *lhs, const void *rhs)
+{
+    const uint64_t a = ((const ram_listener_boundary_t *)lhs)->addr;
+    const uint64_t b = ((const ram_listener_boundary_t *)rhs)->addr;
+    return (a > b) - (a < b);
+}
+
+// Rebuilds the index of the given listener set, in one sweep over the sorted
+// boundaries of its listeners.
+static void listener_set_build_index(ram_listener_set_t *set)
+{
+    free(set->segments);
+    set->segment_count = 0;
+
+    const size_t boundary_count = 2 * (size_t)set->count;
+    ram_listener_boundary_t *boundaries =
+        (ram_listener_boundary_t *)realloc_array(NULL, boundary_count, sizeof(ram_listener_boundary_t));
+    for (uint32_t i = 0; i < set->count; ++i)
     {
-        // We found one!
-        return &ram->buckets[index];
+        boundaries[2 * i].addr = set->listeners[i].addr_low;
+        boundaries[2 * i].listener = i;
+        boundaries[2 * i].is_end = 0;
+        boundaries[2 * i + 1].addr = (uint64_t)set->listeners[i].addr_high + 1;
+        boundaries[2 * i + 1].listener = i;
+        boundaries[2 * i + 1].is_end = 1;
     }
+    qsort(boundaries, boundary_count, sizeof(ram_listener_boundary_t), &compare_boundaries);
 
-    // We failed to find the corresponding memory's page. Now, let's create it.
+    // There are at most boundary_count - 1 segments. The listeners of each
+    // one are those active in the sweep, kept in installation order.
+    set->segments = (ram_listener_segment_t *)realloc_array(NULL, boundary_count, sizeof(ram_listener_segment_t));
+    uint32_t *active = (uint32_t *)realloc_array(NULL, set->count, sizeof(uint32_t));
+    uint32_t active_count = 0;
+    size_t segment_listener_capacity = set->count;
+    set->segment_listeners =
+        (uint32_t *)realloc_array(set->segment_listeners, segment_listener_capacity, sizeof(uint32_t));
+    size_t segment_listener_count = 0;
 
-    // But if there is not enough space, resize the hash table.
-    if (ram->page_count == ram->bucket_count)
+    size_t i = 0;
+    while (i < boundary_count)
     {
-        // Allocate new buckets.
-        addr_t old_bucket_count = ram->bucket_count;
-        ram->bucket_count *= 2;
-        ram_page_t *new_pages = (ram_page_t *)calloc(ram->bucket_count, sizeof(ram_page_t));
-        check_alloc(new_pages);
-
-        // Rehash the table (we just reinsert individually each of the previous
-        // memory pages into the new hash table).
-        for (addr_t i = 0; i < old_bucket_count; ++i)
+        const uint64_t addr = boundaries[i].addr;
+        for (; i < boundary_count && boundaries[i].addr == addr; ++i)
         {
-            ram_page_t *page = ram->buckets + i;
-            if (page->data != NULL)
+            const uint32_t listener = boundaries[i].listener;
+            uint32_t j = 0;
+            while (j < active_count && active[j] < listener)
+                ++j;
+            if (boundaries[i].is_end)
+            {
+                assert(j < active_count && active[j] == listener);
+                memmove(&active[j], &active[j + 1], sizeof(uint32_t) * (active_count - j - 1));
+                active_count -= 1;
+            }
+            else
             {
-                new_pages[ht_find(new_pages, ram->bucket_count, page->base_addr)] = *page;
+                memmove(&active[j + 1], &active[j], sizeof(uint32_t) * (active_count - j));
+                active[j] = listener;
+                active_count += 1;
             }
         }
 
-        // And finally, free and swap the old bucket array and the new one.
-        free(ram->buckets);
-        ram->buckets = new_pages;
-    }
+        // The segment [addr, boundaries[i].addr), the last boundary always
+        // ends a listener.
+        if (active_count == 0)
+            continue;
+        assert(i < boundary_count);
+        const addr_t addr_low = (addr_t)addr;
+        const addr_t addr_high = (addr_t)(boundaries[i].addr - 1);
 
-    init_ram_page(ram, &ram->buckets[index], base_addr);
-    ram->page_count += 1;
+        // Merge with the previous segment if it is contiguous and has the same
+        // listeners.
+        ram_listener_segment_t *previous = (set->segment_count > 0) ? &set->segments[set->segment_count - 1] : NULL;
+        if (previous != NULL && previous->addr_high + 1 == addr_low && previous->count == active_count &&
+            memcmp(&set->segment_listeners[previous->first], active, sizeof(uint32_t) * active_count) == 0)
+        {
+            previous->addr_high = addr_high;
+            continue;
+        }
+
+        if (segment_listener_count + active_count > segment_listener_capacity)
+        {
+            while (segment_listener_count + active_count > segment_listener_capacity)
+                segment_listener_capacity *= 2;
+            set->segment_listeners =
+                (uint32_t *)realloc_array(set->segment_listeners, segment_listener_capacity, sizeof(uint32_t));
+        }
+
+        // The segments refer to their listeners with 32-bits indices.
+        if (segment_listener_count > UINT32_MAX - active_count)
+            check_alloc(NULL);
 
-    return &ram->buckets[index];
+        ram_listener_segment_t *segment = &set->segments[set->segment_count++];
+        segment->addr_low = addr_low;
+        segment->addr_high = addr_high;
+        segment->first = (uint32_t)segment_listener_count;
+        segment->count = active_count;
+        memcpy(&set->segment_listeners[segment_listener_count], active, sizeof(uint32_t) * active_count);
+        segment_listener_count += active_count;
+    }
+
+    free(active);
+    free(boundaries);
 }
 
-void ram_init(ram_t *ram, const word_t *data, size_t data_len)
+static void listener_set_add(ram_listener_set_t *set, addr_t addr_low, addr_t addr_high,
+                             ram_listener_fn_t callback)
 {
-    assert(ram != NULL && data != NULL);
+    assert(addr_low <= addr_high);
 
-    addr_t base_address = 0;
-    while (base_address < data_len)
+    if (set->count == set->capacity)
     {
-        ram_page_t *page = get_ram_page(ram, base_address);
-        assert(page != NULL);
-        addr_t words_to_copy = ((data_len - base_address < ram->page_size) ? (data_len - base_address)
-                                                                           : ram->page_size);
-        memcpy(page->data, data + base_address, sizeof(word_t) * words_to_copy);
-        base_address += ram->page_size;
+        set->capacity = (set->capacity == 0) ? 4 : set->capacity * 2;
+        set->listeners = (ram_listener_t *)realloc(set->listeners, sizeof(ram_listener_t) * set->capacity);
+        check_alloc(set->listeners);
     }
-}
 
-ram_t *ram_from_file(const char *filename)
-{
-    addr_t data_len = 0;
-    word_t *data = read_file(filename, &data_len);
-    if (data == NULL)
-        file_error(filename);
+    ram_listener_t *listener = &set->listeners[set->count++];
+    listener->callback = callback;
+    listener->addr_low = addr_low;
+    listener->addr_high = addr_high;
+#ifdef RAM_ENABLE_STATS
+    listener->call_count = 0;
+#endif
 
-    ram_t *ram = ram_create();
-    ram_init(ram, data, data_len);
-    return ram;
+    listener_set_build_index(set);
 }
 
-void ram_destroy(ram_t *ram)
+// Removes all the listeners of the given set with the given callback.
+static void listener_set_remove(ram_listener_set_t *set, ram_listener_fn_t callback)
 {
-    if (ram == NULL)
-        return;
-
-#ifndef RAM_NO_READ_LISTENER
-    // Free all read listeners.
-    struct ram_read_listener_t *read_it = ram->read_listener;
-    while (read_it != NULL)
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < set->count; ++i)
     {
-        struct ram_read_listener_t *next = read_it->next;
-        free(read_it);
-        read_it = next;
+        if (set->listeners[i].callback != callback)
+            set->listeners[count++] = set->listeners[i];
     }
-#endif // !RAM_NO_READ_LISTENER
 
-#ifndef RAM_NO_WRITE_LISTENER
-    // Free all write listeners.
-    struct ram_write_listener_t *write_it = ram->write_listener;
-    while (write_it != NULL)
-    {
-        struct ram_write_listener_t *next = write_it->next;
-        free(write_it);
-        write_it = next;
-    }
-#endif // !RAM_NO_WRITE_LISTENER
+    if (count == set->count)
+        return;
 
-    for (addr_t i = 0; i < ram->bucket_count; ++i)
+    set->count = count;
+    if (count != 0)
     {
-        // free() is well defined on NULL pointers, so we don't need to check
-        // if ram->buckets[i] is a used page or NULL one.
-        free(ram->buckets[i].data);
+        listener_set_build_index(set);
+        return;
     }
 
-    free(ram->buckets);
-    free(ram);
+    free(set->segments);
+    free(set->segment_listeners);
+    set->segments = NULL;
+    set->segment_listeners = NULL;
+    set->segment_count = 0;
 }
 
-static void handle_read_listeners(ram_t *ram, addr_t addr)
+// Returns the index segment containing addr or NULL if there are no listeners
+// for addr.
+static const ram_listener_segment_t *listener_set_find(const ram_listener_set_t *set, addr_t addr)
 {
-#ifndef RAM_NO_READ_LISTENER
-    struct ram_read_listener_t *it = ram->read_listener;
-    while (it != NULL)
+    uint32_t low = 0;
+    uint32_t high = set->segment_count;
+    while (low < high)
     {
-        if (addr >= it->addr_low && addr <= it->addr_high)
-            it->callback(ram, addr);
-        it = it->next;
+        const uint32_t middle = low + (high - low) / 2;
+        const ram_listener_segment_t *segment = &set->segments[middle];
+        if (addr < segment->addr_low)
+            high = middle;
+        else if (addr > segment->addr_high)
+            low = middle + 1;
+        else
+            return segment;
     }
-#endif // !RAM_NO_READ_LISTENER
+
+    return NULL;
 }
+#endif // !RAM_NO_READ_LISTENER || !RAM_NO_WRITE_LISTENER
 
-static void handle_write_listeners(ram_t *ram, addr_t addr, word_t new_word)
+// Returns the index of the first segment of the given set that ends at or
+// after addr, or the segment count if there is none.
+static uint32_t listener_set_lower_bound(const ram_listener_set_t *set, addr_t addr)
 {
-#ifndef RAM_NO_WRITE_LISTENER
-    struct ram_write_listener_t *it = ram->write_listener;
-    while (it != NULL)
+    uint32_t low = 0;
+    uint32_t high = set->segment_count;
+    while (low < high)
     {
-        if (addr >= it->addr_low && addr <= it->addr_high)
-            it->callback(ram, addr, new_word);
-        it = it->next;
+        const uint32_t middle = low + (high - low) / 2;
+        if (set->segments[middle].addr_high < addr)
+            low = middle + 1;
+        else
+            high = middle;
     }
-#endif // !RAM_NO_WRITE_LISTENER
+
+    return low;
 }
 
-word_t ram_get(ram_t *ram, addr_t addr)
+// Checks if any listener of the given set is interested by at least one address
+// of the range [addr_low, addr_high].
+static int listener_set_intersects(const ram_listener_set_t *set, addr_t addr_low, addr_t addr_high)
 {
-    ram_page_t *page = get_ram_page(ram, addr);
-    handle_read_listeners(ram, addr);
-    return page->data[addr - page->base_addr];
+    const uint32_t first = listener_set_lower_bound(set, addr_low);
+    return first < set->segment_count && set->segments[first].addr_low <= addr_high;
 }
 
-void ram_set(ram_t *ram, addr_t addr, word_t value)
+// Checks if the given page table entry is used by a page, which may be swapped.
+static inline int page_is_used(const ram_page_t *page)
 {
-    ram_page_t *page = get_ram_page(ram, addr);
-    page->data[addr - page->base_addr] = value;
-    handle_write_listeners(ram, addr, value);
+    return page->data != NULL || (page->flags & RAM_PAGE_SWAPPED) != 0;
 }
 
-word_t ram_get_set(ram_t *ram, addr_t addr, word_t value)
+typedef struct ram_file_mapping_t
 {
-    ram_page_t *page = get_ram_page(ram, addr);
-    addr_t in_page_addr = addr - page->base_addr;
+    const word_t *data;
+    size_t data_len;
+} ram_file_mapping_t;
+
+/* The memory shared by a RAM block, its clones and their snapshots: the page
+ * allocator and the files mapped by ram_from_file() (whose pages are directly
+ * used as memory pages until they are written). It is destroyed with the last
+ * RAM or snapshot using it. */
+typedef struct ram_arena_t
+{
+    size_t refcount;
+    ram_page_allocator_t page_allocator;
+    ram_file_mapping_t *file_mappings;
+    size_t file_mapping_count;
+} ram_arena_t;
+
+static ram_arena_t *arena_create(size_t page_bytes, ram_huge_pages_t huge_pages)
+{
+    ram_arena_t *arena = (ram_arena_t *)malloc(sizeof(ram_arena_t));
+    check_alloc(arena);
+    arena->refcount = 1;
+    page_allocator_init(&arena->page_allocator, page_bytes, huge_pages);
+    arena->file_mappings = NULL;
+    arena->file_mapping_count = 0;
+    return arena;
+}
+
+static ram_arena_t *arena_retain(ram_arena_t *arena)
+{
+    ATOMIC_FETCH_ADD(&arena->refcount, 1);
+    return arena;
+}
+
+// Makes the given arena own the given file mapping returned by map_file().
+static void arena_add_file_mapping(ram_arena_t *arena, const word_t *data, size_t data_len)
+{
+    arena->file_mappings = (ram_file_mapping_t *)realloc(arena->file_mappings, sizeof(ram_file_mapping_t) *
+                                                                                   (arena->file_mapping_count + 1));
+    check_alloc(arena->file_mappings);
+    arena->file_mappings[arena->file_mapping_count].data = data;
+    arena->file_mappings[arena->file_mapping_count].data_len = data_len;
+    arena->file_mapping_count += 1;
+}
+
+static void arena_release(ram_arena_t *arena)
+{
+    assert(ATOMIC_LOAD(&arena->refcount) > 0);
+    if (ATOMIC_SUB_FETCH(&arena->refcount, 1) > 0)
+        return;
+
+    page_allocator_destroy(&arena->page_allocator);
+    for (size_t i = 0; i < arena->file_mapping_count; ++i)
+        unmap_file(arena->file_mappings[i].data, arena->file_mappings[i].data_len);
+    free(arena->file_mappings);
+    free(arena);
+}
+
+struct ram_snapshot_t
+{
+    // Keeps the pages and the mapped files alive.
+    ram_arena_t *arena;
+    addr_t page_size;
+    ram_page_t *pages;
+    addr_t page_count;
+};
+
+struct ram_t
+{
+    // Must be the first member, see the inline fast path in memory.h. It
+    // contains the page size and the page caches.
+    ram_fast_path_t fast;
+    // The backend and the page table, right after fast as in ram_core_t (see
+    // memory_core.h): the page cache misses of sparse::Ram look it up.
+    ram_page_table_t pages;
+
+    // The configuration the RAM was created with (without default values).
+    ram_config_t config;
+    // See ram_config_t::concurrent. Concurrent RAM blocks always use the radix
+    // table and never fill their page caches.
+    int concurrent;
+    // Serializes the copies on write of concurrent RAM blocks and the view
+    // registrations.
+    spin_lock_t lock;
+    // The views created by ram_view_create() and not yet destroyed.
+    ram_view_t *views;
+
+    // Hash table backend. During a resize, the pages of pages.old_table from
+    // the slot migrated_slots are not yet moved to pages.table, see
+    // ht_insert(). The capacity of pages.old_table is 0 otherwise.
+    addr_t migrated_slots;
+    addr_t page_count;
+
+    // Radix table backend. The directory of pages.radix_directory has
+    // 2^radix_dir_bits entries, each one is NULL or a leaf table of
+    // 2^radix_leaf_bits pages.
+    addr_t radix_dir_bits;
+    addr_t radix_leaf_bits;
+
+    ram_listener_set_t read_listeners;
+    ram_listener_set_t write_listeners;
+
+    // A page full of zeros, shared by all the missing pages when they are
+    // read. Pages are only really allocated on their first write.
+    word_t *zero_page;
+
+    // The base addresses of the pages removed since the last ram_clear_dirty()
+    // (by ram_discard(), ram_compact() or ram_restore()), maybe with
+    // duplicates. They are dirty pages of zeros while they are missing.
+    addr_t *removed_pages;
+    size_t removed_page_count;
+    size_t removed_page_capacity;
+
+    // Owns the memory pages, which may be shared with other RAM blocks and
+    // snapshots. Shared and file-backed pages are copied on their first write.
+    ram_arena_t *arena;
+
+    // Memory budget (see ram_config_t::max_resident_pages), 0 if unlimited.
+    // A swapped page is stored in the swap file at the offset of its words.
+    addr_t max_resident_pages;
+    addr_t swapped_page_count;
+    FILE *swap_file;
+    // The slot (see find_next_page()) of the next page the eviction clock
+    // considers.
+    size_t clock_hand;
+    // While not 0, no page is evicted as some page data is still in use.
+    int eviction_holds;
+
+    // The count of compressed pages (see ram_config_t::compressed_pages),
+    // and RAM_PAGE_CACHE_SIZE + 1 slots for decoded copies of them (the last
+    // one for the page iterations), allocated on the first use.
+    addr_t compressed_page_count;
+    word_t *decoded_pages;
+    addr_t decoded_base_addrs[RAM_PAGE_CACHE_SIZE];
+
+#ifdef RAM_ENABLE_STATS
+    // Only the counters are used, see ram_get_stats().
+    ram_stats_t stats;
+#endif
+};
+
+// Hash the given integer to have a better distribution.
+addr_t hash(addr_t x) { return ram_core_hash(x); }
+
+// The maximum count of used (or deleted) slots of a hash table of the given
+// capacity: 7/8 of it.
+static addr_t ht_max_load(addr_t capacity) { return capacity - capacity / 8; }
+
+static void ht_init(ram_hash_table_t *table, addr_t capacity)
+{
+    assert(capacity >= RAM_HT_GROUP_SIZE && (capacity & (capacity - 1)) == 0);
+    table->ctrl = (uint8_t *)calloc(capacity + RAM_HT_GROUP_SIZE, 1);
+    check_alloc(table->ctrl);
+    table->slots = (ram_page_t *)calloc(capacity, sizeof(ram_page_t));
+    check_alloc(table->slots);
+    table->capacity = capacity;
+    table->growth_left = ht_max_load(capacity);
+}
+
+static void ht_destroy(ram_hash_table_t *table)
+{
+    free(table->ctrl);
+    free(table->slots);
+    table->ctrl = NULL;
+    table->slots = NULL;
+    table->capacity = 0;
+    table->growth_left = 0;
+}
+
+// Removes all the slots of the given table (the capacity is unchanged).
+static void ht_clear(ram_hash_table_t *table)
+{
+    if (table->capacity == 0)
+        return;
+    memset(table->ctrl, RAM_HT_EMPTY, table->capacity + RAM_HT_GROUP_SIZE);
+    memset(table->slots, 0, sizeof(ram_page_t) * table->capacity);
+    table->growth_left = ht_max_load(table->capacity);
+}
+
+static void ht_set_ctrl(ram_hash_table_t *table, addr_t index, uint8_t value)
+{
+    table->ctrl[index] = value;
+    // Keep the copies of the first control bytes up to date.
+    if (index < RAM_HT_GROUP_SIZE)
+        table->ctrl[table->capacity + index] = value;
+}
+
+// Returns a free slot for the page starting at base_addr (which must be
+// missing) in the given table, which must have some growth left. The slot is
+// marked as used but its content is left to the caller.
+static ram_page_t *ht_insert_slot(ram_hash_table_t *table, addr_t base_addr)
+{
+    assert(table->growth_left > 0);
+
+    const addr_t key_hash = ram_core_hash(base_addr);
+    const addr_t index_mask = table->capacity - 1;
+    addr_t position = (key_hash >> 7) & index_mask;
+    uint64_t mask;
+    while ((mask = ram_core_ht_match_free(&table->ctrl[position])) == 0)
+        position = (position + RAM_HT_GROUP_SIZE) & index_mask;
+
+    const addr_t index = (position + ram_core_ht_first_match(mask)) & index_mask;
+    if (table->ctrl[index] == RAM_HT_EMPTY)
+        table->growth_left -= 1;
+    ht_set_ctrl(table, index, (uint8_t)(RAM_HT_USED | (key_hash & 0x7f)));
+    return &table->slots[index];
+}
+
+static void init_ram_page(ram_t *ram, ram_page_t *page, addr_t base_addr)
+{
+    page->base_addr = base_addr;
+    page->flags = 0;
+    page->data = page_allocator_alloc(&ram->arena->page_allocator);
+    RAM_STAT_ADD(ram, page_allocations, 1);
+}
+
+// Invalidates all the entries of the given page cache.
+static void flush_page_cache(ram_cached_page_t *cache)
+{
+    for (size_t i = 0; i < RAM_PAGE_CACHE_SIZE; ++i)
+    {
+        cache[i].base_addr = INVALID_BASE_ADDR;
+        cache[i].data = NULL;
+    }
+}
+
+/* A view has its own page caches, so its accesses do not touch the shared
+ * caches of the RAM block. Its caches only contain private pages (neither
+ * shared nor file-backed) without listeners of the corresponding kind: such
+ * pages keep their data until the RAM's pages are released, shared or get
+ * listeners, which are all operations that flush the caches of the views.
+ * Accesses to missing pages are never cached, as another thread may create
+ * them at any time. */
+struct ram_view_t
+{
+    // Same layout as the RAM's one, only the caches are used.
+    ram_fast_path_t fast;
+    ram_t *ram;
+    int concurrent;
+    struct ram_view_t *next;
+
+    // The writes whose write listeners are not called yet.
+    addr_t pending_addrs[RAM_VIEW_MAX_PENDING_WRITES];
+    word_t pending_values[RAM_VIEW_MAX_PENDING_WRITES];
+    size_t pending_count;
+};
+
+// Flushes the given caches (read and/or write) of the given RAM block and of
+// all its views.
+static void flush_caches(ram_t *ram, int read, int write)
+{
+    for (ram_fast_path_t *fast = &ram->fast; fast != NULL;)
+    {
+        if (read)
+            flush_page_cache(fast->read_cache);
+        if (write)
+            flush_page_cache(fast->write_cache);
+
+        // The views are all traversed, starting with the RAM's own caches.
+        ram_view_t *view = (fast == &ram->fast) ? ram->views : ((ram_view_t *)fast)->next;
+        fast = (view != NULL) ? &view->fast : NULL;
+    }
+}
+
+// Updates the direct accesses of the page cache misses of sparse::Ram (see
+// ram_page_table_t), after a change of the listeners of the given RAM block.
+static void update_direct_access(ram_t *ram)
+{
+#if defined(RAM_ENABLE_STATS) || defined(RAM_ENABLE_PAGE_STATS)
+    // The direct accesses are not counted.
+    ram->pages.direct_reads = 0;
+    ram->pages.direct_writes = 0;
+#else
+    const int direct = !ram->concurrent && ram->max_resident_pages == 0;
+    ram->pages.direct_reads = direct && ram->read_listeners.count == 0;
+    ram->pages.direct_writes = direct && ram->write_listeners.count == 0;
+#endif
+}
+
+ram_config_t ram_default_config()
+{
+    ram_config_t config;
+    config.backend = RAM_DEFAULT_BACKEND;
+    config.page_size = 0;
+    config.initial_bucket_count = 0;
+    config.huge_pages = RAM_HUGE_PAGES_NONE;
+    config.concurrent = 0;
+    config.max_resident_pages = 0;
+    config.swap_file = NULL;
+    config.compressed_pages = 0;
+    return config;
+}
+
+ram_t *ram_create() { return ram_create_with_backend(RAM_DEFAULT_BACKEND); }
+
+ram_t *ram_create_with_backend(ram_backend_t backend)
+{
+    ram_config_t config = ram_default_config();
+    config.backend = backend;
+    return ram_create_ex(&config);
+}
+
+// Returns 1 if x is a power of 2, at least 2.
+static int is_power_of_2_at_least_2(addr_t x) { return x >= 2 && (x & (x - 1)) == 0; }
+
+ram_t *ram_create_ex(const ram_config_t *config)
+{
+    assert(config != NULL);
+
+    if ((config->page_size != 0 && !is_power_of_2_at_least_2(config->page_size)) ||
+        (config->initial_bucket_count != 0 && !is_power_of_2_at_least_2(config->initial_bucket_count)))
+        return NULL;
+
+    ram_t *ram = (ram_t *)malloc(sizeof(ram_t));
+    check_alloc(ram);
+
+    ram->config = *config;
+    ram->concurrent = config->concurrent;
+#ifdef RAM_ENABLE_STATS
+    memset(&ram->stats, 0, sizeof(ram->stats));
+#endif
+    ram->lock = 0;
+    ram->views = NULL;
+#if !HAS_ATOMICS
+    if (ram->concurrent)
+    {
+        fprintf(stderr, "error: concurrent RAM blocks are not supported by this compiler\n");
+        abort();
+    }
+#endif
+
+    // The radix table is the only backend whose entries can be installed
+    // without a lock (a hash table resize would move all of them).
+    const ram_backend_t backend = ram->concurrent ? RAM_BACKEND_RADIX_TABLE : config->backend;
+    ram->pages.backend = backend;
+
+    listener_set_init(&ram->read_listeners);
+    listener_set_init(&ram->write_listeners);
+
+    // Precompute the RAM's page size. A page has at least two words, so
+    // INVALID_BASE_ADDR is never a page base address.
+    ram->fast.page_size = (config->page_size != 0) ? config->page_size : get_os_memory_page() / sizeof(word_t);
+    assert(ram->fast.page_size >= 2 && ram->fast.page_size <= ((addr_t)1 << 31));
+    assert((ram->fast.page_size & (ram->fast.page_size - 1)) == 0 && "page size must be a power of 2");
+    ram->fast.page_shift = 0;
+    while (((addr_t)1 << ram->fast.page_shift) < ram->fast.page_size)
+        ram->fast.page_shift += 1;
+
+    flush_page_cache(ram->fast.read_cache);
+    flush_page_cache(ram->fast.write_cache);
+
+    ram->zero_page = (word_t *)calloc(sizeof(word_t), ram->fast.page_size);
+    check_alloc(ram->zero_page);
+    ram->removed_pages = NULL;
+    ram->removed_page_count = 0;
+    ram->removed_page_capacity = 0;
+    ram->arena = arena_create(sizeof(word_t) * ram->fast.page_size, config->huge_pages);
+
+    // Memory pages are created lazily, on their first write.
+    ram->page_count = 0;
+    ram->pages.table.ctrl = NULL;
+    ram->pages.table.slots = NULL;
+    ram->pages.table.capacity = 0;
+    ram->pages.table.growth_left = 0;
+    ram->pages.old_table = ram->pages.table;
+    ram->migrated_slots = 0;
+    ram->pages.radix_directory = NULL;
+    ram->radix_dir_bits = 0;
+    ram->radix_leaf_bits = 0;
+
+    assert((config->max_resident_pages == 0 || !config->concurrent) &&
+           "concurrent RAM blocks do not support a memory budget");
+    ram->max_resident_pages = config->max_resident_pages;
+    ram->swapped_page_count = 0;
+    ram->swap_file = NULL;
+    ram->clock_hand = 0;
+    ram->eviction_holds = 0;
+    // The path is only used here (and clones get their own swap file).
+    ram->config.swap_file = NULL;
+    update_direct_access(ram);
+
+    assert((!config->compressed_pages || !config->concurrent) &&
+           "concurrent RAM blocks do not support compressed pages");
+    ram->compressed_page_count = 0;
+    ram->decoded_pages = NULL;
+    for (size_t i = 0; i < RAM_PAGE_CACHE_SIZE; ++i)
+        ram->decoded_base_addrs[i] = INVALID_BASE_ADDR;
+
+    switch (backend)
+    {
+    case RAM_BACKEND_HASH_TABLE:
+    {
+        const addr_t bucket_count = (config->initial_bucket_count != 0) ? config->initial_bucket_count
+                                                                         : INITIAL_RAM_HT_SIZE;
+        ht_init(&ram->pages.table, (bucket_count > RAM_HT_GROUP_SIZE) ? bucket_count : RAM_HT_GROUP_SIZE);
+        break;
+    }
+    case RAM_BACKEND_RADIX_TABLE:
+    {
+        // Split the page number bits between the directory and the leaves.
+        const addr_t page_number_bits = 32 - ram->fast.page_shift;
+        ram->radix_leaf_bits = ram_core_radix_leaf_bits(ram->fast.page_shift);
+        ram->radix_dir_bits = page_number_bits - ram->radix_leaf_bits;
+        ram->pages.radix_directory = (ram_page_t **)calloc((size_t)1 << ram->radix_dir_bits, sizeof(ram_page_t *));
+        check_alloc(ram->pages.radix_directory);
+        break;
+    }
+    default:
+        assert(0 && "invalid RAM backend");
+        abort();
+    }
+
+    if (ram->max_resident_pages != 0)
+    {
+        ram->swap_file = (config->swap_file != NULL) ? fopen(config->swap_file, "w+b") : tmpfile();
+        if (ram->swap_file == NULL)
+        {
+            ram_destroy(ram);
+            return NULL;
+        }
+#if IS_POSIX
+        // The file stays usable until closed and is not left behind.
+        if (config->swap_file != NULL)
+            unlink(config->swap_file);
+#endif
+    }
+
+    return ram;
+}
+
+/* The hash table is resized incrementally, so that no single access moves all
+ * the pages: the new table (of twice the capacity, or of the same one to get
+ * rid of many deleted slots) replaces the previous one at once for the
+ * insertions, and each insertion then moves the pages of the next
+ * RAM_HT_MIGRATION_STEP slots of the previous table. The previous table
+ * is empty (and freed) well before the new one is full, and until then the
+ * lookups search both tables. */
+
+// Moves the pages of the next slot_count slots (at most) of the previous hash
+// table to the new one, and frees the previous table once it is empty.
+static void ht_migrate(ram_t *ram, addr_t slot_count)
+{
+    ram_hash_table_t *old_table = &ram->pages.old_table;
+    const addr_t end = (slot_count < old_table->capacity - ram->migrated_slots) ? ram->migrated_slots + slot_count
+                                                                                 : old_table->capacity;
+    for (addr_t i = ram->migrated_slots; i < end; ++i)
+    {
+        ram_page_t *page = &old_table->slots[i];
+        if (!page_is_used(page))
+            continue;
+
+        *ht_insert_slot(&ram->pages.table, page->base_addr) = *page;
+        // The slot is deleted and not emptied, so the probe sequences of the
+        // pages still in the previous table are not cut.
+        memset(page, 0, sizeof(ram_page_t));
+        ht_set_ctrl(old_table, i, RAM_HT_DELETED);
+    }
+
+    ram->migrated_slots = end;
+    if (end == old_table->capacity)
+        ht_destroy(old_table);
+}
+
+// Moves all the pages of the hash table to a new table of the given capacity,
+// at once.
+static void ht_rebuild(ram_t *ram, addr_t capacity)
+{
+    if (ram->pages.old_table.capacity != 0)
+        ht_migrate(ram, ram->pages.old_table.capacity);
+
+    ram->pages.old_table = ram->pages.table;
+    ht_init(&ram->pages.table, capacity);
+    ram->migrated_slots = 0;
+    ht_migrate(ram, ram->pages.old_table.capacity);
+}
+
+// Removes the given used slot of the hash table (of the new or the previous
+// one during a resize). The slot is deleted and not emptied: like for the
+// migrated slots, the probe sequences going through it are not cut.
+static void ht_erase(ram_t *ram, ram_page_t *slot)
+{
+    ram_hash_table_t *table = &ram->pages.table;
+    if ((uintptr_t)slot - (uintptr_t)table->slots >= sizeof(ram_page_t) * table->capacity)
+        table = &ram->pages.old_table;
+
+    memset(slot, 0, sizeof(ram_page_t));
+    ht_set_ctrl(table, (addr_t)(slot - table->slots), RAM_HT_DELETED);
+}
+
+// Same as ram_core_ht_find() but for the hash table of the given RAM block,
+// which may be being resized.
+static ram_page_t *ht_lookup(const ram_t *ram, addr_t base_addr, addr_t *group_count)
+{
+    return ram_core_find_page(&ram->pages, base_addr, ram->fast.page_shift, RAM_BACKEND_HASH_TABLE, group_count);
+}
+
+// Inserts a new (empty) entry for the memory page starting at base_addr into
+// the hash table, resizing it if needed. The page must not already be present.
+static ram_page_t *ht_insert(ram_t *ram, addr_t base_addr)
+{
+    if (ram->pages.old_table.capacity == 0 && ram->pages.table.growth_left > 0)
+        return ht_insert_slot(&ram->pages.table, base_addr);
+
+#ifdef RAM_ENABLE_STATS
+    const uint64_t resize_begin_ns = get_time_ns();
+#endif
+
+    // If the maximum load factor is reached, start a resize. We always keep
+    // some empty slots, otherwise ram_core_ht_find() would loop forever when
+    // searching a missing page. The deleted slots (see ht_erase()) are not reusable
+    // growth, so when they are many the table keeps its capacity and is only
+    // rebuilt without them.
+    if (ram->pages.table.growth_left == 0)
+    {
+        // The previous resize is always finished by now (the new table has
+        // room for far more insertions than the migration takes), this only
+        // keeps the tables consistent otherwise.
+        if (ram->pages.old_table.capacity != 0)
+            ht_migrate(ram, ram->pages.old_table.capacity);
+
+        const addr_t capacity = ram->pages.table.capacity;
+        ram->pages.old_table = ram->pages.table;
+        ht_init(&ram->pages.table, (ram->page_count > ht_max_load(capacity) / 2) ? capacity * 2 : capacity);
+        ram->migrated_slots = 0;
+        RAM_STAT_ADD(ram, ht_resizes, 1);
+    }
+
+    ht_migrate(ram, RAM_HT_MIGRATION_STEP);
+    RAM_STAT_ADD(ram, ht_resize_ns, get_time_ns() - resize_begin_ns);
+    return ht_insert_slot(&ram->pages.table, base_addr);
+}
+
+// Returns the radix table entry for the memory page starting at base_addr. If
+// create is false and the page's leaf table does not exist, NULL is returned.
+static ram_page_t *radix_find(ram_t *ram, addr_t base_addr, int create)
+{
+    const addr_t page_number = base_addr >> ram->fast.page_shift;
+    const addr_t dir_index = page_number >> ram->radix_leaf_bits;
+    const addr_t leaf_index = page_number & (((addr_t)1 << ram->radix_leaf_bits) - 1);
+
+    // The leaf tables of concurrent RAM blocks are installed with a CAS, the
+    // loser of a race frees its own.
+    ram_page_t *leaf = ATOMIC_LOAD(&ram->pages.radix_directory[dir_index]);
+    if (leaf == NULL)
+    {
+        if (!create)
+            return NULL;
+
+        ram_page_t *new_leaf = (ram_page_t *)calloc((size_t)1 << ram->radix_leaf_bits, sizeof(ram_page_t));
+        check_alloc(new_leaf);
+        if (ATOMIC_CAS(&ram->pages.radix_directory[dir_index], &leaf, new_leaf))
+            leaf = new_leaf;
+        else
+            free(new_leaf);
+    }
+
+    return &leaf[leaf_index];
+}
+
+/* Page iteration. The pages are identified by their slot in the page table:
+ * the slot index for the hash table (the slots of the previous table during a
+ * resize follow the ones of the new table), and the directory index followed
+ * by the leaf index for the radix table. */
+
+// Returns the first page of the given RAM block whose slot is at least *slot
+// and that has all the given flags, or NULL if there is none. *slot is set to
+// the slot of the returned page.
+static ram_page_t *find_next_page(ram_t *ram, size_t *slot, uint32_t flags)
+{
+    if (ram->pages.backend == RAM_BACKEND_RADIX_TABLE)
+    {
+        const size_t dir_size = (size_t)1 << ram->radix_dir_bits;
+        const size_t leaf_size = (size_t)1 << ram->radix_leaf_bits;
+        for (size_t i = *slot >> ram->radix_leaf_bits; i < dir_size; ++i)
+        {
+            ram_page_t *leaf = ram->pages.radix_directory[i];
+            if (leaf == NULL)
+                continue;
+
+            const size_t first = (i == (*slot >> ram->radix_leaf_bits)) ? (*slot & (leaf_size - 1)) : 0;
+            for (size_t j = first; j < leaf_size; ++j)
+            {
+                if (page_is_used(&leaf[j]) && (leaf[j].flags & flags) == flags)
+                {
+                    *slot = (i << ram->radix_leaf_bits) | j;
+                    return &leaf[j];
+                }
+            }
+        }
+    }
+    else
+    {
+        const size_t capacity = ram->pages.table.capacity;
+        for (size_t i = *slot; i < capacity + ram->pages.old_table.capacity; ++i)
+        {
+            ram_page_t *page = (i < capacity) ? &ram->pages.table.slots[i] : &ram->pages.old_table.slots[i - capacity];
+            if (page_is_used(page) && (page->flags & flags) == flags)
+            {
+                *slot = i;
+                return page;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Memory budget. When a RAM block has more resident pages than its
+ * max_resident_pages, pages are evicted to its swap file, and read back by
+ * find_ram_page() on their next lookup. The victims are chosen by the CLOCK
+ * algorithm: the clock hand goes through the page table, and evicts the first
+ * page that was not looked up since the previous turn (nor is in the page
+ * caches on the first turn, as they hold the hottest pages). Shared and
+ * file-backed pages are skipped, evicting them would not free their memory,
+ * and so are the compressed pages, which are small.
+ *
+ * A page is stored in the swap file at the offset of its words in the address
+ * space, so the file is sparse and needs no allocation of its own. */
+
+// Maximum count of pages considered by the clock hand per call of
+// enforce_memory_budget(), so that a RAM block with mostly unevictable pages
+// does not scan all of them at each new page. The budget is then exceeded
+// until the next calls find victims.
+#define RAM_CLOCK_MAX_STEPS 1024
+
+// Reads (or writes, if write is true) the given page data from (to) its place
+// in the swap file of the given RAM block.
+static void swap_file_io(ram_t *ram, addr_t base_addr, word_t *data, int write)
+{
+    const size_t page_bytes = sizeof(word_t) * ram->fast.page_size;
+    const uint64_t offset = sizeof(word_t) * (uint64_t)base_addr;
+#if IS_POSIX
+    const int fd = fileno(ram->swap_file);
+    const ssize_t done = write ? pwrite(fd, data, page_bytes, (off_t)offset) : pread(fd, data, page_bytes, (off_t)offset);
+    const int failed = done != (ssize_t)page_bytes;
+#else
+#ifdef _WIN32
+    int failed = _fseeki64(ram->swap_file, (__int64)offset, SEEK_SET) != 0;
+#else
+    int failed = fseek(ram->swap_file, (long)offset, SEEK_SET) != 0;
+#endif
+    if (!failed)
+        failed = (write ? fwrite(data, page_bytes, 1, ram->swap_file) : fread(data, page_bytes, 1, ram->swap_file)) != 1;
+#endif
+
+    // Like for an allocation failure, the content of the RAM block is lost.
+    if (failed)
+    {
+        fprintf(stderr, "error: failed to %s the swap file\n", write ? "write" : "read");
+        abort();
+    }
+}
+
+// Removes the given page from the page caches of the given RAM block and of
+// all its views.
+static void uncache_page(ram_t *ram, addr_t base_addr)
+{
+    const addr_t index = RAM_PAGE_CACHE_INDEX(&ram->fast, base_addr);
+    for (ram_fast_path_t *fast = &ram->fast; fast != NULL;)
+    {
+        if (fast->read_cache[index].base_addr == base_addr)
+            fast->read_cache[index].base_addr = INVALID_BASE_ADDR;
+        if (fast->write_cache[index].base_addr == base_addr)
+            fast->write_cache[index].base_addr = INVALID_BASE_ADDR;
+
+        ram_view_t *view = (fast == &ram->fast) ? ram->views : ((ram_view_t *)fast)->next;
+        fast = (view != NULL) ? &view->fast : NULL;
+    }
+}
+
+// Checks if the given page is in the page caches of the given RAM block.
+static inline int page_is_cached(const ram_t *ram, addr_t base_addr)
+{
+    const addr_t index = RAM_PAGE_CACHE_INDEX(&ram->fast, base_addr);
+    return ram->fast.read_cache[index].base_addr == base_addr || ram->fast.write_cache[index].base_addr == base_addr;
+}
+
+// Writes the given resident (and private) page to the swap file and frees its
+// memory.
+static void evict_ram_page(ram_t *ram, ram_page_t *page)
+{
+    // Pages of zeros are only flagged.
+    if (memcmp(page->data, ram->zero_page, sizeof(word_t) * ram->fast.page_size) == 0)
+        page->flags |= RAM_PAGE_SWAPPED_ZERO;
+    else
+        swap_file_io(ram, page->base_addr, page->data, 1);
+
+    uncache_page(ram, page->base_addr);
+    page_release(&ram->arena->page_allocator, page->data);
+    page->data = NULL;
+    page->flags = (page->flags & ~(RAM_PAGE_REFERENCED | RAM_PAGE_WRITABLE)) | RAM_PAGE_SWAPPED;
+    ram->swapped_page_count += 1;
+    RAM_STAT_ADD(ram, page_evictions, 1);
+}
+
+// Returns the count of pages of the given RAM block counted in its memory
+// budget. The compressed pages are small, only the dense pages count.
+static addr_t resident_page_count(const ram_t *ram)
+{
+    return ram->page_count - ram->swapped_page_count - ram->compressed_page_count;
+}
+
+// Evicts pages of the given RAM block until extra_pages more pages fit in its
+// memory budget (or no victim is found).
+static void enforce_memory_budget(ram_t *ram, addr_t extra_pages)
+{
+    if (ram->max_resident_pages == 0 || ram->eviction_holds != 0)
+        return;
+
+    const ram_page_allocator_t *allocator = &ram->arena->page_allocator;
+    for (size_t step = 0; step < RAM_CLOCK_MAX_STEPS; ++step)
+    {
+        if (resident_page_count(ram) + extra_pages <= ram->max_resident_pages)
+            return;
+
+        ram_page_t *page = find_next_page(ram, &ram->clock_hand, 0);
+        if (page == NULL)
+        {
+            // The hand wraps around.
+            ram->clock_hand = 0;
+            page = find_next_page(ram, &ram->clock_hand, 0);
+            if (page == NULL)
+                return;
+        }
+        ram->clock_hand += 1;
+
+        if (page->data == NULL || (page->flags & (RAM_PAGE_FILE_BACKED | RAM_PAGE_COMPRESSED)) != 0 ||
+            page_is_shared(allocator, page->data))
+            continue;
+        if ((page->flags & RAM_PAGE_REFERENCED) != 0)
+        {
+            // Second chance.
+            page->flags &= ~RAM_PAGE_REFERENCED;
+            continue;
+        }
+        if (step < ram->page_count && page_is_cached(ram, page->base_addr))
+            continue;
+
+        evict_ram_page(ram, page);
+    }
+}
+
+// Reads the given evicted page of the given RAM block back into memory.
+static void swap_in_ram_page(ram_t *ram, ram_page_t *page)
+{
+    enforce_memory_budget(ram, 1);
+
+    word_t *data = page_allocator_alloc(&ram->arena->page_allocator);
+    if ((page->flags & RAM_PAGE_SWAPPED_ZERO) == 0)
+        swap_file_io(ram, page->base_addr, data, 0);
+    page->data = data;
+    page->flags &= ~(RAM_PAGE_SWAPPED | RAM_PAGE_SWAPPED_ZERO);
+    ram->swapped_page_count -= 1;
+    RAM_STAT_ADD(ram, page_swap_ins, 1);
+}
+
+// Prevents the evictions of the given RAM block while the caller uses the data
+// of several pages at once, until the matching release_evictions().
+static inline void hold_evictions(ram_t *ram) { ram->eviction_holds += 1; }
+
+static void release_evictions(ram_t *ram)
+{
+    ram->eviction_holds -= 1;
+    enforce_memory_budget(ram, 0);
+}
+
+/* Compressed pages (see ram_config_t::compressed_pages). A page with few
+ * distinct words is stored as a ram_compressed_page_t: the value of most of its
+ * words, and the other words as (offset, value) pairs sorted by offset (a
+ * uniform page has none). Its data points to the ram_compressed_page_t, and it
+ * has the RAM_PAGE_COMPRESSED flag. The writes of ram_set() keep a page
+ * compressed while it has at most RAM_COMPRESSED_PAGE_MAX_PAIRS pairs, all the
+ * other writes need the words in memory, so they promote the page to a dense
+ * one first.
+ *
+ * The reads needing the words of a compressed page get a decoded copy, in the
+ * decoded page slot of the page's index in the page caches. The pages of a
+ * slot compete for the same entry of the page caches anyway, so the decoded
+ * copies stay in the read caches until another page needs the slot. The
+ * writes to a compressed page update its decoded copy too. */
+
+// The pairs of a compressed page take at most a quarter of a dense page.
+#define RAM_COMPRESSED_PAGE_MAX_PAIRS(page_size) ((page_size) / 8)
+
+typedef struct ram_compressed_pair_t
+{
+    addr_t offset;
+    word_t value;
+} ram_compressed_pair_t;
+
+typedef struct ram_compressed_page_t
+{
+    // The value of the words without a pair.
+    word_t fill;
+    uint32_t count;
+    uint32_t capacity;
+    ram_compressed_pair_t pairs[];
+} ram_compressed_page_t;
+
+static ram_compressed_page_t *compressed_page_create(word_t fill, uint32_t capacity)
+{
+    ram_compressed_page_t *page =
+        (ram_compressed_page_t *)malloc(sizeof(ram_compressed_page_t) + sizeof(ram_compressed_pair_t) * capacity);
+    check_alloc(page);
+    page->fill = fill;
+    page->count = 0;
+    page->capacity = capacity;
+    return page;
+}
+
+// Writes the page_size words of the given compressed page to words.
+static void compressed_page_decode(const ram_compressed_page_t *page, word_t *words, addr_t page_size)
+{
+    if (page->fill == 0)
+    {
+        memset(words, 0, sizeof(word_t) * page_size);
+    }
+    else
+    {
+        for (addr_t i = 0; i < page_size; ++i)
+            words[i] = page->fill;
+    }
+
+    for (uint32_t i = 0; i < page->count; ++i)
+        words[page->pairs[i].offset] = page->pairs[i].value;
+}
+
+// Makes the given copy of a page table entry (for a snapshot, or a RAM block
+// using the same arena) own its data too.
+static void share_page_data(ram_page_allocator_t *allocator, ram_page_t *page)
+{
+    if ((page->flags & RAM_PAGE_COMPRESSED) != 0)
+    {
+        // Copying the few pairs is cheaper than counting the references.
+        const ram_compressed_page_t *compressed = (const ram_compressed_page_t *)page->data;
+        ram_compressed_page_t *copy = compressed_page_create(compressed->fill, compressed->count);
+        copy->count = compressed->count;
+        memcpy(copy->pairs, compressed->pairs, sizeof(ram_compressed_pair_t) * compressed->count);
+        page->data = (word_t *)copy;
+    }
+    else if ((page->flags & RAM_PAGE_FILE_BACKED) == 0)
+    {
+        page_retain(allocator, page->data);
+    }
+}
+
+// Releases the data of the given page table entry (of a RAM block or a
+// snapshot), if any.
+static void release_page_data(ram_page_allocator_t *allocator, const ram_page_t *page)
+{
+    if ((page->flags & RAM_PAGE_COMPRESSED) != 0)
+        free(page->data);
+    else if (page->data != NULL && (page->flags & RAM_PAGE_FILE_BACKED) == 0)
+        page_release(allocator, page->data);
+}
+
+// Frees the decoded copy of the given page, which is written or removed. The
+// caller must remove the page from the page caches.
+static inline void forget_decoded_page(ram_t *ram, addr_t base_addr)
+{
+    const addr_t slot = RAM_PAGE_CACHE_INDEX(&ram->fast, base_addr);
+    if (ram->decoded_base_addrs[slot] == base_addr)
+        ram->decoded_base_addrs[slot] = INVALID_BASE_ADDR;
+}
+
+// Returns the words of the given decoded page slot.
+static word_t *decoded_page_slot(ram_t *ram, addr_t slot)
+{
+    if (ram->decoded_pages == NULL)
+    {
+        ram->decoded_pages = (word_t *)malloc(sizeof(word_t) * (RAM_PAGE_CACHE_SIZE + 1) * ram->fast.page_size);
+        check_alloc(ram->decoded_pages);
+    }
+    return ram->decoded_pages + (size_t)slot * ram->fast.page_size;
+}
+
+// Returns the decoded copy, in its slot, of the given compressed page.
+static word_t *decode_compressed_page(ram_t *ram, const ram_page_t *page)
+{
+    const addr_t slot = RAM_PAGE_CACHE_INDEX(&ram->fast, page->base_addr);
+    word_t *words = decoded_page_slot(ram, slot);
+    if (ram->decoded_base_addrs[slot] != page->base_addr)
+    {
+        // The previous copy may still be in the page caches.
+        if (ram->decoded_base_addrs[slot] != INVALID_BASE_ADDR)
+            uncache_page(ram, ram->decoded_base_addrs[slot]);
+        compressed_page_decode((const ram_compressed_page_t *)page->data, words, ram->fast.page_size);
+        ram->decoded_base_addrs[slot] = page->base_addr;
+    }
+    return words;
+}
+
+// Returns the words of the given page, for the page iterations: a decoded copy
+// (valid until the next call) if the page is compressed.
+static const word_t *page_words(ram_t *ram, const ram_page_t *page)
+{
+    if ((page->flags & RAM_PAGE_COMPRESSED) == 0)
+        return page->data;
+
+    word_t *words = decoded_page_slot(ram, RAM_PAGE_CACHE_SIZE);
+    compressed_page_decode((const ram_compressed_page_t *)page->data, words, ram->fast.page_size);
+    return words;
+}
+
+// Sets the word at the given offset of the given compressed page. Returns 0,
+// without changing anything, if the page would need more pairs than it can
+// have.
+static int compressed_page_set(ram_t *ram, ram_page_t *page, addr_t offset, word_t value)
+{
+    ram_compressed_page_t *compressed = (ram_compressed_page_t *)page->data;
+
+    // The first pair whose offset is not smaller.
+    uint32_t low = 0, high = compressed->count;
+    while (low < high)
+    {
+        const uint32_t middle = low + (high - low) / 2;
+        if (compressed->pairs[middle].offset < offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    ram_compressed_pair_t *pair = &compressed->pairs[low];
+    if (low < compressed->count && pair->offset == offset)
+    {
+        if (value != compressed->fill)
+        {
+            pair->value = value;
+        }
+        else
+        {
+            memmove(pair, pair + 1, sizeof(ram_compressed_pair_t) * (compressed->count - low - 1));
+            compressed->count -= 1;
+        }
+    }
+    else if (value != compressed->fill)
+    {
+        const uint32_t max_pairs = RAM_COMPRESSED_PAGE_MAX_PAIRS(ram->fast.page_size);
+        if (compressed->count == max_pairs)
+            return 0;
+
+        if (compressed->count == compressed->capacity)
+        {
+            uint32_t capacity = (compressed->capacity < 2) ? 4 : 2 * compressed->capacity;
+            if (capacity > max_pairs)
+                capacity = max_pairs;
+            compressed = (ram_compressed_page_t *)realloc(
+                compressed, sizeof(ram_compressed_page_t) + sizeof(ram_compressed_pair_t) * capacity);
+            check_alloc(compressed);
+            compressed->capacity = capacity;
+            page->data = (word_t *)compressed;
+            pair = &compressed->pairs[low];
+        }
+
+        memmove(pair + 1, pair, sizeof(ram_compressed_pair_t) * (compressed->count - low));
+        pair->offset = offset;
+        pair->value = value;
+        compressed->count += 1;
+    }
+
+    const addr_t slot = RAM_PAGE_CACHE_INDEX(&ram->fast, page->base_addr);
+    if (ram->decoded_base_addrs[slot] == page->base_addr)
+        ram->decoded_pages[(size_t)slot * ram->fast.page_size + offset] = value;
+    return 1;
+}
+
+// Replaces the given compressed page of the given RAM block by a dense page.
+static void promote_compressed_page(ram_t *ram, ram_page_t *page)
+{
+    // The page is counted as dense only once it is.
+    enforce_memory_budget(ram, 1);
+
+    ram_compressed_page_t *compressed = (ram_compressed_page_t *)page->data;
+    word_t *data = page_allocator_alloc(&ram->arena->page_allocator);
+    compressed_page_decode(compressed, data, ram->fast.page_size);
+    free(compressed);
+    page->data = data;
+    page->flags &= ~RAM_PAGE_COMPRESSED;
+    ram->compressed_page_count -= 1;
+
+    uncache_page(ram, page->base_addr);
+    forget_decoded_page(ram, page->base_addr);
+    RAM_STAT_ADD(ram, page_allocations, 1);
+    RAM_STAT_ADD(ram, page_promotions, 1);
+}
+
+// Replaces the given dense page of the given RAM block by a compressed page,
+// if it has few enough distinct words. Returns 1 if the page is compressed.
+// The caller must flush the page caches.
+static int compress_dense_page(ram_t *ram, ram_page_t *page)
+{
+    // The memory of the shared and file-backed pages is not only this page's.
+    ram_page_allocator_t *allocator = &ram->arena->page_allocator;
+    if ((page->flags & RAM_PAGE_FILE_BACKED) != 0 || page_is_shared(allocator, page->data))
+        return 0;
+
+    // The most common word is assumed to be either 0 or the first one.
+    const word_t *data = page->data;
+    const uint32_t max_pairs = RAM_COMPRESSED_PAGE_MAX_PAIRS(ram->fast.page_size);
+    uint32_t other_words[2] = {0, 0};
+    for (addr_t i = 0; i < ram->fast.page_size; ++i)
+    {
+        other_words[0] += (data[i] != 0);
+        other_words[1] += (data[i] != data[0]);
+        if (other_words[0] > max_pairs && other_words[1] > max_pairs)
+            return 0;
+    }
+
+    const int zero_fill = other_words[0] <= other_words[1];
+    const word_t fill = zero_fill ? 0 : data[0];
+    ram_compressed_page_t *compressed = compressed_page_create(fill, zero_fill ? other_words[0] : other_words[1]);
+    for (addr_t i = 0; i < ram->fast.page_size; ++i)
+    {
+        if (data[i] != fill)
+        {
+            compressed->pairs[compressed->count].offset = i;
+            compressed->pairs[compressed->count].value = data[i];
+            compressed->count += 1;
+        }
+    }
+
+    page_discard(allocator, page->data);
+    page->data = (word_t *)compressed;
+    page->flags = (page->flags & ~RAM_PAGE_WRITABLE) | RAM_PAGE_COMPRESSED;
+    ram->compressed_page_count += 1;
+    forget_decoded_page(ram, page->base_addr);
+    return 1;
+}
+
+// Returns the page table entry of the memory page starting at base_addr if it
+// exists, or NULL. Contrary to find_ram_page(), a swapped page stays swapped.
+static ram_page_t *find_page_entry(ram_t *ram, addr_t base_addr)
+{
+    ram_page_t *page;
+    if (ram->pages.backend == RAM_BACKEND_RADIX_TABLE)
+        page = radix_find(ram, base_addr, 0);
+    else
+        page = ht_lookup(ram, base_addr, NULL);
+    return (page != NULL && page_is_used(page)) ? page : NULL;
+}
+
+// Returns the memory page starting at base_addr or NULL if it does not exist.
+static ram_page_t *find_ram_page(ram_t *ram, addr_t base_addr)
+{
+    RAM_STAT_ADD(ram, page_lookups, 1);
+
+    ram_page_t *page;
+    if (ram->pages.backend == RAM_BACKEND_RADIX_TABLE)
+    {
+        page = radix_find(ram, base_addr, 0);
+    }
+    else
+    {
+#ifdef RAM_ENABLE_STATS
+        addr_t group_count = 0;
+        page = ht_lookup(ram, base_addr, &group_count);
+        RAM_STAT_ADD(ram, ht_lookups, 1);
+        RAM_STAT_ADD(ram, ht_probes, group_count);
+        RAM_STAT_MAX(ram, ht_max_probe_length, (uint64_t)group_count);
+#else
+        page = ht_lookup(ram, base_addr, NULL);
+#endif
+    }
+
+    if (page == NULL || !page_is_used(page))
+        return NULL;
+
+    if (ram->max_resident_pages != 0)
+    {
+        if (page->data == NULL)
+            swap_in_ram_page(ram, page);
+        page->flags |= RAM_PAGE_REFERENCED;
+    }
+    return page;
+}
+
+// Returns a new (empty) entry for the memory page starting at base_addr that
+// must be initialized by the caller. The page must not already be present.
+static ram_page_t *insert_ram_page(ram_t *ram, addr_t base_addr)
+{
+    if (ram->pages.backend == RAM_BACKEND_RADIX_TABLE)
+        return radix_find(ram, base_addr, 1);
+    else
+        return ht_insert(ram, base_addr);
+}
+
+// Adds to the given RAM block (where it must be missing) a compressed page
+// whose words are all equal to fill.
+static ram_page_t *insert_compressed_page(ram_t *ram, addr_t base_addr, word_t fill)
+{
+    ram_page_t *page = insert_ram_page(ram, base_addr);
+    page->base_addr = base_addr;
+    page->flags = RAM_PAGE_COMPRESSED;
+    page->data = (word_t *)compressed_page_create(fill, 0);
+    ram->page_count += 1;
+    ram->compressed_page_count += 1;
+
+    // The read caches may still map this page to the zero page.
+    uncache_page(ram, base_addr);
+    return page;
+}
+
+static int compare_addrs(const void *a, const void *b)
+{
+    const addr_t x = *(const addr_t *)a;
+    const addr_t y = *(const addr_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts the removed pages of the given RAM block and removes the duplicates.
+static void dedup_removed_pages(ram_t *ram)
+{
+    if (ram->removed_page_count < 2)
+        return;
+
+    qsort(ram->removed_pages, ram->removed_page_count, sizeof(addr_t), &compare_addrs);
+    size_t count = 1;
+    for (size_t i = 1; i < ram->removed_page_count; ++i)
+    {
+        if (ram->removed_pages[i] != ram->removed_pages[count - 1])
+            ram->removed_pages[count++] = ram->removed_pages[i];
+    }
+    ram->removed_page_count = count;
+}
+
+// Records that the page starting at base_addr was removed, so it is dirty
+// until the next ram_clear_dirty().
+static void record_removed_page(ram_t *ram, addr_t base_addr)
+{
+    if (ram->removed_page_count == ram->removed_page_capacity)
+    {
+        // The same pages may be removed again and again, only grow the array
+        // if it is still at least half full without the duplicates.
+        dedup_removed_pages(ram);
+        if (ram->removed_page_count * 2 > ram->removed_page_capacity || ram->removed_page_capacity == 0)
+        {
+            ram->removed_page_capacity = (ram->removed_page_capacity == 0) ? 16 : ram->removed_page_capacity * 2;
+            ram->removed_pages =
+                (addr_t *)realloc(ram->removed_pages, sizeof(addr_t) * ram->removed_page_capacity);
+            check_alloc(ram->removed_pages);
+        }
+    }
+
+    ram->removed_pages[ram->removed_page_count++] = base_addr;
+}
+
+// Removes the given memory page from the page table of the given RAM block, so
+// its words are zeros again. The caller must flush the page caches.
+static void remove_ram_page(ram_t *ram, ram_page_t *page)
+{
+    record_removed_page(ram, page->base_addr);
+    if (page->data == NULL)
+    {
+        ram->swapped_page_count -= 1;
+    }
+    else if ((page->flags & RAM_PAGE_COMPRESSED) != 0)
+    {
+        free(page->data);
+        ram->compressed_page_count -= 1;
+        forget_decoded_page(ram, page->base_addr);
+    }
+    else if ((page->flags & RAM_PAGE_FILE_BACKED) == 0)
+    {
+        page_discard(&ram->arena->page_allocator, page->data);
+    }
+
+    if (ram->pages.backend == RAM_BACKEND_RADIX_TABLE)
+        memset(page, 0, sizeof(ram_page_t));
+    else
+        ht_erase(ram, page);
+    ram->page_count -= 1;
+    RAM_STAT_ADD(ram, page_discards, 1);
+}
+
+// Returns the index of the page cache entry for the given page base address.
+static inline addr_t page_cache_index(const ram_t *ram, addr_t base_addr)
+{
+    return RAM_PAGE_CACHE_INDEX(&ram->fast, base_addr);
+}
+
+#if HAS_ATOMICS
+/* The page table entries of concurrent RAM blocks are accessed atomically.
+ * A missing page is installed with a CAS on its data pointer. A page that is
+ * shared or file-backed is never written, so its copy on write (serialized by
+ * the RAM lock) can not lose any write. The copy is published before the flags
+ * are cleared, and the flags are loaded before the data pointer, so a
+ * file-backed page is never seen as a private one. */
+
+// Same as lookup_ram_page() but for concurrent RAM blocks.
+static word_t *concurrent_lookup_ram_page(ram_t *ram, addr_t base_addr)
+{
+    RAM_STAT_ADD(ram, page_lookups, 1);
+    ram_page_t *page = radix_find(ram, base_addr, 0);
+    word_t *data = (page != NULL) ? ATOMIC_LOAD(&page->data) : NULL;
+    return (data != NULL) ? data : ram->zero_page;
+}
+
+// Same as get_ram_page() but for concurrent RAM blocks.
+static word_t *concurrent_get_ram_page(ram_t *ram, addr_t base_addr)
+{
+    RAM_STAT_ADD(ram, page_lookups, 1);
+    ram_page_allocator_t *allocator = &ram->arena->page_allocator;
+    ram_page_t *page = radix_find(ram, base_addr, 1);
+
+    for (;;)
+    {
+        const uint32_t flags = ATOMIC_LOAD(&page->flags);
+        word_t *data = ATOMIC_LOAD(&page->data);
+        if (data == NULL)
+        {
+            word_t *new_data = page_allocator_alloc(allocator);
+            ATOMIC_STORE_RELAXED(&page->base_addr, base_addr);
+            if (ATOMIC_CAS(&page->data, &data, new_data))
+            {
+                ATOMIC_FETCH_ADD(&ram->page_count, 1);
+                ATOMIC_FETCH_OR(&page->flags, RAM_PAGE_DIRTY);
+                RAM_STAT_ADD(ram, page_allocations, 1);
+                return new_data;
+            }
+
+            // Another thread installed the page first, data is now its page.
+            page_release(allocator, new_data);
+            ATOMIC_FETCH_OR(&page->flags, RAM_PAGE_DIRTY);
+            return data;
+        }
+
+        if ((flags & RAM_PAGE_FILE_BACKED) != 0 || page_is_shared(allocator, data))
+            break;
+
+        // A copy on write by another thread may have released data (then
+        // still owned by a snapshot or clone) since it was loaded. The copy
+        // is published before the release, so data is private only if it is
+        // still the page's one.
+        if (ATOMIC_LOAD(&page->data) != data)
+            continue;
+
+        // Only the first write since the last ram_clear_dirty() stores the
+        // flag, so the page entry is not written at each access.
+        if ((flags & RAM_PAGE_DIRTY) == 0)
+            ATOMIC_FETCH_OR(&page->flags, RAM_PAGE_DIRTY);
+        return data;
+    }
+
+    // Copy on write.
+    word_t *copy = page_allocator_alloc(allocator);
+    spin_lock(&ram->lock);
+    word_t *data = page->data;
+    if ((page->flags & RAM_PAGE_FILE_BACKED) != 0 || page_is_shared(allocator, data))
+    {
+        memcpy(copy, data, sizeof(word_t) * ram->fast.page_size);
+        const int file_backed = (page->flags & RAM_PAGE_FILE_BACKED) != 0;
+        ATOMIC_STORE(&page->data, copy);
+        ATOMIC_STORE(&page->flags, (page->flags & ~RAM_PAGE_FILE_BACKED) | RAM_PAGE_DIRTY);
+        if (!file_backed)
+            page_release(allocator, data);
+        data = copy;
+        copy = NULL;
+        RAM_STAT_ADD(ram, page_allocations, 1);
+        RAM_STAT_ADD(ram, page_copies, 1);
+    }
+    spin_unlock(&ram->lock);
+
+    // Another thread did the copy first.
+    if (copy != NULL)
+        page_release(allocator, copy);
+    return data;
+}
+#endif // HAS_ATOMICS
+
+// Returns the data of the memory's page corresponding to the given addr for a
+// read access. Contrary to get_ram_page(), a missing page is not created: the
+// shared zero page is returned instead (so the caller must never write to the
+// returned page).
+static word_t *lookup_ram_page(ram_t *ram, addr_t addr)
+{
+    // We clear the lower bits of the address to get the page's base address.
+    const addr_t base_addr = addr & ~(ram->fast.page_size - 1);
+
+    ram_cached_page_t *cached_page = &ram->fast.read_cache[page_cache_index(ram, base_addr)];
+    if (cached_page->base_addr == base_addr)
+    {
+        RAM_STAT_ADD(ram, read_cache_hits, 1);
+        return cached_page->data;
+    }
+    RAM_STAT_ADD(ram, read_cache_misses, 1);
+
+#if HAS_ATOMICS
+    if (ram->concurrent)
+        return concurrent_lookup_ram_page(ram, base_addr);
+#endif
+
+    ram_page_t *page = find_ram_page(ram, base_addr);
+    word_t *data = ram->zero_page;
+    if (page != NULL)
+        data = ((page->flags & RAM_PAGE_COMPRESSED) != 0) ? decode_compressed_page(ram, page) : page->data;
+
+    // Only pages without read listeners can be cached.
+    if (!listener_set_intersects(&ram->read_listeners, base_addr, base_addr + (ram->fast.page_size - 1)))
+    {
+        cached_page->base_addr = base_addr;
+        cached_page->data = data;
+    }
+
+    return data;
+}
+
+// Returns the data of the memory's page corresponding to the given addr. This
+// effectively does a hash table lookup internally. However, this also adds the
+// memory's page if it was not already present (and therefore may resize the
+// hash table).
+static word_t *get_ram_page(ram_t *ram, addr_t addr)
+{
+    // We clear the lower bits of the address to get the page's base address.
+    const addr_t base_addr = addr & ~(ram->fast.page_size - 1);
+
+    // First, check the page cache. On a hit, this is all we have to do.
+    const addr_t cache_index = page_cache_index(ram, base_addr);
+    ram_cached_page_t *cached_page = &ram->fast.write_cache[cache_index];
+    if (cached_page->base_addr == base_addr)
+    {
+        RAM_STAT_ADD(ram, write_cache_hits, 1);
+        return cached_page->data;
+    }
+    RAM_STAT_ADD(ram, write_cache_misses, 1);
+
+#if HAS_ATOMICS
+    if (ram->concurrent)
+        return concurrent_get_ram_page(ram, base_addr);
+#endif
+
+    ram_page_t *page = find_ram_page(ram, base_addr);
+    if (page == NULL)
+    {
+        // We failed to find the corresponding memory's page. Now, let's create
+        // it.
+        enforce_memory_budget(ram, 1);
+        page = insert_ram_page(ram, base_addr);
+        init_ram_page(ram, page, base_addr);
+        ram->page_count += 1;
+
+        // The read cache may still map this page to the zero page.
+        if (ram->fast.read_cache[cache_index].base_addr == base_addr)
+            ram->fast.read_cache[cache_index].data = page->data;
+    }
+    else if ((page->flags & RAM_PAGE_COMPRESSED) != 0)
+    {
+        promote_compressed_page(ram, page);
+    }
+    else if ((page->flags & RAM_PAGE_FILE_BACKED) != 0 || page_is_shared(&ram->arena->page_allocator, page->data))
+    {
+        // The page is still a view of a mapped file or is shared with a
+        // snapshot or another RAM block, copy it first.
+        word_t *data = page_allocator_alloc(&ram->arena->page_allocator);
+        memcpy(data, page->data, sizeof(word_t) * ram->fast.page_size);
+        if ((page->flags & RAM_PAGE_FILE_BACKED) == 0)
+            page_release(&ram->arena->page_allocator, page->data);
+        page->data = data;
+        page->flags &= ~RAM_PAGE_FILE_BACKED;
+        RAM_STAT_ADD(ram, page_allocations, 1);
+        RAM_STAT_ADD(ram, page_copies, 1);
+
+        if (ram->fast.read_cache[cache_index].base_addr == base_addr)
+            ram->fast.read_cache[cache_index].data = page->data;
+    }
+    page->flags |= RAM_PAGE_DIRTY | RAM_PAGE_WRITABLE;
+
+    // Remember the page for the next accesses, if it has no write listeners.
+    if (!listener_set_intersects(&ram->write_listeners, base_addr, base_addr + (ram->fast.page_size - 1)))
+    {
+        cached_page->base_addr = base_addr;
+        cached_page->data = page->data;
+    }
+
+    return page->data;
+}
+
+void ram_init(ram_t *ram, const word_t *data, size_t data_len)
+{
+    assert(ram != NULL && data != NULL);
+
+    addr_t base_address = 0;
+    while (base_address < data_len)
+    {
+        word_t *page = get_ram_page(ram, base_address);
+        assert(page != NULL);
+        addr_t words_to_copy = ((data_len - base_address < ram->fast.page_size) ? (data_len - base_address)
+                                                                                : ram->fast.page_size);
+        memcpy(page, data + base_address, sizeof(word_t) * words_to_copy);
+        base_address += ram->fast.page_size;
+    }
+}
+
+// Initializes the given RAM block (which must be empty) with the content of
+// the mapped file data. Full pages directly use the mapped file as their data.
+static void ram_init_from_mapping(ram_t *ram, const word_t *data, size_t data_len)
+{
+    assert(ram->page_count == 0);
+    assert(data_len <= (size_t)0xffffffff + 1);
+
+    arena_add_file_mapping(ram->arena, data, data_len);
+
+    const size_t full_page_count = data_len / ram->fast.page_size;
+    for (size_t i = 0; i < full_page_count; ++i)
+    {
+        const addr_t base_addr = (addr_t)(i * ram->fast.page_size);
+        ram_page_t *page = insert_ram_page(ram, base_addr);
+        page->base_addr = base_addr;
+        page->flags = RAM_PAGE_FILE_BACKED;
+        page->data = (word_t *)(data + base_addr);
+        ram->page_count += 1;
+    }
+
+    // The last partial page would be partially outside the mapping, so it is
+    // copied.
+    const size_t copied_words = full_page_count * ram->fast.page_size;
+    if (copied_words < data_len)
+    {
+        word_t *page = get_ram_page(ram, (addr_t)copied_words);
+        memcpy(page, data + copied_words, sizeof(word_t) * (data_len - copied_words));
+    }
+}
+
+ram_t *ram_from_file(const char *filename)
+{
+    ram_t *ram = ram_create();
+
+    // Try first to map the file, this avoids to copy all of it.
+    size_t mapped_len = 0;
+    const word_t *mapped_data = map_file(filename, &mapped_len);
+    if (mapped_data != NULL)
+    {
+        ram_init_from_mapping(ram, mapped_data, mapped_len);
+        return ram;
+    }
+
+    addr_t data_len = 0;
+    word_t *data = read_file(filename, &data_len);
+    if (data == NULL)
+        file_error(filename);
+
+    ram_init(ram, data, data_len);
+    free(data);
+    return ram;
+}
+
+// Calls visitor for each memory page of the given RAM block, in no particular
+// order. The data of the evicted pages (see max_resident_pages) is NULL.
+typedef void (*ram_page_visitor_fn_t)(ram_t *ram, ram_page_t *page, void *user_data);
+static void visit_ram_pages(ram_t *ram, ram_page_visitor_fn_t visitor, void *user_data)
+{
+    if (ram->pages.backend == RAM_BACKEND_RADIX_TABLE)
+    {
+        const size_t dir_size = (size_t)1 << ram->radix_dir_bits;
+        const size_t leaf_size = (size_t)1 << ram->radix_leaf_bits;
+        for (size_t i = 0; i < dir_size; ++i)
+        {
+            ram_page_t *leaf = ram->pages.radix_directory[i];
+            if (leaf == NULL)
+                continue;
+
+            for (size_t j = 0; j < leaf_size; ++j)
+            {
+                if (page_is_used(&leaf[j]))
+                    visitor(ram, &leaf[j], user_data);
+            }
+        }
+    }
+    else
+    {
+        // While the table is resized, the pages are in both tables.
+        for (addr_t i = 0; i < ram->pages.table.capacity; ++i)
+        {
+            if (page_is_used(&ram->pages.table.slots[i]))
+                visitor(ram, &ram->pages.table.slots[i], user_data);
+        }
+        for (addr_t i = ram->migrated_slots; i < ram->pages.old_table.capacity; ++i)
+        {
+            if (page_is_used(&ram->pages.old_table.slots[i]))
+                visitor(ram, &ram->pages.old_table.slots[i], user_data);
+        }
+    }
+}
+
+static void release_page_visitor(ram_t *ram, ram_page_t *page, void *_)
+{
+    release_page_data(&ram->arena->page_allocator, page);
+}
+
+// Releases all the memory pages of the given RAM block, which becomes empty.
+static void release_ram_pages(ram_t *ram)
+{
+    visit_ram_pages(ram, &release_page_visitor, NULL);
+
+    if (ram->pages.radix_directory != NULL)
+    {
+        const size_t dir_size = (size_t)1 << ram->radix_dir_bits;
+        for (size_t i = 0; i < dir_size; ++i)
+        {
+            free(ram->pages.radix_directory[i]);
+            ram->pages.radix_directory[i] = NULL;
+        }
+    }
+
+    ht_clear(&ram->pages.table);
+    ht_destroy(&ram->pages.old_table);
+    ram->page_count = 0;
+    ram->swapped_page_count = 0;
+    ram->clock_hand = 0;
+    ram->compressed_page_count = 0;
+    for (size_t i = 0; i < RAM_PAGE_CACHE_SIZE; ++i)
+        ram->decoded_base_addrs[i] = INVALID_BASE_ADDR;
+
+    flush_caches(ram, 1, 1);
+}
+
+void ram_destroy(ram_t *ram)
+{
+    if (ram == NULL)
+        return;
+
+    assert(ram->views == NULL && "the views of a RAM block must be destroyed first");
+
+    listener_set_destroy(&ram->read_listeners);
+    listener_set_destroy(&ram->write_listeners);
+
+    // The page data is owned by the arena, which may be shared.
+    release_ram_pages(ram);
+    arena_release(ram->arena);
+    ht_destroy(&ram->pages.table);
+    free(ram->pages.radix_directory);
+    free(ram->zero_page);
+    free(ram->removed_pages);
+    if (ram->swap_file != NULL)
+        fclose(ram->swap_file);
+    free(ram->decoded_pages);
+    free(ram);
+}
+
+/* Snapshots and clones share the memory pages of the RAM block (the pages are
+ * only copied on their first write, see get_ram_page()), so they only cost a
+ * copy of the page table. The write caches never contain shared pages, so
+ * they must be flushed when pages become shared. */
+
+// Adds to the given RAM block (where the page must be missing) the given
+// page of a RAM block or snapshot using the same arena. Returns the new page.
+static ram_page_t *add_shared_page(ram_t *ram, const ram_page_t *page)
+{
+    ram_page_t *new_page = insert_ram_page(ram, page->base_addr);
+    *new_page = *page;
+    share_page_data(&ram->arena->page_allocator, new_page);
+    if ((page->flags & RAM_PAGE_COMPRESSED) != 0)
+        ram->compressed_page_count += 1;
+#ifdef RAM_ENABLE_PAGE_STATS
+    new_page->reads = 0;
+    new_page->writes = 0;
+#endif
+    ram->page_count += 1;
+    return new_page;
+}
+
+static void snapshot_page_visitor(ram_t *ram, ram_page_t *page, void *user_data)
+{
+    ram_snapshot_t *snapshot = (ram_snapshot_t *)user_data;
+    if (page->data == NULL)
+        swap_in_ram_page(ram, page);
+    page->flags &= ~RAM_PAGE_WRITABLE;
+    snapshot->pages[snapshot->page_count] = *page;
+    share_page_data(&ram->arena->page_allocator, &snapshot->pages[snapshot->page_count++]);
+}
+
+ram_snapshot_t *ram_snapshot(ram_t *ram)
+{
+    assert(ram != NULL);
+
+    ram_snapshot_t *snapshot = (ram_snapshot_t *)malloc(sizeof(ram_snapshot_t));
+    check_alloc(snapshot);
+    snapshot->arena = arena_retain(ram->arena);
+    snapshot->page_size = ram->fast.page_size;
+    snapshot->pages = (ram_page_t *)malloc(sizeof(ram_page_t) * (ram->page_count + 1));
+    check_alloc(snapshot->pages);
+    snapshot->page_count = 0;
+    visit_ram_pages(ram, &snapshot_page_visitor, snapshot);
+    assert(snapshot->page_count == ram->page_count);
+
+    // All the pages are now shared, the write caches and the caches of the
+    // views only contain private pages.
+    flush_caches(ram, 1, 1);
+    return snapshot;
+}
+
+static void record_removed_page_visitor(ram_t *ram, ram_page_t *page, void *_)
+{
+    record_removed_page(ram, page->base_addr);
+}
+
+void ram_restore(ram_t *ram, const ram_snapshot_t *snapshot)
+{
+    assert(ram != NULL && snapshot != NULL);
+    assert(ram->fast.page_size == snapshot->page_size);
+
+    // The pages missing from the snapshot become dirty zero pages.
+    visit_ram_pages(ram, &record_removed_page_visitor, NULL);
+    release_ram_pages(ram);
+
+    // All the restored pages are dirty (the copied ones are by get_ram_page()).
+    if (snapshot->arena == ram->arena)
+    {
+        for (addr_t i = 0; i < snapshot->page_count; ++i)
+        {
+            ram_page_t *page = add_shared_page(ram, &snapshot->pages[i]);
+            page->flags |= RAM_PAGE_DIRTY;
+
+            // The pages beyond the memory budget are evicted right away, as
+            // they can not be evicted while shared with the snapshot.
+            if (ram->max_resident_pages != 0 && ram->eviction_holds == 0 &&
+                resident_page_count(ram) > ram->max_resident_pages &&
+                (page->flags & (RAM_PAGE_FILE_BACKED | RAM_PAGE_COMPRESSED)) == 0)
+                evict_ram_page(ram, page);
+        }
+        return;
+    }
+
+    // The pages of another arena can not be shared, copy them.
+    for (addr_t i = 0; i < snapshot->page_count; ++i)
+    {
+        const ram_page_t *page = &snapshot->pages[i];
+        word_t *data = get_ram_page(ram, page->base_addr);
+        if ((page->flags & RAM_PAGE_COMPRESSED) != 0)
+            compressed_page_decode((const ram_compressed_page_t *)page->data, data, ram->fast.page_size);
+        else
+            memcpy(data, page->data, sizeof(word_t) * ram->fast.page_size);
+    }
+}
+
+void ram_snapshot_destroy(ram_snapshot_t *snapshot)
+{
+    if (snapshot == NULL)
+        return;
+
+    for (addr_t i = 0; i < snapshot->page_count; ++i)
+        release_page_data(&snapshot->arena->page_allocator, &snapshot->pages[i]);
+
+    arena_release(snapshot->arena);
+    free(snapshot->pages);
+    free(snapshot);
+}
+
+static void clone_page_visitor(ram_t *ram, ram_page_t *page, void *user_data)
+{
+    if (page->data == NULL)
+        swap_in_ram_page(ram, page);
+    page->flags &= ~RAM_PAGE_WRITABLE;
+    add_shared_page((ram_t *)user_data, page);
+}
+
+ram_t *ram_clone(ram_t *ram)
+{
+    assert(ram != NULL);
+
+    ram_t *clone = ram_create_ex(&ram->config);
+    assert(clone->fast.page_size == ram->fast.page_size);
+
+    // Share the arena of the cloned RAM block.
+    arena_release(clone->arena);
+    clone->arena = arena_retain(ram->arena);
+    visit_ram_pages(ram, &clone_page_visitor, clone);
+    for (size_t i = 0; i < ram->removed_page_count; ++i)
+        record_removed_page(clone, ram->removed_pages[i]);
+
+    // All the pages are now shared, the write caches and the caches of the
+    // views only contain private pages.
+    flush_caches(ram, 1, 1);
+    return clone;
+}
+
+addr_t ram_page_size(const ram_t *ram)
+{
+    assert(ram != NULL);
+    return ram->fast.page_size;
+}
+
+// The slot of the dirty page iterators once at the removed pages.
+#define REMOVED_PAGES_SLOT SIZE_MAX
+
+// Moves the given iterator to the first dirty page whose slot is at least the
+// iterator's one, or then to the first removed page still missing whose index
+// is at least the iterator's one. Returns 0 if there is none.
+static int dirty_pages_seek(ram_page_iterator_t *it)
+{
+    ram_t *ram = it->ram;
+    if (it->slot != REMOVED_PAGES_SLOT)
+    {
+        ram_page_t *page = find_next_page(ram, &it->slot, RAM_PAGE_DIRTY);
+        if (page != NULL)
+        {
+            if (page->data == NULL)
+                swap_in_ram_page(ram, page);
+            it->base_addr = page->base_addr;
+            it->data = page_words(ram, page);
+            return 1;
+        }
+
+        it->slot = REMOVED_PAGES_SLOT;
+        it->removed_index = 0;
+    }
+
+    // The removed pages created again since are dirty pages of the table.
+    for (; it->removed_index < ram->removed_page_count; ++it->removed_index)
+    {
+        const addr_t base_addr = ram->removed_pages[it->removed_index];
+        if (find_page_entry(ram, base_addr) == NULL)
+        {
+            it->base_addr = base_addr;
+            it->data = ram->zero_page;
+            return 1;
+        }
+    }
+
+    it->base_addr = 0;
+    it->data = NULL;
+    return 0;
+}
+
+int ram_dirty_pages_begin(ram_t *ram, ram_page_iterator_t *it)
+{
+    assert(ram != NULL && it != NULL);
+    dedup_removed_pages(ram);
+    it->ram = ram;
+    it->slot = 0;
+    it->removed_index = 0;
+    return dirty_pages_seek(it);
+}
+
+int ram_dirty_pages_next(ram_page_iterator_t *it)
+{
+    assert(it != NULL && it->data != NULL && "the iteration is already finished");
+    if (it->slot == REMOVED_PAGES_SLOT)
+        it->removed_index += 1;
+    else
+        it->slot += 1;
+    return dirty_pages_seek(it);
+}
+
+static void clear_dirty_page_visitor(ram_t *ram, ram_page_t *page, void *_)
+{
+    page->flags &= ~(RAM_PAGE_DIRTY | RAM_PAGE_WRITABLE);
+}
+
+void ram_clear_dirty(ram_t *ram)
+{
+    assert(ram != NULL);
+    visit_ram_pages(ram, &clear_dirty_page_visitor, NULL);
+    ram->removed_page_count = 0;
+
+    // The next write to each page must go through the slow path again.
+    flush_caches(ram, 0, 1);
+}
+
+typedef struct ram_page_callback_t
+{
+    ram_page_fn_t callback;
+    void *user_data;
+} ram_page_callback_t;
+
+static void page_callback_visitor(ram_t *ram, ram_page_t *page, void *user_data)
+{
+    const ram_page_callback_t *callback = (const ram_page_callback_t *)user_data;
+    if (page->data == NULL)
+        swap_in_ram_page(ram, page);
+
+    // The callback may read the RAM block, which must not evict this page.
+    hold_evictions(ram);
+    callback->callback(ram, page->base_addr, page_words(ram, page), callback->user_data);
+    release_evictions(ram);
+}
+
+void ram_for_each_page(ram_t *ram, ram_page_fn_t callback, void *user_data)
+{
+    assert(ram != NULL && callback != NULL);
+
+    ram_page_callback_t page_callback;
+    page_callback.callback = callback;
+    page_callback.user_data = user_data;
+    visit_ram_pages(ram, &page_callback_visitor, &page_callback);
+}
+
+/* RAM images, written by ram_save(), only store the memory pages that are not
+ * all zeros. The layout is (all integers in the native byte order):
+ *   - a ram_image_header_t;
+ *   - page_count ram_image_page_t, sorted by base address;
+ *   - the page payloads, each one of page_size words and at an offset (from
+ *     the file start) multiple of the page size in bytes.
+ * Thanks to the payload alignment, ram_load() can map the file and directly
+ * use the payloads as file-backed memory pages. */
+
+// "SPRM" when stored in little endian.
+#define RAM_IMAGE_MAGIC 0x4d525053
+#define RAM_IMAGE_VERSION 1
+
+typedef struct ram_image_header_t
+{
+    uint32_t magic;
+    uint32_t version;
+    // In words.
+    uint32_t page_size;
+    uint32_t page_count;
+} ram_image_header_t;
+
+typedef struct ram_image_page_t
+{
+    uint32_t base_addr;
+    uint32_t reserved; // always 0
+    // Offset, in bytes from the file start, of the page payload.
+    uint64_t offset;
+} ram_image_page_t;
+
+typedef struct ram_page_array_t
+{
+    ram_page_t *pages;
+    addr_t page_count;
+} ram_page_array_t;
+
+static void collect_page_visitor(ram_t *ram, ram_page_t *page, void *user_data)
+{
+    ram_page_array_t *image_pages = (ram_page_array_t *)user_data;
+
+    // Only the evicted pages full of zeros are not written to the swap file.
+    if (page->data == NULL)
+    {
+        if ((page->flags & RAM_PAGE_SWAPPED_ZERO) == 0)
+            image_pages->pages[image_pages->page_count++] = *page;
+        return;
+    }
+
+    // The pairs of a compressed page are never equal to its fill value.
+    if ((page->flags & RAM_PAGE_COMPRESSED) != 0)
+    {
+        const ram_compressed_page_t *compressed = (const ram_compressed_page_t *)page->data;
+        if (compressed->count != 0 || compressed->fill != 0)
+            image_pages->pages[image_pages->page_count++] = *page;
+        return;
+    }
+
+    for (addr_t i = 0; i < ram->fast.page_size; ++i)
+    {
+        // Pages full of zeros are not saved.
+        if (page->data[i] != 0)
+        {
+            image_pages->pages[image_pages->page_count++] = *page;
+            return;
+        }
+    }
+}
+
+static int compare_pages(const void *lhs, const void *rhs)
+{
+    const addr_t a = ((const ram_page_t *)lhs)->base_addr;
+    const addr_t b = ((const ram_page_t *)rhs)->base_addr;
+    return (a > b) - (a < b);
+}
+
+int ram_save(ram_t *ram, const char *filename)
+{
+    assert(ram != NULL && filename != NULL);
+
+    ram_page_array_t image_pages;
+    image_pages.pages = (ram_page_t *)malloc(sizeof(ram_page_t) * (ram->page_count + 1));
+    check_alloc(image_pages.pages);
+    image_pages.page_count = 0;
+    visit_ram_pages(ram, &collect_page_visitor, &image_pages);
+    qsort(image_pages.pages, image_pages.page_count, sizeof(ram_page_t), &compare_pages);
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+    {
+        free(image_pages.pages);
+        return -1;
+    }
+
+    ram_image_header_t header;
+    header.magic = RAM_IMAGE_MAGIC;
+    header.version = RAM_IMAGE_VERSION;
+    header.page_size = ram->fast.page_size;
+    header.page_count = image_pages.page_count;
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1;
+
+    // The payloads start after the index, on the next page boundary.
+    const uint64_t page_bytes = sizeof(word_t) * (uint64_t)ram->fast.page_size;
+    const uint64_t index_end = sizeof(header) + sizeof(ram_image_page_t) * (uint64_t)image_pages.page_count;
+    const uint64_t payloads_offset = (index_end + page_bytes - 1) / page_bytes * page_bytes;
+    for (addr_t i = 0; i < image_pages.page_count && !failed; ++i)
+    {
+        ram_image_page_t index_entry;
+        index_entry.base_addr = image_pages.pages[i].base_addr;
+        index_entry.reserved = 0;
+        index_entry.offset = payloads_offset + page_bytes * i;
+        failed = fwrite(&index_entry, sizeof(index_entry), 1, file) != 1;
+    }
+
+    for (uint64_t i = index_end; i < payloads_offset && !failed; ++i)
+        failed = fputc(0, file) == EOF;
+
+    // The pages may have been evicted since they were collected.
+    for (addr_t i = 0; i < image_pages.page_count && !failed; ++i)
+    {
+        const word_t *data = page_words(ram, find_ram_page(ram, image_pages.pages[i].base_addr));
+        failed = fwrite(data, sizeof(word_t), ram->fast.page_size, file) != ram->fast.page_size;
+    }
+
+    free(image_pages.pages);
+    if (fclose(file) != 0)
+        failed = 1;
+    return failed ? -1 : 0;
+}
+
+// Initializes the given RAM block (which must be empty) with the given RAM
+// image of data_len words. If mapped is true, data is a mapping of the file
+// that is kept alive by the RAM block if it uses it. Returns 0 if the image
+// is invalid.
+static int ram_init_from_image(ram_t *ram, const word_t *data, size_t data_len, int mapped)
+{
+    assert(ram->page_count == 0);
+
+    const size_t data_bytes = sizeof(word_t) * data_len;
+    if (data_bytes < sizeof(ram_image_header_t))
+        return 0;
+
+    // Mapped files and read_file() buffers are suitably aligned.
+    const ram_image_header_t *header = (const ram_image_header_t *)data;
+    if (header->magic != RAM_IMAGE_MAGIC || header->version != RAM_IMAGE_VERSION || header->page_size == 0 ||
+        (header->page_size & (header->page_size - 1)) != 0)
+        return 0;
+
+    const ram_image_page_t *index = (const ram_image_page_t *)(header + 1);
+    const uint64_t page_bytes = sizeof(word_t) * (uint64_t)header->page_size;
+    if (sizeof(ram_image_page_t) * (uint64_t)header->page_count > data_bytes - sizeof(ram_image_header_t))
+        return 0;
+
+    // Check all the pages first, the RAM block must not be modified if the
+    // image is invalid.
+    for (uint32_t i = 0; i < header->page_count; ++i)
+    {
+        if ((index[i].base_addr & (header->page_size - 1)) != 0 || index[i].offset % sizeof(word_t) != 0 ||
+            index[i].offset > data_bytes || page_bytes > data_bytes - index[i].offset)
+            return 0;
+        if (i > 0 && index[i].base_addr <= index[i - 1].base_addr)
+            return 0;
+    }
+
+    // If the page sizes match, the payloads are directly used as file-backed
+    // pages. Otherwise, they are copied.
+    const int use_mapping = mapped && header->page_size == ram->fast.page_size;
+    for (uint32_t i = 0; i < header->page_count; ++i)
+    {
+        const word_t *payload = data + index[i].offset / sizeof(word_t);
+        if (use_mapping)
+        {
+            ram_page_t *page = insert_ram_page(ram, index[i].base_addr);
+            page->base_addr = index[i].base_addr;
+            page->flags = RAM_PAGE_FILE_BACKED;
+            page->data = (word_t *)payload;
+            ram->page_count += 1;
+        }
+        else
+        {
+            ram_write_block(ram, index[i].base_addr, payload, header->page_size);
+        }
+    }
+
+    if (use_mapping)
+    {
+        arena_add_file_mapping(ram->arena, data, data_len);
+    }
+    else if (mapped)
+    {
+        unmap_file(data, data_len);
+    }
+
+    return 1;
+}
+
+// Creates an empty RAM block with the page size of the given RAM image of
+// data_len words, or NULL if the image is invalid.
+static ram_t *ram_create_for_image(const word_t *data, size_t data_len)
+{
+    const ram_image_header_t *header = (const ram_image_header_t *)data;
+    if (sizeof(word_t) * data_len < sizeof(ram_image_header_t) || header->page_size < 2 ||
+        header->page_size > ((addr_t)1 << 31) || (header->page_size & (header->page_size - 1)) != 0)
+        return NULL;
+
+    ram_config_t config = ram_default_config();
+    config.page_size = header->page_size;
+    return ram_create_ex(&config);
+}
+
+ram_t *ram_load(const char *filename)
+{
+    // Try first to map the file, this avoids to copy the pages.
+    size_t mapped_len = 0;
+    const word_t *mapped_data = map_file(filename, &mapped_len);
+    if (mapped_data != NULL)
+    {
+        ram_t *ram = ram_create_for_image(mapped_data, mapped_len);
+        if (ram == NULL || !ram_init_from_image(ram, mapped_data, mapped_len, 1))
+            file_format_error(filename);
+        return ram;
+    }
+
+    addr_t data_len = 0;
+    word_t *data = read_file(filename, &data_len);
+    if (data == NULL)
+        file_error(filename);
+
+    ram_t *ram = ram_create_for_image(data, data_len);
+    if (ram == NULL || !ram_init_from_image(ram, data, data_len, 0))
+        file_format_error(filename);
+    free(data);
+    return ram;
+}
+
+// Counts count calls of the given listener.
+#ifdef RAM_ENABLE_STATS
+#define RAM_STAT_LISTENER_CALLS(ram, listener, counter, count)                                                 \
+    do                                                                                                         \
+    {                                                                                                          \
+        stat_add((ram)->concurrent, &(listener)->call_count, (count));                                         \
+        RAM_STAT_ADD(ram, counter, count);                                                                     \
+    } while (0)
+#else
+#define RAM_STAT_LISTENER_CALLS(ram, listener, counter, count) ((void)0)
+#endif
+
+#ifdef RAM_ENABLE_PAGE_STATS
+// Adds the given counts of read and written words to the counters of the
+// memory page starting at base_addr, if it exists.
+static void count_page_accesses(ram_t *ram, addr_t base_addr, uint64_t reads, uint64_t writes)
+{
+    ram_page_t *page;
+    if (ram->pages.backend == RAM_BACKEND_RADIX_TABLE)
+        page = radix_find(ram, base_addr, 0);
+    else
+        page = ht_lookup(ram, base_addr, NULL);
+    if (page == NULL || ATOMIC_LOAD(&page->data) == NULL)
+        return;
+
+    stat_add(ram->concurrent, &page->reads, reads);
+    stat_add(ram->concurrent, &page->writes, writes);
+}
+
+#define RAM_STAT_PAGE_ACCESSES(ram, addr, reads, writes)                                                        \
+    count_page_accesses((ram), (addr) & ~((ram)->fast.page_size - 1), (reads), (writes))
+#else
+#define RAM_STAT_PAGE_ACCESSES(ram, addr, reads, writes) ((void)0)
+#endif // RAM_ENABLE_PAGE_STATS
+
+static void handle_read_listeners(ram_t *ram, addr_t addr)
+{
+#ifndef RAM_NO_READ_LISTENER
+    const ram_listener_set_t *set = &ram->read_listeners;
+    const ram_listener_segment_t *segment = listener_set_find(set, addr);
+    if (segment == NULL)
+        return;
+
+    for (uint32_t i = 0; i < segment->count; ++i)
+    {
+        ram_listener_t *listener = &set->listeners[set->segment_listeners[segment->first + i]];
+        RAM_STAT_LISTENER_CALLS(ram, listener, read_listener_calls, 1);
+        ((ram_read_listener_fn_t)listener->callback)(ram, addr);
+    }
+#endif // !RAM_NO_READ_LISTENER
+}
+
+static void handle_write_listeners(ram_t *ram, addr_t addr, word_t new_word)
+{
+#ifndef RAM_NO_WRITE_LISTENER
+    const ram_listener_set_t *set = &ram->write_listeners;
+    const ram_listener_segment_t *segment = listener_set_find(set, addr);
+    if (segment == NULL)
+        return;
+
+    for (uint32_t i = 0; i < segment->count; ++i)
+    {
+        ram_listener_t *listener = &set->listeners[set->segment_listeners[segment->first + i]];
+        RAM_STAT_LISTENER_CALLS(ram, listener, write_listener_calls, 1);
+        ((ram_write_listener_fn_t)listener->callback)(ram, addr, new_word);
+    }
+#endif // !RAM_NO_WRITE_LISTENER
+}
+
+// Same as handle_read_listeners() but for all the addresses in the range
+// [addr_low, addr_high], in increasing order (like one read at a time). Only
+// the index segments intersecting the range are visited.
+static void handle_read_listeners_range(ram_t *ram, addr_t addr_low, addr_t addr_high)
+{
+#ifndef RAM_NO_READ_LISTENER
+    const ram_listener_set_t *set = &ram->read_listeners;
+    for (uint32_t s = listener_set_lower_bound(set, addr_low);
+         s < set->segment_count && set->segments[s].addr_low <= addr_high; ++s)
+    {
+        const ram_listener_segment_t *segment = &set->segments[s];
+        const addr_t low = (addr_low > segment->addr_low) ? addr_low : segment->addr_low;
+        const addr_t high = (addr_high < segment->addr_high) ? addr_high : segment->addr_high;
+        for (uint32_t i = 0; i < segment->count; ++i)
+            RAM_STAT_LISTENER_CALLS(ram, &set->listeners[set->segment_listeners[segment->first + i]],
+                                    read_listener_calls, (uint64_t)(high - low) + 1);
+
+        for (addr_t addr = low;; ++addr)
+        {
+            for (uint32_t i = 0; i < segment->count; ++i)
+            {
+                const ram_listener_t *listener = &set->listeners[set->segment_listeners[segment->first + i]];
+                ((ram_read_listener_fn_t)listener->callback)(ram, addr);
+            }
+            if (addr == high)
+                break;
+        }
+    }
+#endif // !RAM_NO_READ_LISTENER
+}
+
+// Same as handle_write_listeners() but for all the addresses in the range
+// [addr_low, addr_high], in increasing order (like one write at a time), where
+// words is the new content of the range: the new word of addr is
+// words[(addr - addr_low) * words_step] (so a words_step of 0 means the whole
+// range was set to *words).
+static void handle_write_listeners_range(ram_t *ram, addr_t addr_low, addr_t addr_high,
+                                         const word_t *words, size_t words_step)
+{
+#ifndef RAM_NO_WRITE_LISTENER
+    const ram_listener_set_t *set = &ram->write_listeners;
+    for (uint32_t s = listener_set_lower_bound(set, addr_low);
+         s < set->segment_count && set->segments[s].addr_low <= addr_high; ++s)
+    {
+        const ram_listener_segment_t *segment = &set->segments[s];
+        const addr_t low = (addr_low > segment->addr_low) ? addr_low : segment->addr_low;
+        const addr_t high = (addr_high < segment->addr_high) ? addr_high : segment->addr_high;
+        for (uint32_t i = 0; i < segment->count; ++i)
+            RAM_STAT_LISTENER_CALLS(ram, &set->listeners[set->segment_listeners[segment->first + i]],
+                                    write_listener_calls, (uint64_t)(high - low) + 1);
+
+        for (addr_t addr = low;; ++addr)
+        {
+            const word_t word = words[(addr - addr_low) * words_step];
+            for (uint32_t i = 0; i < segment->count; ++i)
+            {
+                const ram_listener_t *listener = &set->listeners[set->segment_listeners[segment->first + i]];
+                ((ram_write_listener_fn_t)listener->callback)(ram, addr, word);
+            }
+            if (addr == high)
+                break;
+        }
+    }
+#endif // !RAM_NO_WRITE_LISTENER
+}
+
+// Loads the given word of a page of the given RAM block, atomically if the
+// RAM is concurrent.
+static inline word_t load_word(const ram_t *ram, const word_t *word)
+{
+#if HAS_ATOMICS
+    if (ram->concurrent)
+        return ATOMIC_LOAD_RELAXED(word);
+#endif
+    return *word;
+}
+
+// Stores value into the given word of a page of the given RAM block,
+// atomically if the RAM is concurrent.
+static inline void store_word(const ram_t *ram, word_t *word, word_t value)
+{
+#if HAS_ATOMICS
+    if (ram->concurrent)
+    {
+        ATOMIC_STORE_RELAXED(word, value);
+        return;
+    }
+#endif
+    *word = value;
+}
+
+word_t ram_get(ram_t *ram, addr_t addr)
+{
+    RAM_STAT_PAGE_ACCESSES(ram, addr, 1, 0);
+
+    // Fast path: the page is cached, so it has no read listeners.
+    const addr_t base_addr = addr & ~(ram->fast.page_size - 1);
+    const ram_cached_page_t *cached_page = &ram->fast.read_cache[page_cache_index(ram, base_addr)];
+    if (cached_page->base_addr == base_addr)
+    {
+        RAM_STAT_ADD(ram, read_cache_hits, 1);
+        return cached_page->data[addr - base_addr];
+    }
+
+    // Listeners are called first as they may access the RAM themselves.
+    handle_read_listeners(ram, addr);
+    return load_word(ram, &lookup_ram_page(ram, addr)[addr - base_addr]);
+}
+
+// The slow path of ram_set() for a RAM block with compressed pages: the new
+// pages and the compressed ones stay compressed if possible.
+static void set_compressed_word(ram_t *ram, addr_t addr, word_t value)
+{
+    const addr_t base_addr = addr & ~(ram->fast.page_size - 1);
+    ram_page_t *page = find_ram_page(ram, base_addr);
+    if (page == NULL)
+        page = insert_compressed_page(ram, base_addr, 0);
+
+    if ((page->flags & RAM_PAGE_COMPRESSED) != 0 && compressed_page_set(ram, page, addr - base_addr, value))
+    {
+        page->flags |= RAM_PAGE_DIRTY;
+        return;
+    }
+
+    // Promoted by get_ram_page().
+    store_word(ram, &get_ram_page(ram, addr)[addr - base_addr], value);
+}
+
+void ram_set(ram_t *ram, addr_t addr, word_t value)
+{
+    // Fast path: the page is cached, so it has no write listeners.
+    const addr_t base_addr = addr & ~(ram->fast.page_size - 1);
+    const ram_cached_page_t *cached_page = &ram->fast.write_cache[page_cache_index(ram, base_addr)];
+    if (cached_page->base_addr == base_addr)
+    {
+        cached_page->data[addr - base_addr] = value;
+        RAM_STAT_ADD(ram, write_cache_hits, 1);
+        RAM_STAT_PAGE_ACCESSES(ram, addr, 0, 1);
+        return;
+    }
+
+    if (ram->config.compressed_pages)
+        set_compressed_word(ram, addr, value);
+    else
+        store_word(ram, &get_ram_page(ram, addr)[addr - base_addr], value);
+    RAM_STAT_PAGE_ACCESSES(ram, addr, 0, 1);
+    handle_write_listeners(ram, addr, value);
+}
+
+word_t ram_get_set(ram_t *ram, addr_t addr, word_t value)
+{
+    const addr_t base_addr = addr & ~(ram->fast.page_size - 1);
+    const addr_t in_page_addr = addr - base_addr;
+
+    // Fast path: the page is in both caches, so it has no listeners.
+    const addr_t cache_index = page_cache_index(ram, base_addr);
+    const ram_cached_page_t *cached_page = &ram->fast.write_cache[cache_index];
+    if (cached_page->base_addr == base_addr && ram->fast.read_cache[cache_index].base_addr == base_addr)
+    {
+        const word_t old_value = cached_page->data[in_page_addr];
+        cached_page->data[in_page_addr] = value;
+        RAM_STAT_ADD(ram, read_cache_hits, 1);
+        RAM_STAT_ADD(ram, write_cache_hits, 1);
+        RAM_STAT_PAGE_ACCESSES(ram, addr, 1, 1);
+        return old_value;
+    }
+
     handle_read_listeners(ram, addr);
-    word_t old_value = page->data[in_page_addr];
-    page->data[in_page_addr] = value;
+    word_t *page = get_ram_page(ram, addr);
+    RAM_STAT_PAGE_ACCESSES(ram, addr, 1, 1);
+    word_t old_value;
+#if HAS_ATOMICS
+    if (ram->concurrent)
+        old_value = ATOMIC_EXCHANGE(&page[in_page_addr], value);
+    else
+#endif
+    {
+        old_value = page[in_page_addr];
+        page[in_page_addr] = value;
+    }
     handle_write_listeners(ram, addr, value);
     return old_value;
 }
 
-#define MOVE_CURSOR(x, y) "\x1b[" #y ";" #x "H"
-#define CLEAR_LINE "\x1b[0K"
+word_t ram_atomic_cas(ram_t *ram, addr_t addr, word_t expected, word_t desired)
+{
+    assert(ram != NULL);
+    const addr_t base_addr = addr & ~(ram->fast.page_size - 1);
+    const addr_t in_page_addr = addr - base_addr;
+
+    // Fast path: the page is in both caches, so it has no listeners.
+    const addr_t cache_index = page_cache_index(ram, base_addr);
+    const ram_cached_page_t *cached_page = &ram->fast.write_cache[cache_index];
+    if (cached_page->base_addr == base_addr && ram->fast.read_cache[cache_index].base_addr == base_addr)
+    {
+        const word_t old_value = cached_page->data[in_page_addr];
+        if (old_value == expected)
+            cached_page->data[in_page_addr] = desired;
+        RAM_STAT_ADD(ram, read_cache_hits, 1);
+        RAM_STAT_ADD(ram, write_cache_hits, 1);
+        RAM_STAT_PAGE_ACCESSES(ram, addr, 1, 1);
+        return old_value;
+    }
+
+    handle_read_listeners(ram, addr);
+
+    // A failed comparison is only a read, so it neither creates nor copies
+    // the page.
+    word_t *page = lookup_ram_page(ram, addr);
+    word_t old_value;
+#if HAS_ATOMICS
+    if (ram->concurrent)
+        old_value = ATOMIC_LOAD_SEQ_CST(&page[in_page_addr]);
+    else
+#endif
+        old_value = page[in_page_addr];
+    if (old_value != expected)
+    {
+        RAM_STAT_PAGE_ACCESSES(ram, addr, 1, 0);
+        return old_value;
+    }
+
+    word_t *word = &get_ram_page(ram, addr)[in_page_addr];
+    RAM_STAT_PAGE_ACCESSES(ram, addr, 1, 1);
+#if HAS_ATOMICS
+    if (ram->concurrent)
+    {
+        // Another thread may have written the word since.
+        if (!ATOMIC_CAS(word, &old_value, desired))
+            return old_value;
+    }
+    else
+#endif
+    {
+        *word = desired;
+    }
+
+    handle_write_listeners(ram, addr, desired);
+    return old_value;
+}
+
+word_t ram_atomic_fetch_add(ram_t *ram, addr_t addr, word_t value)
+{
+    assert(ram != NULL);
+    const addr_t base_addr = addr & ~(ram->fast.page_size - 1);
+    const addr_t in_page_addr = addr - base_addr;
+
+    // Fast path: the page is in both caches, so it has no listeners.
+    const addr_t cache_index = page_cache_index(ram, base_addr);
+    const ram_cached_page_t *cached_page = &ram->fast.write_cache[cache_index];
+    if (cached_page->base_addr == base_addr && ram->fast.read_cache[cache_index].base_addr == base_addr)
+    {
+        const word_t old_value = cached_page->data[in_page_addr];
+        cached_page->data[in_page_addr] = old_value + value;
+        RAM_STAT_ADD(ram, read_cache_hits, 1);
+        RAM_STAT_ADD(ram, write_cache_hits, 1);
+        RAM_STAT_PAGE_ACCESSES(ram, addr, 1, 1);
+        return old_value;
+    }
+
+    handle_read_listeners(ram, addr);
+    word_t *word = &get_ram_page(ram, addr)[in_page_addr];
+    RAM_STAT_PAGE_ACCESSES(ram, addr, 1, 1);
+    word_t old_value;
+#if HAS_ATOMICS
+    if (ram->concurrent)
+        old_value = ATOMIC_FETCH_ADD(word, value);
+    else
+#endif
+    {
+        old_value = *word;
+        *word = old_value + value;
+    }
+
+    handle_write_listeners(ram, addr, old_value + value);
+    return old_value;
+}
+
+void ram_read_block(ram_t *ram, addr_t addr, word_t *dst, size_t n)
+{
+    assert(ram != NULL && (dst != NULL || n == 0));
+    if (n == 0)
+        return;
+
+    // The block must not wrap around the address space.
+    assert(n - 1 <= (addr_t)(0xffffffff - addr));
+    handle_read_listeners_range(ram, addr, (addr_t)(addr + (n - 1)));
+
+    while (n > 0)
+    {
+        const word_t *page = lookup_ram_page(ram, addr);
+        const addr_t in_page_addr = addr & (ram->fast.page_size - 1);
+        size_t words_to_copy = ram->fast.page_size - in_page_addr;
+        if (words_to_copy > n)
+            words_to_copy = n;
+
+#if HAS_ATOMICS
+        if (ram->concurrent)
+        {
+            for (size_t i = 0; i < words_to_copy; ++i)
+                dst[i] = ATOMIC_LOAD_RELAXED(&page[in_page_addr + i]);
+        }
+        else
+#endif
+            memcpy(dst, page + in_page_addr, sizeof(word_t) * words_to_copy);
+        RAM_STAT_PAGE_ACCESSES(ram, addr, words_to_copy, 0);
+        dst += words_to_copy;
+        addr += (addr_t)words_to_copy;
+        n -= words_to_copy;
+    }
+}
+
+void ram_write_block(ram_t *ram, addr_t addr, const word_t *src, size_t n)
+{
+    assert(ram != NULL && (src != NULL || n == 0));
+    if (n == 0)
+        return;
+
+    // The block must not wrap around the address space.
+    assert(n - 1 <= (addr_t)(0xffffffff - addr));
+    const addr_t addr_low = addr;
+    const word_t *words = src;
+    const size_t word_count = n;
+
+    while (n > 0)
+    {
+        word_t *page = get_ram_page(ram, addr);
+        const addr_t in_page_addr = addr & (ram->fast.page_size - 1);
+        size_t words_to_copy = ram->fast.page_size - in_page_addr;
+        if (words_to_copy > n)
+            words_to_copy = n;
+
+#if HAS_ATOMICS
+        if (ram->concurrent)
+        {
+            for (size_t i = 0; i < words_to_copy; ++i)
+                ATOMIC_STORE_RELAXED(&page[in_page_addr + i], src[i]);
+        }
+        else
+#endif
+            memcpy(page + in_page_addr, src, sizeof(word_t) * words_to_copy);
+        RAM_STAT_PAGE_ACCESSES(ram, addr, 0, words_to_copy);
+        src += words_to_copy;
+        addr += (addr_t)words_to_copy;
+        n -= words_to_copy;
+    }
+
+    handle_write_listeners_range(ram, addr_low, (addr_t)(addr_low + (word_count - 1)), words, 1);
+}
+
+/*
+ * Batched accesses.
+ */
+
+// Prefetches the page table entry of the memory page starting at base_addr.
+static inline void prefetch_page_entry(ram_t *ram, addr_t base_addr)
+{
+    if (ram->pages.backend == RAM_BACKEND_RADIX_TABLE)
+    {
+        const addr_t page_number = base_addr >> ram->fast.page_shift;
+        const ram_page_t *leaf = ATOMIC_LOAD_RELAXED(&ram->pages.radix_directory[page_number >> ram->radix_leaf_bits]);
+        if (leaf != NULL)
+            RAM_PREFETCH(&leaf[page_number & (((addr_t)1 << ram->radix_leaf_bits) - 1)]);
+    }
+    else
+    {
+        const addr_t position = (ram_core_hash(base_addr) >> 7) & (ram->pages.table.capacity - 1);
+        RAM_PREFETCH(&ram->pages.table.ctrl[position]);
+        RAM_PREFETCH(&ram->pages.table.slots[position]);
+    }
+}
+
+// Sets words[i] to the address of the word addrs[i] for the n (at most
+// RAM_BATCH_SIZE) given addresses, looking up or creating (if write is true)
+// each distinct page only once. The page table entries are all prefetched
+// first, then the words as soon as their page is known.
+static void resolve_batch(ram_t *ram, const addr_t *addrs, size_t n, int write, word_t **words)
+{
+    assert(n <= RAM_BATCH_SIZE);
+    const addr_t page_mask = ram->fast.page_size - 1;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i == 0 || ((addrs[i] ^ addrs[i - 1]) & ~page_mask) != 0)
+            prefetch_page_entry(ram, addrs[i] & ~page_mask);
+    }
+
+    ram_cached_page_t pages[RAM_BATCH_PAGE_CACHE_SIZE];
+    for (size_t i = 0; i < RAM_BATCH_PAGE_CACHE_SIZE; ++i)
+        pages[i].base_addr = INVALID_BASE_ADDR;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const addr_t base_addr = addrs[i] & ~page_mask;
+        ram_cached_page_t *page = &pages[(base_addr >> ram->fast.page_shift) & (RAM_BATCH_PAGE_CACHE_SIZE - 1)];
+        if (page->base_addr != base_addr)
+        {
+            page->base_addr = base_addr;
+            page->data = write ? get_ram_page(ram, base_addr) : lookup_ram_page(ram, base_addr);
+        }
+
+        words[i] = &page->data[addrs[i] - base_addr];
+        RAM_PREFETCH(words[i]);
+    }
+}
+
+/* The pages looked up ahead stay valid as long as no listener is called (a
+ * listener may access the RAM block in any way), so the batched accesses are
+ * only used when there are no listeners of the corresponding kind. They are
+ * not used with compressed pages either, whose decoded copies would not all
+ * fit in their slots, and which would all be promoted by the writes. */
+
+void ram_gather(ram_t *ram, const addr_t *addrs, word_t *out, size_t n)
+{
+    assert(ram != NULL && ((addrs != NULL && out != NULL) || n == 0));
+
+    if (ram->read_listeners.count != 0 || ram->config.compressed_pages)
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = ram_get(ram, addrs[i]);
+        return;
+    }
+
+    word_t *words[RAM_BATCH_SIZE];
+    for (size_t first = 0; first < n; first += RAM_BATCH_SIZE)
+    {
+        const size_t count = (n - first < RAM_BATCH_SIZE) ? (n - first) : RAM_BATCH_SIZE;
+        hold_evictions(ram);
+        resolve_batch(ram, addrs + first, count, 0, words);
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[first + i] = load_word(ram, words[i]);
+            RAM_STAT_PAGE_ACCESSES(ram, addrs[first + i], 1, 0);
+        }
+        release_evictions(ram);
+    }
+}
+
+void ram_scatter(ram_t *ram, const addr_t *addrs, const word_t *values, size_t n)
+{
+    assert(ram != NULL && ((addrs != NULL && values != NULL) || n == 0));
+
+    if (ram->write_listeners.count != 0 || ram->config.compressed_pages)
+    {
+        for (size_t i = 0; i < n; ++i)
+            ram_set(ram, addrs[i], values[i]);
+        return;
+    }
+
+    word_t *words[RAM_BATCH_SIZE];
+    for (size_t first = 0; first < n; first += RAM_BATCH_SIZE)
+    {
+        const size_t count = (n - first < RAM_BATCH_SIZE) ? (n - first) : RAM_BATCH_SIZE;
+        hold_evictions(ram);
+        resolve_batch(ram, addrs + first, count, 1, words);
+        for (size_t i = 0; i < count; ++i)
+        {
+            store_word(ram, words[i], values[first + i]);
+            RAM_STAT_PAGE_ACCESSES(ram, addrs[first + i], 0, 1);
+        }
+        release_evictions(ram);
+    }
+}
+
+/*
+ * Page scans.
+ */
+
+/* The kernels work on the words of a single page (which are not accessed
+ * concurrently), the ram_* functions split the ranges page by page. */
+
+// Sets the n given words to value.
+static void fill_words(word_t *words, size_t n, word_t value)
+{
+    if (value == 0)
+    {
+        memset(words, 0, sizeof(word_t) * n);
+        return;
+    }
+
+    size_t i = 0;
+#if HAS_AVX2
+    const __m256i filler = _mm256_set1_epi32((int)value);
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *)(words + i), filler);
+#elif HAS_SSE2
+    const __m128i filler = _mm_set1_epi32((int)value);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i *)(words + i), filler);
+#elif HAS_NEON
+    const uint32x4_t filler = vdupq_n_u32(value);
+    for (; i + 4 <= n; i += 4)
+        vst1q_u32(words + i, filler);
+#endif
+    for (; i < n; ++i)
+        words[i] = value;
+}
+
+// Returns the index of the first of the n given words equal to value, or n if
+// there is none.
+static size_t find_word(const word_t *words, size_t n, word_t value)
+{
+    size_t i = 0;
+#if HAS_AVX2
+    const __m256i needle = _mm256_set1_epi32((int)value);
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i chunk = _mm256_loadu_si256((const __m256i *)(words + i));
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(chunk, needle));
+        if (mask != 0)
+            return i + ram_core_count_trailing_zeros(mask) / 4;
+    }
+#elif HAS_SSE2
+    const __m128i needle = _mm_set1_epi32((int)value);
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128i chunk = _mm_loadu_si128((const __m128i *)(words + i));
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi32(chunk, needle));
+        if (mask != 0)
+            return i + ram_core_count_trailing_zeros(mask) / 4;
+    }
+#elif HAS_NEON
+    const uint32x4_t needle = vdupq_n_u32(value);
+    for (; i + 4 <= n; i += 4)
+    {
+        // Each 32-bits lane becomes 16 bits of the mask.
+        const uint32x4_t equal = vceqq_u32(vld1q_u32(words + i), needle);
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(equal)), 0);
+        if (mask != 0)
+            return i + ram_core_count_trailing_zeros(mask) / 16;
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        if (words[i] == value)
+            return i;
+    }
+    return n;
+}
+
+// Returns the index of the first word that differs between the n words of a
+// and b, or n if they are equal.
+static size_t find_mismatch(const word_t *a, const word_t *b, size_t n)
+{
+    size_t i = 0;
+#if HAS_AVX2
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i chunk_a = _mm256_loadu_si256((const __m256i *)(a + i));
+        const __m256i chunk_b = _mm256_loadu_si256((const __m256i *)(b + i));
+        const uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(chunk_a, chunk_b));
+        if (mask != 0)
+            return i + ram_core_count_trailing_zeros(mask) / 4;
+    }
+#elif HAS_SSE2
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128i chunk_a = _mm_loadu_si128((const __m128i *)(a + i));
+        const __m128i chunk_b = _mm_loadu_si128((const __m128i *)(b + i));
+        const uint32_t mask = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi32(chunk_a, chunk_b)) & 0xffff;
+        if (mask != 0)
+            return i + ram_core_count_trailing_zeros(mask) / 4;
+    }
+#elif HAS_NEON
+    for (; i + 4 <= n; i += 4)
+    {
+        const uint32x4_t equal = vceqq_u32(vld1q_u32(a + i), vld1q_u32(b + i));
+        const uint64_t mask = ~vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(equal)), 0);
+        if (mask != 0)
+            return i + ram_core_count_trailing_zeros(mask) / 16;
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        if (a[i] != b[i])
+            return i;
+    }
+    return n;
+}
+
+/* The words of concurrent RAM blocks are accessed atomically, one by one. */
+
+static void concurrent_fill_words(word_t *words, size_t n, word_t value)
+{
+    for (size_t i = 0; i < n; ++i)
+        ATOMIC_STORE_RELAXED(&words[i], value);
+}
+
+static size_t concurrent_find_word(const word_t *words, size_t n, word_t value)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (ATOMIC_LOAD_RELAXED(&words[i]) == value)
+            return i;
+    }
+    return n;
+}
+
+static size_t concurrent_find_mismatch(const word_t *a, const word_t *b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (ATOMIC_LOAD_RELAXED(&a[i]) != ATOMIC_LOAD_RELAXED(&b[i]))
+            return i;
+    }
+    return n;
+}
+
+// Sets all the words of the given page (of a RAM block with compressed pages)
+// to value, which makes it a uniform compressed page.
+static void fill_compressed_page(ram_t *ram, addr_t base_addr, word_t value)
+{
+    ram_page_t *page = find_ram_page(ram, base_addr);
+    if (page == NULL)
+    {
+        if (value != 0)
+            insert_compressed_page(ram, base_addr, value)->flags |= RAM_PAGE_DIRTY;
+        return;
+    }
+
+    if ((page->flags & RAM_PAGE_COMPRESSED) != 0)
+    {
+        ram_compressed_page_t *compressed = (ram_compressed_page_t *)page->data;
+        compressed->fill = value;
+        compressed->count = 0;
+    }
+    else
+    {
+        release_page_data(&ram->arena->page_allocator, page);
+        page->data = (word_t *)compressed_page_create(value, 0);
+        page->flags = (page->flags & ~(RAM_PAGE_FILE_BACKED | RAM_PAGE_WRITABLE)) | RAM_PAGE_COMPRESSED;
+        ram->compressed_page_count += 1;
+    }
+
+    page->flags |= RAM_PAGE_DIRTY;
+    uncache_page(ram, base_addr);
+    forget_decoded_page(ram, base_addr);
+}
+
+void ram_fill(ram_t *ram, addr_t addr, word_t value, size_t n)
+{
+    assert(ram != NULL);
+    if (n == 0)
+        return;
+
+    // The range must not wrap around the address space.
+    assert(n - 1 <= (addr_t)(0xffffffff - addr));
+    const addr_t addr_low = addr;
+    const size_t word_count = n;
+
+    while (n > 0)
+    {
+        const addr_t in_page_addr = addr & (ram->fast.page_size - 1);
+        size_t words_to_fill = ram->fast.page_size - in_page_addr;
+        if (words_to_fill > n)
+            words_to_fill = n;
+
+        // Missing pages are already zeros, they are not created.
+        if (ram->config.compressed_pages && words_to_fill == ram->fast.page_size)
+        {
+            fill_compressed_page(ram, addr, value);
+            RAM_STAT_PAGE_ACCESSES(ram, addr, 0, words_to_fill);
+        }
+        else if (value != 0 || lookup_ram_page(ram, addr) != ram->zero_page)
+        {
+            word_t *page = get_ram_page(ram, addr);
+            if (ram->concurrent)
+                concurrent_fill_words(page + in_page_addr, words_to_fill, value);
+            else
+                fill_words(page + in_page_addr, words_to_fill, value);
+            RAM_STAT_PAGE_ACCESSES(ram, addr, 0, words_to_fill);
+        }
+
+        addr += (addr_t)words_to_fill;
+        n -= words_to_fill;
+    }
+
+    handle_write_listeners_range(ram, addr_low, (addr_t)(addr_low + (word_count - 1)), &value, 0);
+}
+
+int ram_compare(ram_t *ram_a, ram_t *ram_b, addr_t addr, size_t n)
+{
+    assert(ram_a != NULL && ram_b != NULL);
+    if (n == 0)
+        return 0;
+
+    // The range must not wrap around the address space.
+    assert(n - 1 <= (addr_t)(0xffffffff - addr));
+    handle_read_listeners_range(ram_a, addr, (addr_t)(addr + (n - 1)));
+    handle_read_listeners_range(ram_b, addr, (addr_t)(addr + (n - 1)));
+
+    // The page sizes are powers of 2, so a chunk of the smallest page size
+    // never crosses a page of either RAM block.
+    const addr_t chunk_size = (ram_a->fast.page_size < ram_b->fast.page_size) ? ram_a->fast.page_size
+                                                                                 : ram_b->fast.page_size;
+    const int concurrent = ram_a->concurrent || ram_b->concurrent;
+    while (n > 0)
+    {
+        size_t words_to_compare = chunk_size - (addr & (chunk_size - 1));
+        if (words_to_compare > n)
+            words_to_compare = n;
+
+        const word_t *page_a = lookup_ram_page(ram_a, addr);
+        const word_t *page_b = lookup_ram_page(ram_b, addr);
+        const word_t *words_a = page_a + (addr & (ram_a->fast.page_size - 1));
+        const word_t *words_b = page_b + (addr & (ram_b->fast.page_size - 1));
+
+        // Missing pages on both sides and pages shared copy-on-write are
+        // equal without looking at them.
+        if (words_a != words_b && (page_a != ram_a->zero_page || page_b != ram_b->zero_page))
+        {
+            const size_t i = concurrent ? concurrent_find_mismatch(words_a, words_b, words_to_compare)
+                                        : find_mismatch(words_a, words_b, words_to_compare);
+            if (i < words_to_compare)
+            {
+                const word_t word_a = load_word(ram_a, &words_a[i]);
+                const word_t word_b = load_word(ram_b, &words_b[i]);
+                return (word_a < word_b) ? -1 : 1;
+            }
+        }
+
+        addr += (addr_t)words_to_compare;
+        n -= words_to_compare;
+    }
+
+    return 0;
+}
+
+size_t ram_find_word(ram_t *ram, addr_t addr, size_t n, word_t value)
+{
+    assert(ram != NULL);
+    if (n == 0)
+        return 0;
+
+    // The range must not wrap around the address space.
+    assert(n - 1 <= (addr_t)(0xffffffff - addr));
+    handle_read_listeners_range(ram, addr, (addr_t)(addr + (n - 1)));
+
+    size_t offset = 0;
+    while (offset < n)
+    {
+        const addr_t in_page_addr = addr & (ram->fast.page_size - 1);
+        size_t words_to_scan = ram->fast.page_size - in_page_addr;
+        if (words_to_scan > n - offset)
+            words_to_scan = n - offset;
+
+        const word_t *page = lookup_ram_page(ram, addr);
+        if (page == ram->zero_page)
+        {
+            // A missing page only contains zeros.
+            if (value == 0)
+                return offset;
+        }
+        else
+        {
+            const size_t i = ram->concurrent ? concurrent_find_word(page + in_page_addr, words_to_scan, value)
+                                             : find_word(page + in_page_addr, words_to_scan, value);
+            if (i < words_to_scan)
+                return offset + i;
+        }
+
+        addr += (addr_t)words_to_scan;
+        offset += words_to_scan;
+    }
+
+    return n;
+}
+
+/*
+ * Page reclamation.
+ */
+
+// Discards the given n words of a single memory page, see ram_discard().
+// Returns 1 if the page was removed.
+static int discard_page_words(ram_t *ram, addr_t addr, size_t n)
+{
+    const addr_t base_addr = addr & ~(ram->fast.page_size - 1);
+    // A removed page is not swapped in first.
+    ram_page_t *page = find_page_entry(ram, base_addr);
+    if (page == NULL)
+        return 0;
+
+    if (n == ram->fast.page_size)
+    {
+        remove_ram_page(ram, page);
+        return 1;
+    }
+
+    // The pages only partly in the range are kept, their part is zeroed.
+    word_t *data = get_ram_page(ram, addr);
+    const addr_t in_page_addr = addr - base_addr;
+    if (ram->concurrent)
+        concurrent_fill_words(data + in_page_addr, n, 0);
+    else
+        fill_words(data + in_page_addr, n, 0);
+    RAM_STAT_PAGE_ACCESSES(ram, addr, 0, n);
+    return 0;
+}
+
+typedef struct ram_discarded_range_t
+{
+    addr_t addr_low;
+    addr_t addr_high;
+    int removed;
+} ram_discarded_range_t;
 
-#ifndef RAM_NO_READ_LISTENER
-void ram_install_read_listener(ram_t *ram, addr_t addr_low, addr_t addr_high,
-                               ram_read_listener_fn_t callback)
+// Removes the pages entirely in the given range.
+static void discard_page_visitor(ram_t *ram, ram_page_t *page, void *user_data)
 {
-    struct ram_read_listener_t *listener = (struct ram_read_listener_t *)malloc(sizeof(struct ram_read_listener_t));
-    check_alloc(listener);
+    ram_discarded_range_t *range = (ram_discarded_range_t *)user_data;
+    if (page->base_addr >= range->addr_low && page->base_addr + (ram->fast.page_size - 1) <= range->addr_high)
+    {
+        remove_ram_page(ram, page);
+        range->removed = 1;
+    }
+}
 
-    listener->callback = callback;
-    listener->next = NULL;
-    listener->addr_low = addr_low;
-    listener->addr_high = addr_high;
+void ram_discard(ram_t *ram, addr_t addr, size_t n)
+{
+    assert(ram != NULL);
+    if (n == 0)
+        return;
+
+    // The range must not wrap around the address space.
+    assert(n - 1 <= (addr_t)(0xffffffff - addr));
+    const addr_t page_mask = ram->fast.page_size - 1;
+    const addr_t addr_low = addr;
+    const addr_t addr_high = (addr_t)(addr + (n - 1));
+    const word_t zero = 0;
+    int removed = 0;
+
+    if ((n >> ram->fast.page_shift) > ram->page_count)
+    {
+        // The range has more pages than the RAM block, so it is faster to
+        // visit the existing ones. Only the pages of the two ends of the
+        // range may be partly in it.
+        ram_discarded_range_t range = {addr_low, addr_high, 0};
+        visit_ram_pages(ram, &discard_page_visitor, &range);
+        removed = range.removed;
+
+        if ((addr_low | page_mask) >= addr_high)
+        {
+            discard_page_words(ram, addr_low, n);
+        }
+        else
+        {
+            if ((addr_low & page_mask) != 0)
+                discard_page_words(ram, addr_low, (size_t)(page_mask - (addr_low & page_mask)) + 1);
+            if ((addr_high & page_mask) != page_mask)
+                discard_page_words(ram, addr_high & ~page_mask, (size_t)(addr_high & page_mask) + 1);
+        }
+    }
+    else
+    {
+        while (n > 0)
+        {
+            size_t words_to_discard = ram->fast.page_size - (addr & page_mask);
+            if (words_to_discard > n)
+                words_to_discard = n;
+
+            removed |= discard_page_words(ram, addr, words_to_discard);
+            addr += (addr_t)words_to_discard;
+            n -= words_to_discard;
+        }
+    }
+
+    if (removed)
+        flush_caches(ram, 1, 1);
+
+    handle_write_listeners_range(ram, addr_low, addr_high, &zero, 0);
+}
+
+typedef struct ram_compaction_t
+{
+    size_t removed;
+    size_t compressed;
+} ram_compaction_t;
+
+static void compact_page_visitor(ram_t *ram, ram_page_t *page, void *user_data)
+{
+    ram_compaction_t *compaction = (ram_compaction_t *)user_data;
+
+    // The evicted pages are only known to be zeros when flagged.
+    int is_zero;
+    if (page->data == NULL)
+    {
+        is_zero = (page->flags & RAM_PAGE_SWAPPED_ZERO) != 0;
+    }
+    else if ((page->flags & RAM_PAGE_COMPRESSED) != 0)
+    {
+        const ram_compressed_page_t *compressed = (const ram_compressed_page_t *)page->data;
+        is_zero = compressed->count == 0 && compressed->fill == 0;
+    }
+    else
+    {
+        is_zero = find_mismatch(page->data, ram->zero_page, ram->fast.page_size) == ram->fast.page_size;
+        if (!is_zero && ram->config.compressed_pages)
+            compaction->compressed += compress_dense_page(ram, page);
+    }
+
+    if (is_zero)
+    {
+        remove_ram_page(ram, page);
+        compaction->removed += 1;
+    }
+}
+
+size_t ram_compact(ram_t *ram)
+{
+    assert(ram != NULL);
+
+    ram_compaction_t compaction = {0, 0};
+    visit_ram_pages(ram, &compact_page_visitor, &compaction);
+    if (compaction.removed == 0 && compaction.compressed == 0)
+        return 0;
+
+    flush_caches(ram, 1, 1);
+    if (compaction.removed == 0)
+        return 0;
+
+    if (ram->pages.backend == RAM_BACKEND_RADIX_TABLE)
+    {
+        // Free the leaf tables without pages.
+        const size_t dir_size = (size_t)1 << ram->radix_dir_bits;
+        const size_t leaf_size = (size_t)1 << ram->radix_leaf_bits;
+        for (size_t i = 0; i < dir_size; ++i)
+        {
+            ram_page_t *leaf = ram->pages.radix_directory[i];
+            if (leaf == NULL)
+                continue;
+
+            size_t j = 0;
+            while (j < leaf_size && !page_is_used(&leaf[j]))
+                ++j;
+            if (j == leaf_size)
+            {
+                free(leaf);
+                ram->pages.radix_directory[i] = NULL;
+            }
+        }
+    }
+    else
+    {
+        // Shrink the hash table to a load factor of at most 7/16, which also
+        // drops the deleted slots.
+        addr_t capacity = RAM_HT_GROUP_SIZE;
+        while (ram->page_count > ht_max_load(capacity) / 2)
+            capacity *= 2;
+        ht_rebuild(ram, (capacity < ram->pages.table.capacity) ? capacity : ram->pages.table.capacity);
+    }
+
+    return compaction.removed;
+}
+
+/*
+ * RAM statistics.
+ */
+
+ram_stats_t ram_get_stats(ram_t *ram)
+{
+    assert(ram != NULL);
+
+    ram_stats_t stats;
+#ifdef RAM_ENABLE_STATS
+    stats = ram->stats;
+#else
+    memset(&stats, 0, sizeof(stats));
+#endif
+    stats.page_count = ram->page_count;
+    stats.bucket_count = ram->pages.table.capacity;
+    stats.swapped_page_count = ram->swapped_page_count;
+    stats.compressed_page_count = ram->compressed_page_count;
+    return stats;
+}
+
+#ifdef RAM_ENABLE_PAGE_STATS
+static void reset_page_stats_visitor(ram_t *ram, ram_page_t *page, void *_)
+{
+    page->reads = 0;
+    page->writes = 0;
+}
+#endif
+
+void ram_reset_stats(ram_t *ram)
+{
+    assert(ram != NULL);
+
+#ifdef RAM_ENABLE_STATS
+    memset(&ram->stats, 0, sizeof(ram->stats));
+    for (uint32_t i = 0; i < ram->read_listeners.count; ++i)
+        ram->read_listeners.listeners[i].call_count = 0;
+    for (uint32_t i = 0; i < ram->write_listeners.count; ++i)
+        ram->write_listeners.listeners[i].call_count = 0;
+#endif
+#ifdef RAM_ENABLE_PAGE_STATS
+    visit_ram_pages(ram, &reset_page_stats_visitor, NULL);
+#endif
+}
+
+// Count of pages printed by ram_dump_stats().
+#define RAM_DUMP_HOT_PAGE_COUNT 16
+
+#ifdef RAM_ENABLE_PAGE_STATS
+static void collect_hot_page_visitor(ram_t *ram, ram_page_t *page, void *user_data)
+{
+    ram_page_array_t *pages = (ram_page_array_t *)user_data;
+    if (page->reads != 0 || page->writes != 0)
+        pages->pages[pages->page_count++] = *page;
+}
+
+// Sorts by decreasing count of accesses.
+static int compare_page_accesses(const void *lhs, const void *rhs)
+{
+    const uint64_t a = ((const ram_page_t *)lhs)->reads + ((const ram_page_t *)lhs)->writes;
+    const uint64_t b = ((const ram_page_t *)rhs)->reads + ((const ram_page_t *)rhs)->writes;
+    return (a < b) - (a > b);
+}
+#endif // RAM_ENABLE_PAGE_STATS
+
+#ifdef RAM_ENABLE_STATS
+static void dump_listener_stats(const ram_listener_set_t *set, const char *kind, FILE *out)
+{
+    for (uint32_t i = 0; i < set->count; ++i)
+    {
+        const ram_listener_t *listener = &set->listeners[i];
+        fprintf(out, "  %s listener [0x%08x, 0x%08x]: %llu calls\n", kind, listener->addr_low, listener->addr_high,
+                (unsigned long long)listener->call_count);
+    }
+}
+#endif // RAM_ENABLE_STATS
+
+// Returns numerator / denominator, or 0 if denominator is 0.
+static double safe_ratio(uint64_t numerator, uint64_t denominator)
+{
+    return (denominator != 0) ? (double)numerator / (double)denominator : 0.0;
+}
+
+void ram_dump_stats(ram_t *ram, FILE *out)
+{
+    assert(ram != NULL && out != NULL);
+
+    const ram_stats_t stats = ram_get_stats(ram);
+    fprintf(out, "RAM statistics:\n");
+#ifndef RAM_ENABLE_STATS
+    fprintf(out, "  (counters disabled, compile memory.c with RAM_ENABLE_STATS)\n");
+#endif
+    fprintf(out, "  pages: %llu (page size: %u words)\n", (unsigned long long)stats.page_count,
+            ram->fast.page_size);
+    if (ram->max_resident_pages != 0)
+    {
+        fprintf(out, "  swapped pages: %llu (budget: %u resident pages)\n",
+                (unsigned long long)stats.swapped_page_count, ram->max_resident_pages);
+    }
+    if (ram->config.compressed_pages)
+        fprintf(out, "  compressed pages: %llu\n", (unsigned long long)stats.compressed_page_count);
+    if (ram->pages.backend == RAM_BACKEND_HASH_TABLE)
+    {
+        fprintf(out, "  hash table: %llu buckets (load factor: %.2f)\n", (unsigned long long)stats.bucket_count,
+                safe_ratio(stats.page_count, stats.bucket_count));
+    }
+
+#ifdef RAM_ENABLE_STATS
+    const uint64_t reads = stats.read_cache_hits + stats.read_cache_misses;
+    const uint64_t writes = stats.write_cache_hits + stats.write_cache_misses;
+    fprintf(out, "  read cache: %llu hits, %llu misses (hit rate: %.2f%%)\n",
+            (unsigned long long)stats.read_cache_hits, (unsigned long long)stats.read_cache_misses,
+            100.0 * safe_ratio(stats.read_cache_hits, reads));
+    fprintf(out, "  write cache: %llu hits, %llu misses (hit rate: %.2f%%)\n",
+            (unsigned long long)stats.write_cache_hits, (unsigned long long)stats.write_cache_misses,
+            100.0 * safe_ratio(stats.write_cache_hits, writes));
+    fprintf(out, "  page table lookups: %llu\n", (unsigned long long)stats.page_lookups);
+    if (ram->pages.backend == RAM_BACKEND_HASH_TABLE)
+    {
+        fprintf(out, "  hash table probes: %.2f on average, %llu at most\n",
+                safe_ratio(stats.ht_probes, stats.ht_lookups), (unsigned long long)stats.ht_max_probe_length);
+        fprintf(out, "  hash table resizes: %llu (%.3f ms)\n", (unsigned long long)stats.ht_resizes,
+                (double)stats.ht_resize_ns / 1e6);
+    }
+    fprintf(out, "  page allocations: %llu (%llu copies on write)\n", (unsigned long long)stats.page_allocations,
+            (unsigned long long)stats.page_copies);
+    fprintf(out, "  page discards: %llu\n", (unsigned long long)stats.page_discards);
+    if (ram->max_resident_pages != 0)
+    {
+        fprintf(out, "  page evictions: %llu (%llu swap-ins)\n", (unsigned long long)stats.page_evictions,
+                (unsigned long long)stats.page_swap_ins);
+    }
+    if (ram->config.compressed_pages)
+        fprintf(out, "  page promotions: %llu\n", (unsigned long long)stats.page_promotions);
+    fprintf(out, "  listener calls: %llu reads, %llu writes\n", (unsigned long long)stats.read_listener_calls,
+            (unsigned long long)stats.write_listener_calls);
+    dump_listener_stats(&ram->read_listeners, "read", out);
+    dump_listener_stats(&ram->write_listeners, "write", out);
+#endif // RAM_ENABLE_STATS
+
+#ifdef RAM_ENABLE_PAGE_STATS
+    ram_page_array_t hot_pages;
+    hot_pages.pages = (ram_page_t *)malloc(sizeof(ram_page_t) * (ram->page_count + 1));
+    check_alloc(hot_pages.pages);
+    hot_pages.page_count = 0;
+    visit_ram_pages(ram, &collect_hot_page_visitor, &hot_pages);
+    qsort(hot_pages.pages, hot_pages.page_count, sizeof(ram_page_t), &compare_page_accesses);
+
+    fprintf(out, "  most accessed pages:\n");
+    for (addr_t i = 0; i < hot_pages.page_count && i < RAM_DUMP_HOT_PAGE_COUNT; ++i)
+    {
+        const ram_page_t *page = &hot_pages.pages[i];
+        fprintf(out, "    0x%08x: %llu reads, %llu writes\n", page->base_addr, (unsigned long long)page->reads,
+                (unsigned long long)page->writes);
+    }
+    free(hot_pages.pages);
+#endif // RAM_ENABLE_PAGE_STATS
+}
+
+/*
+ * RAM views.
+ */
+
+ram_view_t *ram_view_create(ram_t *ram)
+{
+    assert(ram != NULL);
+
+    ram_view_t *view = (ram_view_t *)malloc(sizeof(ram_view_t));
+    check_alloc(view);
+    view->fast.page_size = ram->fast.page_size;
+    view->fast.page_shift = ram->fast.page_shift;
+    flush_page_cache(view->fast.read_cache);
+    flush_page_cache(view->fast.write_cache);
+    view->ram = ram;
+    view->concurrent = ram->concurrent;
+    view->pending_count = 0;
 
-    // Insert the listener to the RAM block.
-    if (ram->read_listener == NULL)
+    spin_lock(&ram->lock);
+    view->next = ram->views;
+    ram->views = view;
+    spin_unlock(&ram->lock);
+    return view;
+}
+
+void ram_view_destroy(ram_view_t *view)
+{
+    if (view == NULL)
+        return;
+
+    ram_view_flush(view);
+
+    ram_t *ram = view->ram;
+    spin_lock(&ram->lock);
+    for (ram_view_t **it = &ram->views; *it != NULL; it = &(*it)->next)
     {
-        ram->read_listener = listener;
+        if (*it == view)
+        {
+            *it = view->next;
+            break;
+        }
     }
+    spin_unlock(&ram->lock);
+    free(view);
+}
+
+// Returns the data of the memory page starting at base_addr if it exists and
+// is private (neither shared nor file-backed), NULL otherwise.
+static word_t *find_private_ram_page(ram_t *ram, addr_t base_addr)
+{
+    ram_page_t *page;
+    if (ram->pages.backend == RAM_BACKEND_RADIX_TABLE)
+        page = radix_find(ram, base_addr, 0);
     else
+        page = ht_lookup(ram, base_addr, NULL);
+    if (page == NULL)
+        return NULL;
+
+    // Same loads order as concurrent_get_ram_page().
+    const uint32_t flags = ATOMIC_LOAD(&page->flags);
+    word_t *data = ATOMIC_LOAD(&page->data);
+    if (data == NULL || (flags & (RAM_PAGE_FILE_BACKED | RAM_PAGE_COMPRESSED)) != 0 ||
+        page_is_shared(&ram->arena->page_allocator, data))
+        return NULL;
+
+    // Same check as concurrent_get_ram_page(): a copy on write may have
+    // released data since it was loaded, which is then the snapshot's page.
+    // The page is then just not cached.
+    if (ATOMIC_LOAD(&page->data) != data)
+        return NULL;
+    return data;
+}
+
+word_t ram_view_get(ram_view_t *view, addr_t addr)
+{
+    const addr_t base_addr = addr & ~(view->fast.page_size - 1);
+    ram_cached_page_t *cached_page = &view->fast.read_cache[RAM_PAGE_CACHE_INDEX(&view->fast, base_addr)];
+    if (cached_page->base_addr != base_addr)
+    {
+        ram_t *ram = view->ram;
+        const addr_t addr_high = base_addr + (ram->fast.page_size - 1);
+        word_t *data = NULL;
+        if (!listener_set_intersects(&ram->read_listeners, base_addr, addr_high))
+            data = find_private_ram_page(ram, base_addr);
+
+        if (data == NULL)
+        {
+            handle_read_listeners(ram, addr);
+            return load_word(ram, &lookup_ram_page(ram, addr)[addr - base_addr]);
+        }
+
+        cached_page->base_addr = base_addr;
+        cached_page->data = data;
+    }
+
+#if HAS_ATOMICS
+    if (view->concurrent)
+        return ATOMIC_LOAD_RELAXED(&cached_page->data[addr - base_addr]);
+#endif
+    return cached_page->data[addr - base_addr];
+}
+
+void ram_view_set(ram_view_t *view, addr_t addr, word_t value)
+{
+    const addr_t base_addr = addr & ~(view->fast.page_size - 1);
+    ram_cached_page_t *cached_page = &view->fast.write_cache[RAM_PAGE_CACHE_INDEX(&view->fast, base_addr)];
+    if (cached_page->base_addr != base_addr)
+    {
+        // The page is private after get_ram_page().
+        ram_t *ram = view->ram;
+        word_t *data = get_ram_page(ram, addr);
+        const addr_t addr_high = base_addr + (ram->fast.page_size - 1);
+        if (listener_set_intersects(&ram->write_listeners, base_addr, addr_high))
+        {
+            store_word(ram, &data[addr - base_addr], value);
+
+#ifndef RAM_NO_WRITE_LISTENER
+            // The write listeners are called later, by ram_view_flush().
+            if (listener_set_find(&ram->write_listeners, addr) != NULL)
+            {
+                if (view->pending_count == RAM_VIEW_MAX_PENDING_WRITES)
+                    ram_view_flush(view);
+                view->pending_addrs[view->pending_count] = addr;
+                view->pending_values[view->pending_count] = value;
+                view->pending_count += 1;
+            }
+#endif // !RAM_NO_WRITE_LISTENER
+            return;
+        }
+
+        cached_page->base_addr = base_addr;
+        cached_page->data = data;
+    }
+
+#if HAS_ATOMICS
+    if (view->concurrent)
+    {
+        ATOMIC_STORE_RELAXED(&cached_page->data[addr - base_addr], value);
+        return;
+    }
+#endif
+    cached_page->data[addr - base_addr] = value;
+}
+
+void ram_view_flush(ram_view_t *view)
+{
+    assert(view != NULL);
+
+    // The listeners may write through the view again.
+    while (view->pending_count > 0)
     {
-        struct ram_read_listener_t *it = ram->read_listener;
-        while (it->next != NULL)
-            it = it->next;
-        it->next = listener;
+        const size_t count = view->pending_count;
+        addr_t addrs[RAM_VIEW_MAX_PENDING_WRITES];
+        word_t values[RAM_VIEW_MAX_PENDING_WRITES];
+        memcpy(addrs, view->pending_addrs, sizeof(addr_t) * count);
+        memcpy(values, view->pending_values, sizeof(word_t) * count);
+        view->pending_count = 0;
+
+        for (size_t i = 0; i < count; ++i)
+            handle_write_listeners(view->ram, addrs[i], values[i]);
     }
 }
 
+#define MOVE_CURSOR(x, y) "\x1b[" #y ";" #x "H"
+#define CLEAR_LINE "\x1b[0K"
+
+#ifndef RAM_NO_READ_LISTENER
+void ram_install_read_listener(ram_t *ram, addr_t addr_low, addr_t addr_high,
+                               ram_read_listener_fn_t callback)
+{
+    listener_set_add(&ram->read_listeners, addr_low, addr_high, (ram_listener_fn_t)callback);
+    update_direct_access(ram);
+    // Some cached pages may now have listeners.
+    flush_caches(ram, 1, 0);
+}
+
+void ram_remove_read_listener(ram_t *ram, ram_read_listener_fn_t callback)
+{
+    // The pages without listeners are cached again by the next accesses.
+    listener_set_remove(&ram->read_listeners, (ram_listener_fn_t)callback);
+    update_direct_access(ram);
+}
+
 static void ram_read_debugger_listener(ram_t *_, addr_t addr)
 {
     printf("RAM read at %#x\n", addr);
@@ -461,27 +4317,17 @@ void ram_install_read_debugger(ram_t *ram, int use_screen)
 void ram_install_write_listener(ram_t *ram, addr_t addr_low, addr_t addr_high,
                                 ram_write_listener_fn_t callback)
 {
-    struct ram_write_listener_t *listener = (struct ram_write_listener_t *)malloc(
-        sizeof(struct ram_write_listener_t));
-    check_alloc(listener);
-
-    listener->callback = callback;
-    listener->next = NULL;
-    listener->addr_low = addr_low;
-    listener->addr_high = addr_high;
+    listener_set_add(&ram->write_listeners, addr_low, addr_high, (ram_listener_fn_t)callback);
+    update_direct_access(ram);
+    // Some cached pages may now have listeners.
+    flush_caches(ram, 0, 1);
+}
 
-    // Insert the listener to the RAM block.
-    if (ram->write_listener == NULL)
-    {
-        ram->write_listener = listener;
-    }
-    else
-    {
-        struct ram_write_listener_t *it = ram->write_listener;
-        while (it->next != NULL)
-            it = it->next;
-        it->next = listener;
-    }
+void ram_remove_write_listener(ram_t *ram, ram_write_listener_fn_t callback)
+{
+    // The pages without listeners are cached again by the next accesses.
+    listener_set_remove(&ram->write_listeners, (ram_listener_fn_t)callback);
+    update_direct_access(ram);
 }
 
 static void ram_write_debugger_listener(ram_t *_, addr_t addr, word_t value)
@@ -526,17 +4372,186 @@ rom_t rom_create(const word_t *data, size_t data_len)
 
     rom_t rom;
     rom.data = rom_data;
+    rom.data_len = data_len;
     return rom;
 }
 
+/* The data of the ROMs created by rom_from_file() is shared by all the ROMs of
+ * the same file version (see get_file_version()), through a process-wide
+ * cache of reference-counted entries. The data of an entry is either a
+ * read-only mapping of the file, or a buffer returned by read_file(). The
+ * cache is also used by rom_destroy() to know how to destroy the data of a ROM
+ * (the data of the ROMs created by rom_create() is not in the cache). */
+
+// Identifies a version of a file: a change of the file content changes at
+// least its modification time.
+typedef struct rom_file_version_t
+{
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    uint64_t mtime_ns;
+} rom_file_version_t;
+
+typedef struct rom_cache_entry_t
+{
+    char *filename;
+    // If 0, the version of the file is unknown and the entry is not shared.
+    int versioned;
+    rom_file_version_t version;
+    const word_t *data;
+    size_t data_len;
+    int mapped;
+    size_t ref_count;
+    struct rom_cache_entry_t *next;
+} rom_cache_entry_t;
+
+static rom_cache_entry_t *rom_cache = NULL;
+static spin_lock_t rom_cache_lock = 0;
+
+// Gets the current version of the file filename. Returns 0 if it is unknown.
+static int get_file_version(const char *filename, rom_file_version_t *version)
+{
+    memset(version, 0, sizeof(rom_file_version_t));
+#if IS_POSIX
+    struct stat file_stat;
+    if (stat(filename, &file_stat) != 0)
+        return 0;
+
+    version->device = (uint64_t)file_stat.st_dev;
+    version->inode = (uint64_t)file_stat.st_ino;
+    version->size = (uint64_t)file_stat.st_size;
+#ifdef __APPLE__
+    version->mtime_ns = (uint64_t)file_stat.st_mtimespec.tv_sec * 1000000000 + file_stat.st_mtimespec.tv_nsec;
+#else
+    version->mtime_ns = (uint64_t)file_stat.st_mtim.tv_sec * 1000000000 + file_stat.st_mtim.tv_nsec;
+#endif
+    return 1;
+#elif defined(_WIN32)
+    struct _stat64 file_stat;
+    if (_stat64(filename, &file_stat) != 0)
+        return 0;
+
+    version->device = (uint64_t)file_stat.st_dev;
+    version->size = (uint64_t)file_stat.st_size;
+    version->mtime_ns = (uint64_t)file_stat.st_mtime * 1000000000;
+    return 1;
+#else
+    (void)filename;
+    return 0;
+#endif
+}
+
+// Returns the cache entry of the given file version, with a new reference,
+// or NULL if there is none. The cache must be locked.
+static rom_cache_entry_t *rom_cache_find(const char *filename, const rom_file_version_t *version)
+{
+    for (rom_cache_entry_t *entry = rom_cache; entry != NULL; entry = entry->next)
+    {
+        if (entry->versioned && memcmp(&entry->version, version, sizeof(rom_file_version_t)) == 0 &&
+            strcmp(entry->filename, filename) == 0)
+        {
+            entry->ref_count += 1;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Destroys the data of the given cache entry (which is not in the cache any
+// more) and the entry itself.
+static void rom_cache_entry_destroy(rom_cache_entry_t *entry)
+{
+    if (entry->mapped)
+        unmap_file(entry->data, entry->data_len);
+    else
+        free((word_t *)entry->data);
+    free(entry->filename);
+    free(entry);
+}
+
 rom_t rom_from_file(const char *filename)
 {
-    addr_t data_len;
-    const word_t *data = read_file(filename, &data_len);
-    if (data == NULL)
-        file_error(filename);
+    rom_file_version_t version;
+    const int versioned = get_file_version(filename, &version);
+
+    rom_t rom;
+    rom_cache_entry_t *entry = NULL;
+    if (versioned)
+    {
+        spin_lock(&rom_cache_lock);
+        entry = rom_cache_find(filename, &version);
+        spin_unlock(&rom_cache_lock);
+    }
+
+    if (entry == NULL)
+    {
+        // The file is loaded without the lock, which would make the other
+        // threads spin while it is read.
+        const size_t filename_len = strlen(filename);
+        entry = (rom_cache_entry_t *)malloc(sizeof(rom_cache_entry_t));
+        check_alloc(entry);
+        entry->filename = (char *)malloc(filename_len + 1);
+        check_alloc(entry->filename);
+        memcpy(entry->filename, filename, filename_len + 1);
+        entry->versioned = versioned;
+        entry->version = version;
+        entry->ref_count = 1;
+
+        // Try first to map the file, this avoids to copy all of it.
+        entry->data = map_file(filename, &entry->data_len);
+        entry->mapped = entry->data != NULL;
+        if (!entry->mapped)
+        {
+            addr_t data_len;
+            entry->data = read_file(filename, &data_len);
+            if (entry->data == NULL)
+                file_error(filename);
+            entry->data_len = data_len;
+        }
 
-    return rom_create(data, data_len);
+        // Another thread may have loaded the same file in the meantime.
+        spin_lock(&rom_cache_lock);
+        rom_cache_entry_t *loaded_entry = versioned ? rom_cache_find(filename, &version) : NULL;
+        if (loaded_entry == NULL)
+        {
+            entry->next = rom_cache;
+            rom_cache = entry;
+        }
+        spin_unlock(&rom_cache_lock);
+
+        if (loaded_entry != NULL)
+        {
+            rom_cache_entry_destroy(entry);
+            entry = loaded_entry;
+        }
+    }
+
+    rom.data = entry->data;
+    rom.data_len = entry->data_len;
+    return rom;
 }
 
-void rom_destroy(rom_t rom) { free((word_t *)rom.data); }
+void rom_destroy(rom_t rom)
+{
+    spin_lock(&rom_cache_lock);
+    for (rom_cache_entry_t **it = &rom_cache; *it != NULL; it = &(*it)->next)
+    {
+        rom_cache_entry_t *entry = *it;
+        if (entry->data == rom.data)
+        {
+            entry->ref_count -= 1;
+            const int unused = entry->ref_count == 0;
+            if (unused)
+                *it = entry->next;
+            spin_unlock(&rom_cache_lock);
+
+            if (unused)
+                rom_cache_entry_destroy(entry);
+            return;
+        }
+    }
+    spin_unlock(&rom_cache_lock);
+
+    free((word_t *)rom.data);
+}
@@ -7,6 +7,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 typedef uint32_t word_t;
@@ -27,8 +28,107 @@ void check_alloc(void* ptr);
 
 typedef struct ram_t ram_t;
 
+/** The data structure used by a RAM block to map addresses to memory pages. */
+typedef enum ram_backend_t {
+    /** Open addressing hash table (a Swiss table, probed 16 slots at a time).
+     * Its memory usage is proportional to the count of used memory pages. It
+     * is resized incrementally, a few slots at each page creation. */
+    RAM_BACKEND_HASH_TABLE,
+    /** Two-level radix page table. Lookups are faster than with the hash
+     * table (no hashing, no probing and no rehashing) but leaf tables are
+     * allocated for each used region of a few megawords. */
+    RAM_BACKEND_RADIX_TABLE,
+} ram_backend_t;
+
+/** The backend used by ram_create() and ram_from_file(). */
+#ifndef RAM_DEFAULT_BACKEND
+#define RAM_DEFAULT_BACKEND RAM_BACKEND_HASH_TABLE
+#endif // !RAM_DEFAULT_BACKEND
+
+/** How the memory pages of a RAM block are backed by the OS pages. */
+typedef enum ram_huge_pages_t {
+    /** Normal OS pages. */
+    RAM_HUGE_PAGES_NONE,
+    /** Ask the OS to use transparent huge pages when possible (only a hint,
+     * used on Linux). */
+    RAM_HUGE_PAGES_TRANSPARENT,
+    /** Use explicitly reserved huge pages (MAP_HUGETLB on Linux), or
+     * transparent huge pages if there are not enough reserved ones. */
+    RAM_HUGE_PAGES_HUGETLB,
+} ram_huge_pages_t;
+
+/** The configuration of a RAM block, see ram_create_ex(). */
+typedef struct ram_config_t {
+    /** The page mapping backend. */
+    ram_backend_t backend;
+    /** The size, in words, of a memory page. Must be a power of 2, at least
+     * 2. If 0, the size of the OS memory pages is used. */
+    addr_t page_size;
+    /** The initial bucket count of the hash table backend. Must be a power of
+     * 2, at least 2 (counts smaller than 16 are rounded up to 16). If 0, a
+     * small default is used. */
+    addr_t initial_bucket_count;
+    /** The kind of OS pages used to back the memory pages. */
+    ram_huge_pages_t huge_pages;
+    /** If not 0, the RAM block may be accessed by several threads at once.
+     *
+     * Pages are then looked up and created without locks (in a radix table,
+     * whatever the requested backend), and accesses to a word are atomic:
+     * ram_get() and ram_set() are relaxed atomic operations, ram_get_set(),
+     * ram_atomic_cas() and ram_atomic_fetch_add() are sequentially
+     * consistent. Blocks accesses are atomic word by word. The page caches
+     * are not used, so the accesses are a bit slower.
+     *
+     * The other operations (ram_init(), listener installation, snapshots,
+     * restores, clones, ...) must not run while another thread accesses the
+     * RAM block. Listeners may be called from any thread. */
+    int concurrent;
+    /** If not 0, the maximum count of memory pages kept in memory. Beyond it,
+     * the least recently used pages are evicted to a swap file, and read back
+     * on their next access.
+     *
+     * The victims are chosen by the CLOCK algorithm. Pages full of zeros are
+     * not written to the swap file. Pages shared with snapshots or clones and
+     * pages mapped from a file count in the budget but are never evicted
+     * (except the pages restored by ram_restore() beyond the budget, which are
+     * evicted right away), and ram_snapshot(), ram_clone() and
+     * ram_for_each_page() read the evicted pages back. The budget may be exceeded by a few pages while a function
+     * uses several pages at once. Not supported for concurrent RAM blocks. */
+    addr_t max_resident_pages;
+    /** The path of the swap file (see max_resident_pages), which is created
+     * or truncated. If NULL, a temporary file is used. On POSIX systems, the
+     * file is removed right after its creation. ram_create_ex() returns NULL
+     * if the file can not be created. */
+    const char* swap_file;
+    /** If not 0, the memory pages with few distinct words are compressed: a
+     * uniform page (whose words are all equal, for example
+     * after a ram_fill() of the whole page) as a single word, and a sparse
+     * page as the pairs of offset and value of its words that differ from
+     * the most common one, as long as they take at most a quarter of a page.
+     *
+     * The pages written by ram_set() start sparse. A page is promoted to a
+     * normal (dense) page by the ram_set() that exceeds its form, and by the
+     * other writes (ram_write_block(), ram_get_set(), the atomic operations,
+     * the views...). ram_compact() compresses the dense pages again when
+     * possible. Reads of a compressed page use a decoded copy, which
+     * stays in the page caches like a dense page. ram_gather() and
+     * ram_scatter() access the words one by one. Not supported for concurrent
+     * RAM blocks. */
+    int compressed_pages;
+} ram_config_t;
+
+/** Returns the configuration used by ram_create(). */
+ram_config_t ram_default_config();
+
 /** Creates an infinite size RAM block. */
 ram_t* ram_create();
+/** Same as ram_create() but using the given page mapping @a backend. */
+ram_t* ram_create_with_backend(ram_backend_t backend);
+/** Same as ram_create() but using the given @a config. Larger pages and huge
+ * pages are better for dense workloads, smaller pages for very sparse ones.
+ * Returns NULL if the page size or the initial bucket count of @a config is
+ * not a power of 2 (at least 2), or if the swap file can not be created. */
+ram_t* ram_create_ex(const ram_config_t* config);
 /** Initializes the given RAM block with the given initial data. */
 void ram_init(ram_t* ram, const word_t* data, size_t data_len);
 /** Creates an infinite size RAM block first initialized with the data stored at
@@ -36,12 +136,296 @@ void ram_init(ram_t* ram, const word_t* data, size_t data_len);
 ram_t* ram_from_file(const char* filename);
 /** Destroys the given @a ram block. */
 void ram_destroy(ram_t* ram);
+/** Saves the content of the given @a ram block into the file @a filename, in
+ * a sparse format where only the non-zero memory pages are stored. Returns 0
+ * on success and a non-zero value on failure. */
+int ram_save(ram_t* ram, const char* filename);
+/** Creates an infinite size RAM block initialized with the content of the
+ * file @a filename written by ram_save().
+ *
+ * When possible, the file is mapped into memory and its pages are only copied
+ * on their first write. */
+ram_t* ram_load(const char* filename);
+
+/** A saved content of a RAM block, see ram_snapshot(). */
+typedef struct ram_snapshot_t ram_snapshot_t;
+
+/** Saves the current content of the given @a ram block.
+ *
+ * The memory pages are shared copy-on-write between the RAM block and the
+ * snapshot, so taking a snapshot only costs a copy of the page table. The
+ * snapshot must be destroyed by ram_snapshot_destroy(). */
+ram_snapshot_t* ram_snapshot(ram_t* ram);
+/** Restores the content of the given @a ram block to the given @a snapshot
+ * (which may have been taken from another RAM block with the same page size).
+ *
+ * The pages of the snapshot are shared copy-on-write if the snapshot was taken
+ * from @a ram, a clone of it or the RAM block it was cloned from, and copied
+ * otherwise. Listeners are not changed. */
+void ram_restore(ram_t* ram, const ram_snapshot_t* snapshot);
+/** Destroys the given @a snapshot. */
+void ram_snapshot_destroy(ram_snapshot_t* snapshot);
+/** Creates a new RAM block with the same content and configuration as the
+ * given @a ram block.
+ *
+ * The memory pages are shared copy-on-write between both RAM blocks, so
+ * cloning only costs a copy of the page table. Listeners are not cloned.
+ * A RAM block, its clones and their snapshots share their memory and must not
+ * be used concurrently. */
+ram_t* ram_clone(ram_t* ram);
+
 /** Gets the word at the given @a addr of the given @a ram block. */
 word_t ram_get(ram_t* ram, addr_t addr);
 /** Sets the word at the given @a addr to @a value of the given @a ram block. */
 void ram_set(ram_t* ram, addr_t addr, word_t value);
 /** Same as ram_get() then ram_set(), but faster. */
 word_t ram_get_set(ram_t* ram, addr_t addr, word_t value);
+/** Replaces the word at the given @a addr of the given @a ram block by
+ * @a desired if it is equal to @a expected. Returns the previous word (so the
+ * word was replaced if and only if it is equal to @a expected).
+ *
+ * This is atomic for concurrent RAM blocks (see ram_config_t). Read listeners
+ * are called, and write listeners too if the word was replaced. A failed
+ * comparison is a read: a missing page is not created. */
+word_t ram_atomic_cas(ram_t* ram, addr_t addr, word_t expected, word_t desired);
+/** Adds @a value to the word at the given @a addr of the given @a ram block
+ * (wrapping around on overflow) and returns the previous word.
+ *
+ * This is atomic for concurrent RAM blocks (see ram_config_t). Read and write
+ * listeners are called. */
+word_t ram_atomic_fetch_add(ram_t* ram, addr_t addr, word_t value);
+/** Reads the @a n words starting at @a addr of the given @a ram block into
+ * @a dst.
+ *
+ * This is equivalent to @a n calls to ram_get() but the words are copied page
+ * by page. Read listeners are called for each read address, before any word
+ * is copied. The block must not wrap around the address space. */
+void ram_read_block(ram_t* ram, addr_t addr, word_t* dst, size_t n);
+/** Writes the @a n words of @a src into the given @a ram block starting at
+ * @a addr.
+ *
+ * This is equivalent to @a n calls to ram_set() but the words are copied page
+ * by page. Write listeners are called for each written address, after all
+ * the words are copied. The block must not wrap around the address space. */
+void ram_write_block(ram_t* ram, addr_t addr, const word_t* src, size_t n);
+
+/** Sets the @a n words starting at @a addr of the given @a ram block to
+ * @a value.
+ *
+ * This is equivalent to @a n calls to ram_set() but the words are set page by
+ * page (with SIMD instructions when available), and missing pages are not
+ * created when @a value is 0. Write listeners are called for each written
+ * address, after all the words are set. The range must not wrap around the
+ * address space. */
+void ram_fill(ram_t* ram, addr_t addr, word_t value, size_t n);
+/** Compares the @a n words starting at @a addr of the RAM blocks @a ram_a and
+ * @a ram_b (which may have different page sizes). Returns 0 if they are
+ * equal, otherwise a negative (resp. positive) value if the first different
+ * word is smaller (resp. greater) in @a ram_a.
+ *
+ * Missing pages are compared as zeros without being created, and pages
+ * shared by both RAM blocks (see ram_clone()) are not compared at all, so
+ * comparing large sparse RAM blocks is fast. Read listeners of both RAM blocks
+ * are called for each address of the range, before the comparison. The range
+ * must not wrap around the address space. */
+int ram_compare(ram_t* ram_a, ram_t* ram_b, addr_t addr, size_t n);
+/** Returns the offset (from @a addr) of the first of the @a n words starting at
+ * @a addr of the given @a ram block that is equal to @a value, or @a n if
+ * there is none.
+ *
+ * Missing pages are zeros and are not scanned. Read listeners are called for
+ * each address of the range, before the search. The range must not wrap
+ * around the address space. */
+size_t ram_find_word(ram_t* ram, addr_t addr, size_t n, word_t value);
+
+/** Sets the @a n words starting at @a addr of the given @a ram block to 0, like
+ * ram_fill(), but the memory pages entirely in the range are removed (as if
+ * they were never written) instead of being zeroed. This is the equivalent of
+ * madvise(MADV_DONTNEED), for example to reclaim the memory of a heap freed
+ * by the guest.
+ *
+ * The memory of the removed pages is given back to the OS when the pages are
+ * multiples of the OS memory pages, and not backed by huge pages. Write
+ * listeners are called for each address of the range, with 0, after all the
+ * words are discarded. The range must not wrap around the address space.
+ *
+ * For a concurrent RAM block, there must not be any other access to the RAM
+ * (or its views) during the call. */
+void ram_discard(ram_t* ram, addr_t addr, size_t n);
+/** Removes the memory pages of the given @a ram block that only contain zeros,
+ * exactly like ram_discard() does, and shrinks the page table to the
+ * remaining pages. Returns the count of removed pages. With compressed pages
+ * (see ram_config_t), the other pages are compressed when possible.
+ *
+ * This scans all the pages, so it is meant to be called now and then, for
+ * example after a lot of memory was zeroed by the guest. For a concurrent RAM
+ * block, there must not be any other access to the RAM (or its views) during
+ * the call. */
+size_t ram_compact(ram_t* ram);
+
+/** Reads the words at the @a n given @a addrs of the given @a ram block into
+ * @a out.
+ *
+ * This is equivalent to @a n calls to ram_get(), in order, but the pages of
+ * the addresses are looked up by batches, once per distinct page, and their
+ * words are prefetched, so independent accesses to many pages overlap. If the
+ * RAM block has read listeners, the words are read one by one instead. */
+void ram_gather(ram_t* ram, const addr_t* addrs, word_t* out, size_t n);
+/** Writes the @a n given @a values at the @a n given @a addrs of the given
+ * @a ram block.
+ *
+ * This is equivalent to @a n calls to ram_set(), in order (so the last of
+ * several writes to the same address wins), but batched like ram_gather(). If
+ * the RAM block has write listeners, the words are written one by one
+ * instead. */
+void ram_scatter(ram_t* ram, const addr_t* addrs, const word_t* values, size_t n);
+
+/** Returns the size, in words, of the memory pages of the given @a ram
+ * block. */
+addr_t ram_page_size(const ram_t* ram);
+
+/** An iterator over the dirty pages of a RAM block, see
+ * ram_dirty_pages_begin(). */
+typedef struct ram_page_iterator_t {
+    /** The base address of the current page. */
+    addr_t base_addr;
+    /** The ram_page_size() words of the current page. */
+    const word_t* data;
+
+    /* Implementation details. */
+    ram_t* ram;
+    size_t slot;
+    size_t removed_index;
+} ram_page_iterator_t;
+
+/** Starts an iteration over the dirty pages of the given @a ram block, in no
+ * particular order. Returns 0 if there are none, otherwise @a it refers to the
+ * first one.
+ *
+ * A page is dirty from its first write (by any function writing to the RAM
+ * block) until the next call to ram_clear_dirty(). Pages mapped from a file
+ * by ram_from_file() or ram_load() are clean until they are written, and all
+ * the pages restored by ram_restore() are dirty. The pages removed by
+ * ram_discard(), ram_compact() or ram_restore() are dirty too, as pages of
+ * zeros (@a data then points to zeros), until they are created again or the
+ * next call to ram_clear_dirty(). Tracking the dirty pages costs nothing on
+ * the common case of the writes.
+ *
+ * The RAM block must not be modified during the iteration. With a memory
+ * budget (see ram_config_t::max_resident_pages), the data of the current page
+ * is only valid until the next access to the RAM block. */
+int ram_dirty_pages_begin(ram_t* ram, ram_page_iterator_t* it);
+/** Moves the given iterator @a it to the next dirty page. Returns 0 if there
+ * are no more dirty pages. */
+int ram_dirty_pages_next(ram_page_iterator_t* it);
+/** Marks all the pages of the given @a ram block as clean. */
+void ram_clear_dirty(ram_t* ram);
+
+typedef void (*ram_page_fn_t)(ram_t*, addr_t base_addr, const word_t* data, void* user_data);
+/** Calls @a callback for each memory page of the given @a ram block, in no
+ * particular order, with its base address, its ram_page_size() words and
+ * @a user_data. Missing pages (which are all zeros) are not visited.
+ *
+ * The RAM block must not be modified by @a callback. */
+void ram_for_each_page(ram_t* ram, ram_page_fn_t callback, void* user_data);
+
+/* With RAM_ENABLE_PAGE_STATS, RAM_ENABLE_STATS is enabled too. */
+#if defined(RAM_ENABLE_PAGE_STATS) && !defined(RAM_ENABLE_STATS)
+#define RAM_ENABLE_STATS
+#endif
+
+/** Access statistics of a RAM block, see ram_get_stats().
+ *
+ * The counters are only maintained when memory.c is compiled with
+ * RAM_ENABLE_STATS defined, they are always 0 otherwise (and cost nothing).
+ * The accesses done by the inline fast path (see RAM_INLINE_FAST_PATH) and
+ * through views are not counted. */
+typedef struct ram_stats_t {
+    /** Page cache hits and misses of the read and write accesses. */
+    uint64_t read_cache_hits;
+    uint64_t read_cache_misses;
+    uint64_t write_cache_hits;
+    uint64_t write_cache_misses;
+    /** Lookups of a page in the page table (after a page cache miss). */
+    uint64_t page_lookups;
+    /** Lookups in the hash table backend, the total count of probed groups
+     * (of 16 buckets) and the maximum count of groups probed by a lookup. */
+    uint64_t ht_lookups;
+    uint64_t ht_probes;
+    uint64_t ht_max_probe_length;
+    /** Resizes of the hash table backend and the total time spent in them
+     * (including the incremental moves of the pages), in nanoseconds. */
+    uint64_t ht_resizes;
+    uint64_t ht_resize_ns;
+    /** Allocated memory pages, including the copies on write (of shared and
+     * file-backed pages), which are also counted alone. */
+    uint64_t page_allocations;
+    uint64_t page_copies;
+    /** Memory pages removed by ram_discard() and ram_compact(). */
+    uint64_t page_discards;
+    /** Calls of the read and write listeners (see ram_dump_stats() for the
+     * counts per listener). */
+    uint64_t read_listener_calls;
+    uint64_t write_listener_calls;
+    /** Memory pages evicted to the swap file and read back from it (see
+     * ram_config_t::max_resident_pages). */
+    uint64_t page_evictions;
+    uint64_t page_swap_ins;
+    /** Compressed memory pages promoted to dense pages (see
+     * ram_config_t::compressed_pages). */
+    uint64_t page_promotions;
+    /** The current count of used memory pages and of hash table buckets (0
+     * for the radix backend). These are always available. */
+    uint64_t page_count;
+    uint64_t bucket_count;
+    /** The current count of used memory pages that are evicted to the swap
+     * file, and that are compressed (see ram_config_t::compressed_pages).
+     * These are always available. */
+    uint64_t swapped_page_count;
+    uint64_t compressed_page_count;
+} ram_stats_t;
+
+/** Returns the statistics of the given @a ram block since its creation or
+ * the last call to ram_reset_stats(). */
+ram_stats_t ram_get_stats(ram_t* ram);
+/** Resets the counters of the given @a ram block to 0 (including the ones of
+ * its listeners and pages). */
+void ram_reset_stats(ram_t* ram);
+/** Prints in a human readable format the statistics of the given @a ram
+ * block to @a out: the counters, the calls of each listener and, if memory.c
+ * is compiled with RAM_ENABLE_PAGE_STATS, the most accessed pages.
+ *
+ * With RAM_ENABLE_PAGE_STATS, each access to a page updates its own read or
+ * write counter (which costs a page table lookup per access). */
+void ram_dump_stats(ram_t* ram, FILE* out);
+
+/** A handle to access a RAM block with its own page caches, see
+ * ram_view_create(). */
+typedef struct ram_view_t ram_view_t;
+
+/** Creates a view of the given @a ram block.
+ *
+ * A view has its own page caches, so the common case of its accesses does not
+ * touch any data shared with the other threads: each thread accessing a
+ * concurrent RAM block (see ram_config_t) should use its own view. The RAM
+ * block remains the source of truth, and a view can be used along with the
+ * other RAM functions.
+ *
+ * The write listeners of the writes done through a view are called later, in
+ * order, by ram_view_flush(), which is also called when too many writes are
+ * pending and by ram_view_destroy(). Read listeners are called immediately.
+ *
+ * The views must be destroyed before the RAM block. */
+ram_view_t* ram_view_create(ram_t* ram);
+/** Flushes then destroys the given @a view. */
+void ram_view_destroy(ram_view_t* view);
+/** Same as ram_get() but through the given @a view. */
+word_t ram_view_get(ram_view_t* view, addr_t addr);
+/** Same as ram_set() but through the given @a view. */
+void ram_view_set(ram_view_t* view, addr_t addr, word_t value);
+/** Calls the write listeners of the writes done through the given @a view
+ * since the last flush. */
+void ram_view_flush(ram_view_t* view);
 
 #ifndef RAM_NO_READ_LISTENER
 typedef void (*ram_read_listener_fn_t)(ram_t*, addr_t);
@@ -53,6 +437,9 @@ typedef void (*ram_read_listener_fn_t)(ram_t*, addr_t);
  * argument to @a callback. */
 void ram_install_read_listener(ram_t* ram, addr_t addr_low, addr_t addr_high,
     ram_read_listener_fn_t callback);
+/** Removes all the read listeners of @a ram with the given @a callback,
+ * whatever their memory range. */
+void ram_remove_read_listener(ram_t* ram, ram_read_listener_fn_t callback);
 
 void ram_install_read_debugger(ram_t* ram, int use_screen);
 #endif // !RAM_NO_READ_LISTENER
@@ -67,26 +454,137 @@ typedef void (*ram_write_listener_fn_t)(ram_t*, addr_t, word_t);
  * value are given as arguments to @a callback. */
 void ram_install_write_listener(ram_t* ram, addr_t addr_low, addr_t addr_high,
     ram_write_listener_fn_t callback);
+/** Removes all the write listeners of @a ram with the given @a callback,
+ * whatever their memory range. */
+void ram_remove_write_listener(ram_t* ram, ram_write_listener_fn_t callback);
 
 void ram_install_write_debugger(ram_t* ram, int use_screen);
 #endif // !RAM_NO_WRITE_LISTENER
 
+/*
+ * Inline RAM fast path.
+ */
+
+/* The following declarations are implementation details of the RAM, they are
+ * only exposed so that the common case of ram_get(), ram_set() and
+ * ram_get_set() can be inlined into the caller. Do not use them directly. */
+
+/** Count of entries of the RAM page caches. Must be a power of 2. */
+#define RAM_PAGE_CACHE_SIZE 8
+
+typedef struct ram_cached_page_t {
+    addr_t base_addr;
+    word_t* data;
+} ram_cached_page_t;
+
+/** The first member of any ram_t. */
+typedef struct ram_fast_path_t {
+    /* Small direct-mapped caches of recently accessed memory pages, indexed by
+     * the page number. Reads and writes have their own cache because a read of
+     * a missing page is cached as a shared zero page, which must never be
+     * written. Pages with read (resp. write) listeners are never in the read
+     * (resp. write) cache. Shared or file-backed pages, which are copied on
+     * their first write, are never in the write cache, which only contains
+     * dirty pages (so the writes do not have to update the dirty flag). */
+    ram_cached_page_t read_cache[RAM_PAGE_CACHE_SIZE];
+    ram_cached_page_t write_cache[RAM_PAGE_CACHE_SIZE];
+    /* Size, in words, of a RAM's page size and its log2. */
+    addr_t page_size;
+    addr_t page_shift;
+} ram_fast_path_t;
+
+#define RAM_PAGE_CACHE_INDEX(fast, base_addr)                                  \
+    (((base_addr) >> (fast)->page_shift) & (RAM_PAGE_CACHE_SIZE - 1))
+
+#if defined(__GNUC__) || defined(__clang__)
+#define RAM_LIKELY(x) __builtin_expect(!!(x), 1)
+#else
+#define RAM_LIKELY(x) (x)
+#endif
+
+/** Same as ram_get() but inlined when the page is in the RAM page cache. */
+static inline word_t ram_get_inline(ram_t* ram, addr_t addr)
+{
+    const ram_fast_path_t* fast = (const ram_fast_path_t*)ram;
+    const addr_t base_addr = addr & ~(fast->page_size - 1);
+    const ram_cached_page_t* page
+        = &fast->read_cache[RAM_PAGE_CACHE_INDEX(fast, base_addr)];
+    if (RAM_LIKELY(page->base_addr == base_addr))
+        return page->data[addr - base_addr];
+    return (ram_get)(ram, addr);
+}
+
+/** Same as ram_set() but inlined when the page is in the RAM page cache. */
+static inline void ram_set_inline(ram_t* ram, addr_t addr, word_t value)
+{
+    const ram_fast_path_t* fast = (const ram_fast_path_t*)ram;
+    const addr_t base_addr = addr & ~(fast->page_size - 1);
+    const ram_cached_page_t* page
+        = &fast->write_cache[RAM_PAGE_CACHE_INDEX(fast, base_addr)];
+    if (RAM_LIKELY(page->base_addr == base_addr))
+        page->data[addr - base_addr] = value;
+    else
+        (ram_set)(ram, addr, value);
+}
+
+/** Same as ram_get_set() but inlined when the page is in the RAM page
+ * caches. */
+static inline word_t ram_get_set_inline(ram_t* ram, addr_t addr, word_t value)
+{
+    const ram_fast_path_t* fast = (const ram_fast_path_t*)ram;
+    const addr_t base_addr = addr & ~(fast->page_size - 1);
+    const addr_t cache_index = RAM_PAGE_CACHE_INDEX(fast, base_addr);
+    const ram_cached_page_t* page = &fast->write_cache[cache_index];
+    if (RAM_LIKELY(page->base_addr == base_addr
+            && fast->read_cache[cache_index].base_addr == base_addr)) {
+        const word_t old_value = page->data[addr - base_addr];
+        page->data[addr - base_addr] = value;
+        return old_value;
+    }
+    return (ram_get_set)(ram, addr, value);
+}
+
+/* If RAM_INLINE_FAST_PATH is defined, all RAM accesses are done through the
+ * inline fast path, which avoids a function call for most of them. */
+#if defined(RAM_INLINE_FAST_PATH) && !defined(CPULM_MEMORY_IMPLEMENTATION)
+#define ram_get(ram, addr) ram_get_inline((ram), (addr))
+#define ram_set(ram, addr, value) ram_set_inline((ram), (addr), (value))
+#define ram_get_set(ram, addr, value) ram_get_set_inline((ram), (addr), (value))
+#endif // RAM_INLINE_FAST_PATH
+
 /*
  * ROM abstraction.
  */
 
 typedef struct rom_t {
     const word_t* data;
+    /** The count of words of the ROM block. */
+    size_t data_len;
 } rom_t;
 
 /** Creates a ROM block with the given initial @a data of length @a data_len. */
 rom_t rom_create(const word_t* data, size_t data_len);
-/** Creates a ROM block with the data stored in the file @a filename. */
+/** Creates a ROM block with the data stored in the file @a filename.
+ *
+ * The ROM blocks created from the same file share the same read-only data
+ * (mapped into memory when possible), which is destroyed with the last of
+ * them: many instances of a simulator in one process only load their firmware
+ * once. A file is the same if its path, identity, size and modification time
+ * did not change. This may be called from several threads at once, like
+ * rom_destroy(). */
 rom_t rom_from_file(const char* filename);
 /** Destroys the given @a rom block. */
 void rom_destroy(rom_t rom);
-/** Gets the word at the given @a addr of the given @a rom block. */
+/** Gets the word at the given @a addr of the given @a rom block, which must be
+ * in the ROM block. */
 static inline word_t rom_get(rom_t rom, addr_t addr) { return rom.data[addr]; }
+/** Same as rom_get() but the words after the end of the given @a rom block are
+ * 0 (like the missing pages of a RAM block). The check is a single branch,
+ * which is always predicted correctly for the valid addresses. */
+static inline word_t rom_get_checked(rom_t rom, addr_t addr)
+{
+    return RAM_LIKELY(addr < rom.data_len) ? rom.data[addr] : 0;
+}
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,231 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+#ifndef CPULM_MEMORY_HPP
+#define CPULM_MEMORY_HPP
+
+#include "memory.h"
+#include "memory_core.h"
+
+#include <cassert>
+#include <stdexcept>
+#include <utility>
+
+/* A C++ interface to the RAM blocks of memory.h, for C++ simulators.
+ *
+ * sparse::Ram owns a ram_t created with its compile-time configuration. The
+ * pages, backends, snapshots, etc. are those of memory.c, only the hot path is
+ * specialized: get(), set() and get_set() are inlined with the page size as a
+ * constant shift and mask, and call the listeners of the ListenerPolicy
+ * directly (so they can be inlined too). These listeners do not disable the
+ * page caches, unlike the listeners of memory.h, which still work and are
+ * called by the slow path.
+ *
+ * The page cache misses look up the page table of memory_core.h, the one of
+ * memory.c, instantiated with the page size and the backend of the template
+ * arguments. The existing pages that can be accessed directly (see
+ * ram_page_table_t) are then cached without calling memory.c, which is only
+ * called to create, copy or decode pages, and when memory.c needs to see the
+ * accesses (listeners of memory.h, memory budget, statistics). */
+
+namespace sparse {
+
+/** A ListenerPolicy with no listeners, the accesses then cost exactly the
+ * page cache lookup. */
+struct NoListeners {
+  void on_read(addr_t) {}
+  void on_write(addr_t, word_t) {}
+};
+
+/** A ListenerPolicy calling the callable objects @a OnRead with the address of
+ * each read, before the read, and @a OnWrite with the address and the value of
+ * each write, after the write. See make_listeners(). */
+template <class OnRead, class OnWrite> struct CallbackListeners {
+  OnRead read;
+  OnWrite write;
+
+  void on_read(addr_t addr) { read(addr); }
+  void on_write(addr_t addr, word_t value) { write(addr, value); }
+};
+
+template <class OnRead, class OnWrite>
+CallbackListeners<OnRead, OnWrite> make_listeners(OnRead on_read,
+                                                  OnWrite on_write) {
+  return {std::move(on_read), std::move(on_write)};
+}
+
+/** A RAM block whose pages are 2^@a PageBits words, mapped by @a Backend,
+ * whose accesses through get(), set() and get_set() are reported to a
+ * @a ListenerPolicy (an object with on_read(addr_t) and on_write(addr_t,
+ * word_t) members, see NoListeners).
+ *
+ * A Ram is movable but not copyable (see clone()). The accesses done directly
+ * through its handle(), like ram_fill() or ram_restore(), are not reported to
+ * its ListenerPolicy. */
+template <unsigned PageBits = 10, ram_backend_t Backend = RAM_DEFAULT_BACKEND,
+          class ListenerPolicy = NoListeners>
+class Ram : private ListenerPolicy {
+  static_assert(PageBits >= 1 && PageBits <= 31,
+                "a page has from 2 to 2^31 words");
+
+public:
+  static constexpr addr_t page_size = (addr_t)1 << PageBits;
+  static constexpr addr_t page_mask = page_size - 1;
+
+  explicit Ram(ListenerPolicy listeners = ListenerPolicy())
+      : Ram(ram_default_config(), std::move(listeners)) {}
+  /** Creates the RAM block with the given @a config, whose backend and page
+   * size are replaced by the template arguments. Throws std::runtime_error
+   * if ram_create_ex() fails (e.g. the swap file can not be created). */
+  explicit Ram(ram_config_t config,
+               ListenerPolicy listeners = ListenerPolicy())
+      : ListenerPolicy(std::move(listeners)) {
+    config.backend = Backend;
+    config.page_size = page_size;
+    ram_ = checked(ram_create_ex(&config));
+    assert(ram_page_size(ram_) == page_size);
+    // Concurrent RAM blocks always use the radix table, but they have no
+    // direct accesses.
+    assert(core()->pages.backend == Backend ||
+           !(core()->pages.direct_reads || core()->pages.direct_writes));
+  }
+
+  Ram(const Ram &) = delete;
+  Ram &operator=(const Ram &) = delete;
+
+  Ram(Ram &&other) noexcept
+      : ListenerPolicy(std::move(other.listeners())), ram_(other.ram_) {
+    other.ram_ = nullptr;
+  }
+
+  Ram &operator=(Ram &&other) noexcept {
+    if (this != &other) {
+      reset();
+      listeners() = std::move(other.listeners());
+      ram_ = other.ram_;
+      other.ram_ = nullptr;
+    }
+    return *this;
+  }
+
+  ~Ram() { reset(); }
+
+  /** Returns a new RAM block with the same content, see ram_clone(). The
+   * listeners of the policy are copied, those of memory.h are not. Throws
+   * std::runtime_error if ram_clone() fails. */
+  Ram clone() const { return Ram(ram_clone(ram_), listeners()); }
+
+  /** The underlying RAM block, for the other functions of memory.h. Null
+   * after a move. */
+  ram_t *handle() const { return ram_; }
+  ListenerPolicy &listeners() { return *this; }
+  const ListenerPolicy &listeners() const { return *this; }
+
+  /** Same as ram_get(). */
+  word_t get(addr_t addr) {
+    listeners().on_read(addr);
+    const addr_t base_addr = addr & ~page_mask;
+    ram_cached_page_t *page = &core()->fast.read_cache[cache_index(addr)];
+    if (RAM_LIKELY(page->base_addr == base_addr))
+      return page->data[addr & page_mask];
+
+    if (core()->pages.direct_reads) {
+      const ram_page_t *entry = find_page(base_addr);
+      // The missing pages are only zeros.
+      if (entry == nullptr ||
+          (entry->data == nullptr && (entry->flags & RAM_PAGE_SWAPPED) == 0))
+        return 0;
+      if (entry->data != nullptr &&
+          (entry->flags & RAM_PAGE_COMPRESSED) == 0) {
+        page->base_addr = base_addr;
+        page->data = entry->data;
+        return page->data[addr & page_mask];
+      }
+    }
+    return (ram_get)(ram_, addr);
+  }
+
+  /** Same as ram_set(). */
+  void set(addr_t addr, word_t value) {
+    const addr_t base_addr = addr & ~page_mask;
+    ram_cached_page_t *page = &core()->fast.write_cache[cache_index(addr)];
+    if (RAM_LIKELY(page->base_addr == base_addr) ||
+        (core()->pages.direct_writes && cache_writable_page(page, base_addr)))
+      page->data[addr & page_mask] = value;
+    else
+      (ram_set)(ram_, addr, value);
+    listeners().on_write(addr, value);
+  }
+
+  /** Same as ram_get_set(). */
+  word_t get_set(addr_t addr, word_t value) {
+    listeners().on_read(addr);
+    const addr_t base_addr = addr & ~page_mask;
+    const addr_t index = cache_index(addr);
+    ram_cached_page_t *page = &core()->fast.write_cache[index];
+    ram_cached_page_t *read_page = &core()->fast.read_cache[index];
+    bool cached = RAM_LIKELY(page->base_addr == base_addr &&
+                             read_page->base_addr == base_addr);
+    if (!cached && core()->pages.direct_reads && core()->pages.direct_writes &&
+        cache_writable_page(page, base_addr)) {
+      *read_page = *page;
+      cached = true;
+    }
+    word_t old_value;
+    if (cached) {
+      old_value = page->data[addr & page_mask];
+      page->data[addr & page_mask] = value;
+    } else {
+      old_value = (ram_get_set)(ram_, addr, value);
+    }
+    listeners().on_write(addr, value);
+    return old_value;
+  }
+
+private:
+  Ram(ram_t *ram, const ListenerPolicy &listeners)
+      : ListenerPolicy(listeners), ram_(checked(ram)) {}
+
+  static ram_t *checked(ram_t *ram) {
+    if (ram == nullptr)
+      throw std::runtime_error("sparse::Ram: failed to create the RAM block");
+    return ram;
+  }
+
+  void reset() {
+    if (ram_ != nullptr)
+      ram_destroy(ram_);
+    ram_ = nullptr;
+  }
+
+  ram_core_t *core() const { return reinterpret_cast<ram_core_t *>(ram_); }
+
+  /** Returns the page table entry of the page starting at @a base_addr, see
+   * ram_core_find_page(). */
+  ram_page_t *find_page(addr_t base_addr) const {
+    return ram_core_find_page(&core()->pages, base_addr, PageBits, Backend,
+                              nullptr);
+  }
+
+  /** Puts in the write cache entry @a page the page starting at @a base_addr
+   * if it exists and can be written directly. Returns true on success. */
+  bool cache_writable_page(ram_cached_page_t *page, addr_t base_addr) const {
+    const ram_page_t *entry = find_page(base_addr);
+    if (entry == nullptr || (entry->flags & RAM_PAGE_WRITABLE) == 0)
+      return false;
+    page->base_addr = base_addr;
+    page->data = entry->data;
+    return true;
+  }
+
+  static addr_t cache_index(addr_t addr) {
+    return (addr >> PageBits) & (RAM_PAGE_CACHE_SIZE - 1);
+  }
+
+  ram_t *ram_;
+};
+
+} // namespace sparse
+
+#endif // !CPULM_MEMORY_HPP
@@ -0,0 +1,305 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+#ifndef CPULM_MEMORY_CORE_H
+#define CPULM_MEMORY_CORE_H
+
+#include "memory.h"
+
+#include <assert.h>
+
+// The SIMD instruction set of the hash table lookups, also used by the page
+// scan kernels of memory.c.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RAM_HAS_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RAM_HAS_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RAM_HAS_NEON 1
+#endif
+
+/* The page table of the RAM blocks and its lookups, shared by memory.c and the
+ * C++ interface of memory.hpp. This is not a public interface.
+ *
+ * The lookup functions take the page shift and the backend as parameters and
+ * are inlined: memory.c calls them with the runtime values of each RAM block,
+ * and sparse::Ram with its template arguments, so that its page cache misses
+ * are specialized lookups (constant shifts and masks, a single backend)
+ * without any call into memory.c for the existing pages. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+#if defined(__GNUC__) || defined(__clang__)
+#define RAM_PREFETCH(ptr) __builtin_prefetch(ptr)
+#else
+#define RAM_PREFETCH(ptr) ((void)(ptr))
+#endif
+
+/* The flags of the pages. */
+
+// The page data is a read-only view of a file mapped by ram_from_file(), it
+// must be copied before being written.
+#define RAM_PAGE_FILE_BACKED 0x1
+// The page was written since its creation or the last ram_clear_dirty(). The
+// write caches only contain dirty pages, so this flag is only set by the slow
+// path of the writes.
+#define RAM_PAGE_DIRTY 0x2
+// The page was evicted to the swap file (its data is NULL), see
+// enforce_memory_budget(). If RAM_PAGE_SWAPPED_ZERO is set too, the page only
+// contained zeros and was not written to the file.
+#define RAM_PAGE_SWAPPED 0x4
+#define RAM_PAGE_SWAPPED_ZERO 0x8
+// The page was looked up since the last time the eviction clock considered it.
+#define RAM_PAGE_REFERENCED 0x10
+// The page data is a ram_compressed_page_t, see compress_dense_page().
+#define RAM_PAGE_COMPRESSED 0x20
+// The page data can be written directly: the page is dirty, private (neither
+// shared nor file-backed) and neither compressed nor swapped. Set by the slow
+// path of the writes, like the write caches (which are flushed whenever this
+// flag is cleared).
+#define RAM_PAGE_WRITABLE 0x40
+
+typedef struct ram_page_t {
+    addr_t base_addr;
+    // Combination of the RAM_PAGE_* flags.
+    uint32_t flags;
+    word_t* data;
+#ifdef RAM_ENABLE_PAGE_STATS
+    // The count of words read and written in the page.
+    uint64_t reads, writes;
+#endif
+} ram_page_t;
+
+/* The hash table backend is a Swiss table: an open addressing table whose
+ * slots have a control byte each, stored apart. A control byte is either
+ * RAM_HT_EMPTY, RAM_HT_DELETED or, for a used slot, RAM_HT_USED with the 7 low
+ * bits of the hash of its base address. RAM_HT_EMPTY is 0 so that a new table
+ * is just zeroed memory, which the OS provides lazily for big tables. A lookup
+ * probes groups of RAM_HT_GROUP_SIZE consecutive control bytes at once (with
+ * SIMD instructions when available), starting at the slot given by the other
+ * bits of the hash: only the slots whose control byte matches are compared,
+ * and the probing stops at the first group with an empty slot. The table is
+ * grown when more than 7/8 of its slots are used, so groups with an empty slot
+ * are frequent and the probe sequences stay short. */
+#define RAM_HT_EMPTY 0x00
+#define RAM_HT_DELETED 0x01
+#define RAM_HT_USED 0x80
+// Count of control bytes of the hash table probed at once.
+#define RAM_HT_GROUP_SIZE 16
+
+typedef struct ram_hash_table_t {
+    // capacity + RAM_HT_GROUP_SIZE control bytes. The last ones are copies of
+    // the first ones, so a group can be loaded at any slot.
+    uint8_t* ctrl;
+    // The slots of the empty and deleted control bytes are all zeros.
+    ram_page_t* slots;
+    // A power of 2, at least RAM_HT_GROUP_SIZE.
+    addr_t capacity;
+    // The count of empty slots that can still be used before the maximum load
+    // factor is reached.
+    addr_t growth_left;
+} ram_hash_table_t;
+
+typedef struct ram_page_table_t {
+    ram_backend_t backend;
+    // If not 0, the existing pages can be read (resp. written if
+    // RAM_PAGE_WRITABLE) directly on a page cache miss: there are no read
+    // (resp. write) listeners, no memory budget, no statistics and the RAM
+    // block is not concurrent. Maintained by memory.c.
+    int direct_reads;
+    int direct_writes;
+
+    // Hash table backend (RAM_BACKEND_HASH_TABLE). During a resize, the pages
+    // not yet moved to the new table are still in old_table.
+    ram_hash_table_t table;
+    ram_hash_table_t old_table;
+
+    // Radix table backend (RAM_BACKEND_RADIX_TABLE). The directory has
+    // 2^(32 - page_shift - ram_core_radix_leaf_bits(page_shift)) entries, each
+    // one NULL or a leaf table of 2^ram_core_radix_leaf_bits(page_shift)
+    // pages.
+    ram_page_t** radix_directory;
+} ram_page_table_t;
+
+/** The first members of any ram_t. */
+typedef struct ram_core_t {
+    ram_fast_path_t fast;
+    ram_page_table_t pages;
+} ram_core_t;
+
+// Hash the given integer to have a better distribution.
+static inline addr_t ram_core_hash(addr_t x)
+{
+    // From https://stackoverflow.com/a/12996028
+    // addr_t is assumed to be 32-bits
+    x = ((x >> 16) ^ x) * 0x45d9f3b;
+    x = ((x >> 16) ^ x) * 0x45d9f3b;
+    x = (x >> 16) ^ x;
+    return x;
+}
+
+// Returns the count of trailing zero bits of x, which must not be 0.
+static inline unsigned ram_core_count_trailing_zeros(uint64_t x)
+{
+    assert(x != 0);
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(x);
+#else
+    unsigned count = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        count += 1;
+    }
+    return count;
+#endif
+}
+
+/* Group matching. The masks have RAM_HT_MATCH_BITS bits per control byte of
+ * the group, the lowest set bit of the first matching byte. */
+#if defined(RAM_HAS_AVX2) || defined(RAM_HAS_SSE2)
+#define RAM_HT_MATCH_BITS 1
+
+// Returns the mask of the control bytes of the given group equal to value.
+static inline uint64_t ram_core_ht_match(const uint8_t* group, uint8_t value)
+{
+    const __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+}
+
+// Returns the mask of the empty or deleted control bytes of the given group.
+static inline uint64_t ram_core_ht_match_free(const uint8_t* group)
+{
+    // Only the used control bytes have their high bit set.
+    return (uint64_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group)) ^ 0xffff;
+}
+#elif defined(RAM_HAS_NEON)
+#define RAM_HT_MATCH_BITS 4
+
+// Same as the SSE2 version but with a nibble per control byte, only the
+// highest bit of each nibble is kept so the lowest bit can be cleared.
+static inline uint64_t ram_core_ht_match_mask(uint8x16_t match)
+{
+    const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(match), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x8888888888888888ull;
+}
+
+static inline uint64_t ram_core_ht_match(const uint8_t* group, uint8_t value)
+{
+    return ram_core_ht_match_mask(vceqq_u8(vld1q_u8(group), vdupq_n_u8(value)));
+}
+
+static inline uint64_t ram_core_ht_match_free(const uint8_t* group)
+{
+    return ram_core_ht_match_mask(vcltq_u8(vld1q_u8(group), vdupq_n_u8(RAM_HT_USED)));
+}
+#else
+#define RAM_HT_MATCH_BITS 1
+
+static inline uint64_t ram_core_ht_match(const uint8_t* group, uint8_t value)
+{
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < RAM_HT_GROUP_SIZE; ++i)
+        mask |= (uint64_t)(group[i] == value) << i;
+    return mask;
+}
+
+static inline uint64_t ram_core_ht_match_free(const uint8_t* group)
+{
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < RAM_HT_GROUP_SIZE; ++i)
+        mask |= (uint64_t)((group[i] & RAM_HT_USED) == 0) << i;
+    return mask;
+}
+#endif
+
+// Returns the index of the first control byte of the given non-zero mask.
+static inline addr_t ram_core_ht_first_match(uint64_t mask)
+{
+    return (addr_t)(ram_core_count_trailing_zeros(mask) / RAM_HT_MATCH_BITS);
+}
+
+// Returns the slot of the page starting at base_addr in the given table, or
+// NULL if it is missing. If group_count is not NULL, it is set to the count
+// of probed groups.
+static inline ram_page_t* ram_core_ht_find(const ram_hash_table_t* table, addr_t base_addr, addr_t* group_count)
+{
+    const addr_t key_hash = ram_core_hash(base_addr);
+    const uint8_t h2 = (uint8_t)(RAM_HT_USED | (key_hash & 0x7f));
+    const addr_t index_mask = table->capacity - 1;
+    addr_t position = (key_hash >> 7) & index_mask;
+
+    // Most pages sit in the first slot of their group: fetch it while the
+    // control bytes are loaded, so a lookup costs one memory latency only.
+    RAM_PREFETCH(&table->slots[position]);
+
+    // There is always at least one empty slot, so this terminates.
+    for (addr_t groups = 1;; ++groups) {
+        const uint8_t* group = &table->ctrl[position];
+        for (uint64_t mask = ram_core_ht_match(group, h2); mask != 0; mask &= mask - 1) {
+            ram_page_t* slot = &table->slots[(position + ram_core_ht_first_match(mask)) & index_mask];
+            if (slot->base_addr == base_addr) {
+                if (group_count != NULL)
+                    *group_count = groups;
+                return slot;
+            }
+        }
+
+        if (ram_core_ht_match(group, RAM_HT_EMPTY) != 0) {
+            if (group_count != NULL)
+                *group_count = groups;
+            return NULL;
+        }
+
+        position = (position + RAM_HT_GROUP_SIZE) & index_mask;
+    }
+}
+
+// Returns the count of page number bits of the given page shift indexing the
+// leaf tables of the radix table backend, the other ones index its directory.
+static inline unsigned ram_core_radix_leaf_bits(unsigned page_shift)
+{
+    return (32 - page_shift) / 2;
+}
+
+// Returns the page table entry of the page starting at base_addr, in the given
+// page table of a RAM block whose pages are 2^page_shift words and whose
+// backend is the given one, or NULL if there is none. The entry may be unused
+// (see page_is_used() in memory.c). If group_count is not NULL, it is set to
+// the count of probed groups of the hash tables.
+//
+// The radix table entries are read without atomics, so this must not be used
+// while another thread may install a leaf table (see radix_find() of
+// memory.c).
+static inline ram_page_t* ram_core_find_page(const ram_page_table_t* pages, addr_t base_addr, unsigned page_shift,
+                                             ram_backend_t backend, addr_t* group_count)
+{
+    if (backend == RAM_BACKEND_RADIX_TABLE) {
+        const unsigned leaf_bits = ram_core_radix_leaf_bits(page_shift);
+        const addr_t page_number = base_addr >> page_shift;
+        ram_page_t* leaf = pages->radix_directory[page_number >> leaf_bits];
+        if (leaf == NULL)
+            return NULL;
+        return &leaf[page_number & (((addr_t)1 << leaf_bits) - 1)];
+    }
+
+    ram_page_t* page = ram_core_ht_find(&pages->table, base_addr, group_count);
+    if (page == NULL && pages->old_table.capacity != 0) {
+        addr_t old_group_count = 0;
+        page = ram_core_ht_find(&pages->old_table, base_addr, &old_group_count);
+        if (group_count != NULL)
+            *group_count += old_group_count;
+    }
+    return page;
+}
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // !CPULM_MEMORY_CORE_H
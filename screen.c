@@ -2,13 +2,145 @@
 // This file is part of SparseMemory which is released under the MIT license.
 // See file LICENSE.txt for full license details.
 
+// Needed for clock_gettime() when compiling with a strict C standard.
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
 #include "screen.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#define IS_POSIX 1
+#include <unistd.h>
+#else
+#define IS_POSIX 0
+#endif
+
+// The presenter thread needs POSIX threads and the GCC atomic builtins,
+// otherwise the asynchronous mode falls back to the synchronous buffered mode.
+#if IS_POSIX && (defined(__GNUC__) || defined(__clang__))
+#define HAS_PRESENTER_THREAD 1
+#include <pthread.h>
+#else
+#define HAS_PRESENTER_THREAD 0
+#endif
+
+#if HAS_PRESENTER_THREAD
+// The frame and the dirty bitmap are shared with the presenter thread. A cell
+// is stored before its dirty bit is set (with release semantics), and the
+// presenter clears the dirty bits (with acquire semantics) before loading the
+// cells, so an update is never lost: at worst, it is presented twice.
+#define STORE_CELL(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELAXED)
+#define LOAD_CELL(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define SET_DIRTY(ptr, bits) __atomic_fetch_or(ptr, bits, __ATOMIC_RELEASE)
+#define TAKE_DIRTY(ptr) __atomic_exchange_n(ptr, 0, __ATOMIC_ACQUIRE)
+// The time of the last presented frame is also written by the flush timer.
+#define STORE_TIME(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELAXED)
+#define LOAD_TIME(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#else
+#define STORE_CELL(ptr, value) (*(ptr) = (value))
+#define LOAD_CELL(ptr) (*(ptr))
+#define SET_DIRTY(ptr, bits) (*(ptr) |= (bits))
+#define TAKE_DIRTY(ptr) take_dirty(ptr)
+#define STORE_TIME(ptr, value) (*(ptr) = (value))
+#define LOAD_TIME(ptr) (*(ptr))
+#endif
 
 #define SCI "\x1b["
 
+// The maximum size, in bytes, of the output of render_character().
+#define RENDERED_CHARACTER_MAX_SIZE 48
+// The maximum size, in bytes, of a Select Graphic Rendition command (with its
+// NUL terminator).
+#define RENDERED_STYLE_MAX_SIZE 32
+
+/* In buffered mode, screen_put_character() only updates an in-memory frame and
+ * marks the updated cell as dirty. When the frame is presented, only the
+ * dirty cells that differ from the last presented frame are emitted, and all
+ * the escape sequences of the frame are written at once. */
+
+static int buffered = 0;
+static unsigned frame_interval_ms = 0;
+static uint64_t last_present_time_ms = 0;
+static word_t frame[SCREEN_SIZE];
+static word_t presented_frame[SCREEN_SIZE];
+static uint64_t dirty_cells[SCREEN_SIZE / 64];
+
+/* In asynchronous mode, the frames are presented by a dedicated thread at
+ * most max_fps times per second, so the caller is never blocked by the
+ * terminal output. Only the presenter thread writes to the terminal and
+ * touches presented_frame while it runs.
+ *
+ * The same thread is the flush timer of the buffered mode with a maximum
+ * frame interval: it presents the pending updates at the end of each
+ * interval, even if no character is put afterwards, while screen_present()
+ * still presents synchronously (both serialized by present_mutex). */
+
+// The frame rate used by screen_set_async() when max_fps is 0.
+#define DEFAULT_MAX_FPS 60
+
+#if HAS_PRESENTER_THREAD
+static int presenter_running = 0;
+// 0 if the presenter thread is only the flush timer of the buffered mode.
+static int presenter_async = 0;
+static int presenter_stop = 0; // protected by presenter_mutex
+static unsigned presenter_interval_ms = 0;
+static pthread_t presenter_thread;
+static pthread_mutex_t presenter_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t presenter_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t present_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void start_presenter(unsigned interval_ms, int async);
+#else
+static uint64_t take_dirty(uint64_t *dirty)
+{
+    const uint64_t bits = *dirty;
+    *dirty = 0;
+    return bits;
+}
+#endif // HAS_PRESENTER_THREAD
+
+// Returns a monotonic time in milliseconds.
+static uint64_t current_time_ms()
+{
+#if IS_POSIX
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+#else
+    return (uint64_t)clock() * 1000 / CLOCKS_PER_SEC;
+#endif
+}
+
+// Returns the index of the lowest set bit of x, which must not be 0.
+static addr_t lowest_set_bit(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (addr_t)__builtin_ctzll(x);
+#else
+    addr_t bit = 0;
+    while (((x >> bit) & 1) == 0)
+        bit += 1;
+    return bit;
+#endif
+}
+
+// Copies the NUL-terminated string str to it and returns the end of the
+// copied data.
+static char *append(char *it, const char *str)
+{
+    const size_t len = strlen(str);
+    memcpy(it, str, len);
+    return it + len;
+}
+
 #ifndef DISABLE_SCREEN_STYLING
 enum style_flag_t
 {
@@ -21,6 +153,15 @@ enum style_flag_t
     STYLE_CROSSED = 1 << 24,
     STYLE_OVERLINE = 1 << 25,
 };
+
+// The bits of a styled character that select its colors and style flags. Any
+// bit above the 7-bits character selects a styled rendering (with the default
+// colors if they are 0), even bit 7 and the unused bits above the flags.
+#define STYLE_MASK (~(word_t)0x7f)
+
+// The SGR cache has 2^SGR_CACHE_BITS entries.
+#define SGR_CACHE_BITS 8
+#define SGR_CACHE_SIZE (1 << SGR_CACHE_BITS)
 #endif // !DISABLE_SCREEN_STYLING
 
 /** If @a addr is inside the screen memory bounds (starting at @a
@@ -40,12 +181,38 @@ static void ding_callback(ram_t * ram, addr_t addr, word_t new_word) {
     }
 }
 
+static void vsync_callback(ram_t *_, addr_t addr, word_t new_word)
+{
+    (void)new_word;
+    if (addr == SCREEN_VSYNC_ADDR)
+        screen_present();
+}
+
 void screen_init()
 {
+    // The presenter thread (if any) reads the frames, so it is stopped while
+    // they are reset, and started again afterwards.
+#if HAS_PRESENTER_THREAD
+    const int restart_presenter = presenter_running;
+    const int async = presenter_async;
+    const unsigned interval_ms = presenter_interval_ms;
+#endif // HAS_PRESENTER_THREAD
+    screen_set_async(0, 0);
+
+    // The screen is cleared below.
+    memset(frame, 0, sizeof(frame));
+    memset(presented_frame, 0, sizeof(presented_frame));
+    memset(dirty_cells, 0, sizeof(dirty_cells));
+
     printf(SCI "?25l");  // hide cursor
     printf(SCI "2J");    // clear screen
     printf(SCI "17;1H"); // initial cursor position
     fflush(stdout);
+
+#if HAS_PRESENTER_THREAD
+    if (restart_presenter)
+        start_presenter(interval_ms, async);
+#endif // HAS_PRESENTER_THREAD
 }
 
 void screen_init_with_ram_mapping(ram_t *ram)
@@ -57,119 +224,414 @@ void screen_init_with_ram_mapping(ram_t *ram)
     ram_install_write_listener(ram, SCREEN_BASE_ADDR,
                                SCREEN_BASE_ADDR + SCREEN_SIZE - 1, &screen_ram_write);
     ram_install_write_listener(ram, 1034, 1034, &ding_callback);
+    ram_install_write_listener(ram, SCREEN_VSYNC_ADDR, SCREEN_VSYNC_ADDR, &vsync_callback);
 }
 
 void screen_terminate()
 {
+    // Also presents the pending updates.
+    screen_set_async(0, 0);
+    if (buffered)
+        screen_present();
+
     printf(SCI "?25h"); // show cursor
     fflush(stdout);
 }
 
-void screen_put_character(addr_t x, addr_t y, word_t styled_char)
+#ifndef DISABLE_SCREEN_STYLING
+// Builds in it the Select Graphic Rendition command of the given non-zero
+// style and returns the end of the written data.
+static char *build_style(char *it, word_t style)
 {
-    assert(x < SCREEN_WIDTH);
-    assert(y < SCREEN_HEIGHT);
-    // Save current cursor position
-    printf(SCI "s");
-    // Cursor indices are 1-based, thus the +1.
-    // The first argument is the row number, the second is the column number.
-    printf(SCI "%u;%uH", y + 1, x + 1);
+    word_t fg_color = ((style >> 8) & 0x1f);  // 5-bits
+    word_t bg_color = ((style >> 13) & 0x1f); // 5-bits
+
+    if (fg_color == 0) // default foreground color
+        fg_color = 39;
+    else if (fg_color <= 9) // normal colors
+        fg_color = (fg_color - 1) + 30;
+    else if (fg_color <= 16) // bright colors
+        fg_color = 90 + (fg_color - 9);
+    else
+        assert(0 && "invalid fg color");
+
+    if (bg_color == 0) // default background color
+        bg_color = 49;
+    else if (bg_color <= 9) // normal colors
+        bg_color = (bg_color - 1) + 40;
+    else if (bg_color <= 16) // bright colors
+        bg_color = 100 + (bg_color - 9);
+    else
+        assert(0 && "invalid bg color");
 
+    char style_buffer[32]; // should be large enough
+    char *style_it = style_buffer;
+    *style_it++ = ';';
+
+    // Handle all style attributes
+    if ((style & STYLE_BOLD) != 0)
+    {
+        *style_it++ = '1';
+        *style_it++ = ';';
+    }
+    if ((style & STYLE_FAINT) != 0)
+    {
+        *style_it++ = '2';
+        *style_it++ = ';';
+    }
+    if ((style & STYLE_ITALIC) != 0)
+    {
+        *style_it++ = '3';
+        *style_it++ = ';';
+    }
+    if ((style & STYLE_UNDERLINE) != 0)
+    {
+        *style_it++ = '4';
+        *style_it++ = ';';
+    }
+    if ((style & STYLE_BLINKING) != 0)
+    {
+        *style_it++ = '5'; // slow blinking, fast is not widely supported
+        *style_it++ = ';';
+    }
+    if ((style & STYLE_HIDE) != 0)
+    {
+        // No widely supported
+        *style_it++ = '8';
+        *style_it++ = ';';
+    }
+    if ((style & STYLE_CROSSED) != 0)
+    {
+        // No widely supported
+        *style_it++ = '9';
+        *style_it++ = ';';
+    }
+    if ((style & STYLE_OVERLINE) != 0)
+    {
+        // No widely supported
+        *style_it++ = '5';
+        *style_it++ = '3';
+        *style_it++ = ';';
+    }
+
+    *(--style_it) = '\0'; // sprintf expect a NUL-terminated string
+
+    // Emit the Select Graphic Rendition command to style the character.
+    return it + sprintf(it, SCI "0;%u;%u%sm", fg_color, bg_color, style_buffer);
+}
+
+/* Building the SGR command of a style is heavy, so the command of each style
+ * is built once and cached. The cache is direct-mapped and indexed by a hash
+ * of the style bits. Style 0 is never cached, thus zero-initialized entries
+ * are empty. */
+typedef struct sgr_cache_entry_t
+{
+    word_t style;
+    size_t len;
+    char sgr[RENDERED_STYLE_MAX_SIZE];
+} sgr_cache_entry_t;
+
+static sgr_cache_entry_t sgr_cache[SGR_CACHE_SIZE];
+
+// Writes into it the Select Graphic Rendition command that selects the given
+// style (the default one for 0) and returns the end of the written data.
+static char *render_style(char *it, word_t style)
+{
+    if (style == 0)
+        return append(it, SCI "0m");
+
+    sgr_cache_entry_t *entry = &sgr_cache[(word_t)(style * 2654435761u) >> (32 - SGR_CACHE_BITS)];
+    if (entry->style != style)
+    {
+        entry->len = (size_t)(build_style(entry->sgr, style) - entry->sgr);
+        entry->style = style;
+    }
+
+    memcpy(it, entry->sgr, entry->len);
+    return it + entry->len;
+}
+#endif // !DISABLE_SCREEN_STYLING
+
+// Writes into it the escape sequences and the character to display the given
+// styled_char (without moving the cursor) and returns the end of the written
+// data. At most RENDERED_CHARACTER_MAX_SIZE bytes are written. The terminal
+// is left with the default style.
+static char *render_character(char *it, word_t styled_char)
+{
     const char ch = (char)(styled_char & 0x7f); // ASCII character, 7-bits
                                                 // 1-bit which is always set to 0
 
 #ifndef DISABLE_SCREEN_STYLING
-    // Check if there is any styling, and if yes, then handle it.
-    // Because styling handling is heavy, we try to skip it if there is no style
-    // specified.
-    if (styled_char & (~0x7f))
+    const word_t style = styled_char & STYLE_MASK;
+    if (style != 0)
+        it = render_style(it, style);
+#endif // !DISABLE_SCREEN_STYLING
+
+    *it++ = ch;
+
+#ifndef DISABLE_SCREEN_STYLING
+    if (style != 0)
+        it = append(it, SCI "0m");
+#endif // !DISABLE_SCREEN_STYLING
+
+    return it;
+}
+
+// Writes into it the escape sequence to move the cursor to the x, y
+// coordinates and returns the end of the written data.
+static char *render_cursor_move(char *it, addr_t x, addr_t y)
+{
+    // Cursor indices are 1-based, thus the +1.
+    // The first argument is the row number, the second is the column number.
+    return it + sprintf(it, SCI "%u;%uH", y + 1, x + 1);
+}
+
+// Writes the given data to the standard output at once.
+static void output(const char *data, size_t data_len)
+{
+    fflush(stdout);
+#if IS_POSIX
+    while (data_len > 0)
     {
-        word_t fg_color = ((styled_char >> 8) & 0x1f);  // 5-bits
-        word_t bg_color = ((styled_char >> 13) & 0x1f); // 5-bits
-
-        if (fg_color == 0) // default foreground color
-            fg_color = 39;
-        else if (fg_color <= 9) // normal colors
-            fg_color = (fg_color - 1) + 30;
-        else if (fg_color <= 16) // bright colors
-            fg_color = 90 + (fg_color - 9);
-        else
-            assert(0 && "invalid fg color");
-
-        if (bg_color == 0) // default background color
-            bg_color = 49;
-        else if (bg_color <= 9) // normal colors
-            bg_color = (bg_color - 1) + 40;
-        else if (bg_color <= 16) // bright colors
-            bg_color = 100 + (bg_color - 9);
-        else
-            assert(0 && "invalid bg color");
-
-        char style_buffer[32]; // should be large enough
-        char *it = style_buffer;
-        *it++ = ';';
-
-        // Handle all style attributes
-        if ((styled_char & STYLE_BOLD) != 0)
-        {
-            *it++ = '1';
-            *it++ = ';';
-        }
-        if ((styled_char & STYLE_FAINT) != 0)
+        const ssize_t written = write(STDOUT_FILENO, data, data_len);
+        if (written < 0)
         {
-            *it++ = '2';
-            *it++ = ';';
+            if (errno == EINTR)
+                continue;
+            return;
         }
-        if ((styled_char & STYLE_ITALIC) != 0)
-        {
-            *it++ = '3';
-            *it++ = ';';
-        }
-        if ((styled_char & STYLE_UNDERLINE) != 0)
-        {
-            *it++ = '4';
-            *it++ = ';';
-        }
-        if ((styled_char & STYLE_BLINKING) != 0)
-        {
-            *it++ = '5'; // slow blinking, fast is not widely supported
-            *it++ = ';';
-        }
-        if ((styled_char & STYLE_HIDE) != 0)
+
+        data += written;
+        data_len -= (size_t)written;
+    }
+#else
+    fwrite(data, 1, data_len, stdout);
+    fflush(stdout);
+#endif
+}
+
+void screen_put_character(addr_t x, addr_t y, word_t styled_char)
+{
+    assert(x < SCREEN_WIDTH);
+    assert(y < SCREEN_HEIGHT);
+
+    if (buffered)
+    {
+        const addr_t offset = y * SCREEN_WIDTH + x;
+        STORE_CELL(&frame[offset], styled_char);
+        SET_DIRTY(&dirty_cells[offset / 64], (uint64_t)1 << (offset % 64));
+
+#if HAS_PRESENTER_THREAD
+        // The frames are presented by the presenter thread (if any).
+        if (presenter_running)
+            return;
+#endif // HAS_PRESENTER_THREAD
+
+        if (frame_interval_ms != 0 && current_time_ms() - LOAD_TIME(&last_present_time_ms) >= frame_interval_ms)
+            screen_present();
+        return;
+    }
+
+    char buffer[RENDERED_CHARACTER_MAX_SIZE + 32];
+    char *it = buffer;
+    // Save current cursor position
+    it = append(it, SCI "s");
+    it = render_cursor_move(it, x, y);
+    it = render_character(it, styled_char);
+    // Restore cursor position
+    it = append(it, SCI "u");
+    output(buffer, it - buffer);
+}
+
+void screen_set_buffered(int enabled, unsigned max_frame_interval_ms)
+{
+    // The presenter thread relies on the buffered mode.
+    screen_set_async(0, 0);
+
+    // Do not lose the pending updates.
+    if (buffered && !enabled)
+        screen_present();
+
+    buffered = enabled;
+    frame_interval_ms = max_frame_interval_ms;
+    STORE_TIME(&last_present_time_ms, current_time_ms());
+
+#if HAS_PRESENTER_THREAD
+    // Without a thread, screen_put_character() presents the late frames.
+    if (enabled && max_frame_interval_ms != 0)
+        start_presenter(max_frame_interval_ms, 0);
+#endif // HAS_PRESENTER_THREAD
+}
+
+// Presents the dirty cells of the frame (the caller must hold present_mutex
+// if there is a presenter thread).
+static void present_dirty_cells_unlocked()
+{
+    STORE_TIME(&last_present_time_ms, current_time_ms());
+
+    // Static, as it is a bit large for the stack.
+    static char buffer[SCREEN_SIZE * (RENDERED_CHARACTER_MAX_SIZE + 16) + 16];
+    char *it = buffer;
+
+    // Save current cursor position
+    it = append(it, SCI "s");
+    const char *frame_begin = it;
+    // Offset of the cell where the cursor is (SCREEN_SIZE if unknown), and
+    // style currently selected in the terminal.
+    addr_t cursor_offset = SCREEN_SIZE;
+#ifndef DISABLE_SCREEN_STYLING
+    word_t current_style = 0;
+#endif // !DISABLE_SCREEN_STYLING
+    for (addr_t i = 0; i < SCREEN_SIZE / 64; ++i)
+    {
+        uint64_t dirty = TAKE_DIRTY(&dirty_cells[i]);
+        while (dirty != 0)
         {
-            // No widely supported
-            *it++ = '8';
-            *it++ = ';';
+            // Iterate over the set bits, from the lowest one.
+            const addr_t bit = lowest_set_bit(dirty);
+            dirty &= dirty - 1;
+
+            // Only emit the cells that really changed since the last frame.
+            const addr_t offset = i * 64 + bit;
+            const word_t styled_char = LOAD_CELL(&frame[offset]);
+            if (styled_char == presented_frame[offset])
+                continue;
+
+            presented_frame[offset] = styled_char;
+
+            // The cursor is already there after the previous cell if it is
+            // horizontally adjacent.
+            if (offset != cursor_offset)
+                it = render_cursor_move(it, offset % SCREEN_WIDTH, offset / SCREEN_WIDTH);
+            // After the last column, the cursor does not move to the next line.
+            cursor_offset = (offset % SCREEN_WIDTH == SCREEN_WIDTH - 1) ? SCREEN_SIZE : offset + 1;
+
+#ifndef DISABLE_SCREEN_STYLING
+            // Consecutive cells of a same style share the same SGR command.
+            const word_t style = styled_char & STYLE_MASK;
+            if (style != current_style)
+            {
+                it = render_style(it, style);
+                current_style = style;
+            }
+#endif // !DISABLE_SCREEN_STYLING
+
+            *it++ = (char)(styled_char & 0x7f);
         }
-        if ((styled_char & STYLE_CROSSED) != 0)
+    }
+
+    // Nothing changed.
+    if (it == frame_begin)
+        return;
+
+#ifndef DISABLE_SCREEN_STYLING
+    // Leave the terminal with the default style.
+    if (current_style != 0)
+        it = append(it, SCI "0m");
+#endif // !DISABLE_SCREEN_STYLING
+
+    // Restore cursor position
+    it = append(it, SCI "u");
+    output(buffer, it - buffer);
+}
+
+// Presents the dirty cells of the frame.
+static void present_dirty_cells()
+{
+#if HAS_PRESENTER_THREAD
+    pthread_mutex_lock(&present_mutex);
+    present_dirty_cells_unlocked();
+    pthread_mutex_unlock(&present_mutex);
+#else
+    present_dirty_cells_unlocked();
+#endif // HAS_PRESENTER_THREAD
+}
+
+void screen_present()
+{
+#if HAS_PRESENTER_THREAD
+    // The presenter thread presents the frame at its own pace.
+    if (presenter_running && presenter_async)
+        return;
+#endif // HAS_PRESENTER_THREAD
+
+    present_dirty_cells();
+}
+
+#if HAS_PRESENTER_THREAD
+static void *presenter_main(void *_)
+{
+    pthread_mutex_lock(&presenter_mutex);
+    while (!presenter_stop)
+    {
+        pthread_mutex_unlock(&presenter_mutex);
+        present_dirty_cells();
+        pthread_mutex_lock(&presenter_mutex);
+
+        // Wait for the next frame, unless asked to stop.
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += presenter_interval_ms / 1000;
+        deadline.tv_nsec += (long)(presenter_interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
         {
-            // No widely supported
-            *it++ = '9';
-            *it++ = ';';
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
         }
-        if ((styled_char & STYLE_OVERLINE) != 0)
+
+        while (!presenter_stop)
         {
-            // No widely supported
-            *it++ = '5';
-            *it++ = '3';
-            *it++ = ';';
+            if (pthread_cond_timedwait(&presenter_cond, &presenter_mutex, &deadline) == ETIMEDOUT)
+                break;
         }
+    }
+    pthread_mutex_unlock(&presenter_mutex);
+    return NULL;
+}
 
-        *(--it) = '\0'; // printf expect a NUL-terminated string
+// Starts the presenter thread, presenting the frames every interval_ms
+// milliseconds. If the thread can not be created, presenter_running stays 0.
+static void start_presenter(unsigned interval_ms, int async)
+{
+    presenter_stop = 0;
+    presenter_interval_ms = interval_ms;
+    presenter_async = async;
+    presenter_running = (pthread_create(&presenter_thread, NULL, &presenter_main, NULL) == 0);
+}
+#endif // HAS_PRESENTER_THREAD
+
+void screen_set_async(int enabled, unsigned max_fps)
+{
+    if (max_fps == 0)
+        max_fps = DEFAULT_MAX_FPS;
+    const unsigned interval_ms = (1000 + max_fps - 1) / max_fps;
+
+#if HAS_PRESENTER_THREAD
+    if (presenter_running)
+    {
+        pthread_mutex_lock(&presenter_mutex);
+        presenter_stop = 1;
+        pthread_cond_signal(&presenter_cond);
+        pthread_mutex_unlock(&presenter_mutex);
+        pthread_join(presenter_thread, NULL);
+        presenter_running = 0;
 
-        // Emit the Select Graphic Rendition command to style the character.
-        printf(SCI "0;%u;%u%sm", fg_color, bg_color, style_buffer);
+        // Drain the updates done since the last frame of the thread.
+        present_dirty_cells();
     }
-#endif // !DISABLE_SCREEN_STYLING
 
-    putchar(ch);
-#ifndef DISABLE_SCREEN_STYLING
-    printf(SCI "0m");
-#endif // !DISABLE_SCREEN_STYLING
+    if (!enabled)
+        return;
 
-    // Restore cursor position
-    printf(SCI "u");
-    fflush(stdout);
+    screen_set_buffered(1, 0);
+    start_presenter(interval_ms, 1);
+    // Without a thread, fall back to the synchronous buffered mode.
+    if (!presenter_running)
+        screen_set_buffered(1, interval_ms);
+#else
+    if (enabled)
+        screen_set_buffered(1, interval_ms);
+#endif // HAS_PRESENTER_THREAD
 }
 
 void screen_ram_write(ram_t *_, addr_t addr, word_t new_word)
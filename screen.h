@@ -23,6 +23,9 @@ extern "C"
 
 /** The base address for RAM mapped screen. */
 #define SCREEN_BASE_ADDR 0
+/** With RAM mapped screen, writing any value at this address presents the
+ * screen (see screen_present()). */
+#define SCREEN_VSYNC_ADDR 1035
 
     /** Initializes the screen. */
     void screen_init();
@@ -37,6 +40,39 @@ extern "C"
      * The format of @a styled_char is specified in the CPUlm assembler
      * documentation. */
     void screen_put_character(addr_t x, addr_t y, word_t styled_char);
+    /** Enables or disables (depending on @a enabled) the buffered mode.
+     *
+     * In buffered mode, screen_put_character() does not print anything, it
+     * only updates an in-memory frame. The frame is presented, with all its
+     * changes since the previous frame written at once, by screen_present(),
+     * by a RAM write to SCREEN_VSYNC_ADDR (with RAM mapped screen) or by
+     * screen_terminate(). If @a max_frame_interval_ms is not 0, the updates
+     * are also automatically presented at most @a max_frame_interval_ms
+     * milliseconds later, even if no other character is put: by a timer
+     * thread where threads are supported, otherwise by the next
+     * screen_put_character() once the last frame was presented at least
+     * @a max_frame_interval_ms milliseconds ago.
+     *
+     * By default, the buffered mode is disabled, so each call to
+     * screen_put_character() directly prints the character. */
+    void screen_set_buffered(int enabled, unsigned max_frame_interval_ms);
+    /** Presents the current frame (only useful in buffered mode). In
+     * asynchronous mode, this does nothing as the frames are presented by the
+     * presenter thread. */
+    void screen_present();
+    /** Enables or disables (depending on @a enabled) the asynchronous mode.
+     *
+     * The asynchronous mode is the buffered mode (see screen_set_buffered())
+     * where the frames are presented by a dedicated thread, at most
+     * @a max_fps times per second (60 if 0), so screen_put_character() never
+     * blocks on the terminal output. Disabling it, or calling
+     * screen_terminate(), presents the pending updates and joins the thread;
+     * the screen then stays in buffered mode.
+     *
+     * Where threads are not supported, the frames are presented
+     * synchronously by screen_put_character() at most @a max_fps times per
+     * second instead. */
+    void screen_set_async(int enabled, unsigned max_fps);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,212 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+#include <gtest/gtest.h>
+
+#include "memory.hpp"
+
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+TEST(RamCppTest, get_set) {
+  sparse::Ram<> ram;
+  ASSERT_NE(ram.handle(), nullptr);
+  EXPECT_EQ(ram_page_size(ram.handle()), decltype(ram)::page_size);
+
+  EXPECT_EQ(ram.get(4523), 0);
+  ram.set(4523, 563);
+  EXPECT_EQ(ram.get(4523), 563);
+
+  // Now the page is cached and the accesses are inlined.
+  ram.set(4524, 564);
+  EXPECT_EQ(ram.get(4524), 564);
+  EXPECT_EQ(ram.get_set(4524, 565), 564);
+  EXPECT_EQ(ram.get(4524), 565);
+  EXPECT_EQ(ram_get(ram.handle(), 4524), 565);
+
+  ram.set(0xffffffff, 84852);
+  EXPECT_EQ(ram.get(0xffffffff), 84852);
+  EXPECT_EQ(ram.get(4523), 563);
+}
+
+TEST(RamCppTest, config) {
+  // Small pages in a radix table, with the other settings of the config.
+  ram_config_t config = ram_default_config();
+  config.compressed_pages = 1;
+  sparse::Ram<4, RAM_BACKEND_RADIX_TABLE> ram(config);
+  EXPECT_EQ(ram_page_size(ram.handle()), 16);
+
+  for (addr_t i = 0; i < 1000; ++i) {
+    ram.set(i * 7, i);
+  }
+  for (addr_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(ram.get(i * 7), i);
+    ASSERT_EQ(ram.get(i * 7 + 1), 0);
+  }
+}
+
+// More pages than the page caches hold, so that most accesses miss them and
+// use the direct accesses to the page table.
+template <ram_backend_t Backend> static void test_direct_accesses() {
+  constexpr addr_t page_count = 8 * RAM_PAGE_CACHE_SIZE;
+  sparse::Ram<4, Backend> ram;
+  for (addr_t i = 0; i < page_count; ++i) {
+    ram.set(i * 16, i);
+  }
+  for (int pass = 0; pass < 2; ++pass) {
+    for (addr_t i = 0; i < page_count; ++i) {
+      ASSERT_EQ(ram.get(i * 16), i);
+      ASSERT_EQ(ram.get(i * 16 + 1), 0);
+      ASSERT_EQ(ram.get(0x80000000 + i * 16), 0); // missing page
+      ram.set(i * 16 + 1, i + 1);
+      ASSERT_EQ(ram.get_set(i * 16 + 2, i + 2), 0);
+      ASSERT_EQ(ram_get(ram.handle(), i * 16 + 1), i + 1);
+      ram.set(i * 16 + 1, 0);
+      ram.set(i * 16 + 2, 0);
+    }
+  }
+
+  // The pages shared with a snapshot or a clone are copied by memory.c.
+  ram_snapshot_t *snapshot = ram_snapshot(ram.handle());
+  sparse::Ram<4, Backend> clone = ram.clone();
+  for (addr_t i = 0; i < page_count; ++i) {
+    ram.set(i * 16, i + 1000);
+  }
+  for (addr_t i = 0; i < page_count; ++i) {
+    ASSERT_EQ(ram.get(i * 16), i + 1000);
+    ASSERT_EQ(clone.get(i * 16), i);
+  }
+  ram_restore(ram.handle(), snapshot);
+  ram_snapshot_destroy(snapshot);
+  for (addr_t i = 0; i < page_count; ++i) {
+    ASSERT_EQ(ram.get(i * 16), i);
+  }
+
+  // The writes after ram_clear_dirty() still make the pages dirty.
+  ram_clear_dirty(ram.handle());
+  for (addr_t i = 0; i < page_count; i += 2) {
+    ram.set(i * 16 + 3, 1);
+  }
+  ram_page_iterator_t it;
+  addr_t dirty_pages = 0;
+  for (int valid = ram_dirty_pages_begin(ram.handle(), &it); valid;
+       valid = ram_dirty_pages_next(&it)) {
+    EXPECT_EQ(it.base_addr % 32, 0);
+    EXPECT_EQ(it.data[3], 1);
+    ++dirty_pages;
+  }
+  EXPECT_EQ(dirty_pages, page_count / 2);
+}
+
+TEST(RamCppTest, direct_accesses) {
+  test_direct_accesses<RAM_BACKEND_HASH_TABLE>();
+  test_direct_accesses<RAM_BACKEND_RADIX_TABLE>();
+}
+
+TEST(RamCppTest, direct_accesses_compressed) {
+  ram_config_t config = ram_default_config();
+  config.compressed_pages = 1;
+  sparse::Ram<4> ram(config);
+  constexpr addr_t page_count = 8 * RAM_PAGE_CACHE_SIZE;
+  for (addr_t i = 0; i < page_count; ++i) {
+    ram.set(i * 16, i); // compressed pages
+  }
+  for (addr_t i = 0; i < page_count; ++i) {
+    for (addr_t j = 0; j < 16; ++j) {
+      ram.set(i * 16 + j, i + j); // promoted to dense pages
+    }
+  }
+  ram_compact(ram.handle());
+  for (addr_t i = 0; i < page_count; ++i) {
+    ram.set(i * 16 + 1, 7);
+    ASSERT_EQ(ram.get(i * 16), i);
+    ASSERT_EQ(ram.get(i * 16 + 1), 7);
+    ASSERT_EQ(ram_get(ram.handle(), i * 16 + 15), i + 15);
+  }
+}
+
+TEST(RamCppTest, create_failure) {
+  ram_config_t config = ram_default_config();
+  config.max_resident_pages = 4;
+  config.swap_file = "/nonexistent-directory/ram.swap";
+  EXPECT_THROW(sparse::Ram<> ram(config), std::runtime_error);
+}
+
+TEST(RamCppTest, listeners) {
+  std::vector<addr_t> reads;
+  std::vector<std::pair<addr_t, word_t>> writes;
+  auto listeners = sparse::make_listeners(
+      [&](addr_t addr) { reads.push_back(addr); },
+      [&](addr_t addr, word_t value) { writes.emplace_back(addr, value); });
+  sparse::Ram<10, RAM_DEFAULT_BACKEND, decltype(listeners)> ram(listeners);
+
+  ram.set(10, 1);
+  ram.set(10, 2); // cached
+  EXPECT_EQ(ram.get(10), 2);
+  EXPECT_EQ(ram.get(11), 0);
+  EXPECT_EQ(ram.get_set(10, 3), 2);
+  EXPECT_EQ(reads, (std::vector<addr_t>{10, 11, 10}));
+  EXPECT_EQ(writes, (std::vector<std::pair<addr_t, word_t>>{
+                        {10, 1}, {10, 2}, {10, 3}}));
+
+  // The accesses done through the handle are not reported.
+  ram_set(ram.handle(), 10, 4);
+  EXPECT_EQ(writes.size(), 3);
+}
+
+#ifndef RAM_NO_WRITE_LISTENER
+static int cpp_write_listener_calls = 0;
+
+TEST(RamCppTest, c_listener) {
+  sparse::Ram<> ram;
+  ram.set(67, 1);
+
+  // The listeners of memory.h are called by the slow path.
+  ram_install_write_listener(ram.handle(), 60, 70, [](ram_t *, addr_t addr,
+                                                      word_t value) {
+    EXPECT_EQ(addr, 67);
+    EXPECT_EQ(value, 2);
+    ++cpp_write_listener_calls;
+  });
+  cpp_write_listener_calls = 0;
+  ram.set(67, 2);
+  ram.set(1000, 2);
+  EXPECT_EQ(cpp_write_listener_calls, 1);
+
+  // Nor by the page cache misses, which go through memory.c.
+  for (addr_t i = 1; i <= RAM_PAGE_CACHE_SIZE; ++i) {
+    ram.set(i * decltype(ram)::page_size, 1);
+  }
+  ram.set(67, 2);
+  EXPECT_EQ(cpp_write_listener_calls, 2);
+}
+#endif // !RAM_NO_WRITE_LISTENER
+
+TEST(RamCppTest, move) {
+  static_assert(!std::is_copy_constructible<sparse::Ram<>>::value,
+                "a Ram owns its RAM block");
+
+  sparse::Ram<> ram;
+  ram.set(5, 42);
+  ram_t *handle = ram.handle();
+
+  sparse::Ram<> moved(std::move(ram));
+  EXPECT_EQ(ram.handle(), nullptr);
+  EXPECT_EQ(moved.handle(), handle);
+  EXPECT_EQ(moved.get(5), 42);
+
+  sparse::Ram<> other;
+  other.set(5, 1);
+  other = std::move(moved);
+  EXPECT_EQ(other.handle(), handle);
+  EXPECT_EQ(other.get(5), 42);
+
+  // The clone shares the pages copy-on-write.
+  sparse::Ram<> clone = other.clone();
+  clone.set(5, 43);
+  EXPECT_EQ(clone.get(5), 43);
+  EXPECT_EQ(other.get(5), 42);
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+#include <gtest/gtest.h>
+
+#define RAM_INLINE_FAST_PATH
+#include "memory.h"
+
+TEST(RamInlineTest, get_set) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  // The first accesses miss the page caches and go through memory.c.
+  EXPECT_EQ(ram_get(ram, 4523), 0);
+  ram_set(ram, 4523, 563);
+  EXPECT_EQ(ram_get(ram, 4523), 563);
+
+  // Now the page is cached and the accesses are inlined.
+  ram_set(ram, 4524, 564);
+  EXPECT_EQ(ram_get(ram, 4524), 564);
+  EXPECT_EQ(ram_get_set(ram, 4524, 565), 564);
+  EXPECT_EQ(ram_get(ram, 4524), 565);
+
+  ram_set(ram, 1147483647, 84852);
+  EXPECT_EQ(ram_get(ram, 1147483647), 84852);
+  EXPECT_EQ(ram_get(ram, 4523), 563);
+
+  ram_destroy(ram);
+}
+
+#ifndef RAM_NO_WRITE_LISTENER
+static int inline_write_listener_calls = 0;
+
+TEST(RamInlineTest, write_listener) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  // Put the page in the cache before installing the listener.
+  ram_set(ram, 67, 1);
+
+  ram_install_write_listener(ram, 50, 100,
+                             [](auto, auto, auto) { inline_write_listener_calls += 1; });
+
+  inline_write_listener_calls = 0;
+  ram_set(ram, 67, 146);
+  EXPECT_EQ(inline_write_listener_calls, 1);
+  EXPECT_EQ(ram_get_set(ram, 67, 147), 146);
+  EXPECT_EQ(inline_write_listener_calls, 2);
+  EXPECT_EQ(ram_get(ram, 67), 147);
+
+  ram_destroy(ram);
+}
+#endif // !RAM_NO_WRITE_LISTENER
@@ -4,6 +4,12 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "memory.h"
 
 TEST(RamTest, ram_create) {
@@ -31,6 +37,38 @@ TEST(RamTest, ram_init) {
   ram_destroy(ram);
 }
 
+TEST(RamTest, ram_from_file) {
+  // A few memory pages and a partial one.
+  std::vector<word_t> data(10000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (word_t)(i * 3 + 1);
+  }
+
+  const std::string filename = testing::TempDir() + "ram_from_file.ram";
+  FILE *file = fopen(filename.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  fwrite(data.data(), sizeof(word_t), data.size(), file);
+  fclose(file);
+
+  ram_t *ram = ram_from_file(filename.c_str());
+  ASSERT_NE(ram, nullptr);
+  for (size_t i = 0; i < data.size(); ++i) {
+    EXPECT_EQ(ram_get(ram, i), data[i]);
+  }
+  EXPECT_EQ(ram_get(ram, 10000), 0);
+
+  // Writes are not visible to the file nor to other RAM blocks.
+  ram_set(ram, 5, 42);
+  EXPECT_EQ(ram_get(ram, 5), 42);
+  EXPECT_EQ(ram_get(ram, 6), data[6]);
+  ram_t *other_ram = ram_from_file(filename.c_str());
+  EXPECT_EQ(ram_get(other_ram, 5), data[5]);
+  ram_destroy(other_ram);
+  ram_destroy(ram);
+
+  std::remove(filename.c_str());
+}
+
 TEST(RamTest, low_address) {
   ram_t *ram = ram_create();
   ASSERT_NE(ram, nullptr);
@@ -72,11 +110,1111 @@ TEST(RamTest, many_access) {
   ram_destroy(ram);
 }
 
+TEST(RamTest, read_untouched_memory) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  // Untouched memory reads as zero.
+  for (addr_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(ram_get(ram, i * 1000003), 0);
+  }
+
+  // Writing to a page previously read is visible to the next reads.
+  ram_set(ram, 1000003, 15);
+  EXPECT_EQ(ram_get(ram, 1000003), 15);
+  EXPECT_EQ(ram_get(ram, 1000004), 0);
+  EXPECT_EQ(ram_get_set(ram, 2000006, 16), 0);
+  EXPECT_EQ(ram_get(ram, 2000006), 16);
+
+  // Other missing pages still read as zero.
+  EXPECT_EQ(ram_get(ram, 3000009), 0);
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, page_cache_across_resize) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  // Keep a page hot in the page cache.
+  ram_set(ram, 100, 42);
+  EXPECT_EQ(ram_get(ram, 100), 42);
+
+  // Create enough memory pages to resize the hash table several times. The
+  // stride is not a multiple of the page cache size so entries get evicted.
+  for (addr_t i = 0; i < 1000; ++i) {
+    ram_set(ram, i * 12345 + 7, i);
+    EXPECT_EQ(ram_get(ram, 100), 42);
+  }
+
+  ram_set(ram, 100, 43);
+  EXPECT_EQ(ram_get(ram, 100), 43);
+  for (addr_t i = 0; i < 1000; ++i) {
+    EXPECT_EQ(ram_get(ram, i * 12345 + 7), i);
+  }
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, radix_backend) {
+  ram_t *ram = ram_create_with_backend(RAM_BACKEND_RADIX_TABLE);
+  ASSERT_NE(ram, nullptr);
+
+  const word_t data[] = { 1, 2, 3, 4 };
+  ram_init(ram, data, 4);
+  EXPECT_EQ(ram_get(ram, 3), 4);
+
+  ram_set(ram, 0xffffffff, 84852);
+  EXPECT_EQ(ram_get(ram, 0xffffffff), 84852);
+  EXPECT_EQ(ram_get(ram, 0xfffffffe), 0);
+
+  for (addr_t i = 52; i < 47483647; i += 1284852) {
+    ram_set(ram, i, i);
+  }
+  for (addr_t i = 52; i < 47483647; i += 1284852) {
+    EXPECT_EQ(ram_get(ram, i), i);
+  }
+  EXPECT_EQ(ram_get_set(ram, 52, 0), 52);
+  EXPECT_EQ(ram_get(ram, 52), 0);
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, create_ex) {
+  for (addr_t page_size : {2u, 64u, 1u << 16}) {
+    for (ram_backend_t backend :
+         {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}) {
+      ram_config_t config = ram_default_config();
+      config.backend = backend;
+      config.page_size = page_size;
+      config.initial_bucket_count = 2;
+      config.huge_pages = RAM_HUGE_PAGES_HUGETLB;
+      ram_t *ram = ram_create_ex(&config);
+      ASSERT_NE(ram, nullptr);
+
+      for (addr_t i = 52; i < 47483647; i += 128485) {
+        ram_set(ram, i, i);
+      }
+      ram_set(ram, 0xffffffff, 1);
+      for (addr_t i = 52; i < 47483647; i += 128485) {
+        EXPECT_EQ(ram_get(ram, i), i);
+        EXPECT_EQ(ram_get(ram, i + 1), 0);
+      }
+      EXPECT_EQ(ram_get(ram, 0xffffffff), 1);
+
+      // Clones have the same page size.
+      ram_t *clone = ram_clone(ram);
+      ram_set(clone, 52, 0);
+      EXPECT_EQ(ram_get(clone, 52 + 128485), 52 + 128485);
+      EXPECT_EQ(ram_get(ram, 52), 52);
+      ram_destroy(clone);
+
+      ram_destroy(ram);
+    }
+  }
+
+  // The invalid configurations are rejected.
+  for (addr_t page_size : {1u, 3u, 1000u, 0x80000001u}) {
+    ram_config_t config = ram_default_config();
+    config.page_size = page_size;
+    EXPECT_EQ(ram_create_ex(&config), nullptr) << "page size " << page_size;
+  }
+  for (addr_t bucket_count : {1u, 24u}) {
+    ram_config_t config = ram_default_config();
+    config.initial_bucket_count = bucket_count;
+    EXPECT_EQ(ram_create_ex(&config), nullptr)
+        << "bucket count " << bucket_count;
+  }
+}
+
+TEST(RamTest, atomic_operations) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  EXPECT_EQ(ram_atomic_fetch_add(ram, 10, 5), 0);
+  EXPECT_EQ(ram_atomic_fetch_add(ram, 10, 0xffffffff), 5);
+  EXPECT_EQ(ram_get(ram, 10), 4);
+
+  EXPECT_EQ(ram_atomic_cas(ram, 10, 3, 7), 4);
+  EXPECT_EQ(ram_get(ram, 10), 4);
+  EXPECT_EQ(ram_atomic_cas(ram, 10, 4, 7), 4);
+  EXPECT_EQ(ram_get(ram, 10), 7);
+
+  // Failed comparisons do not create the pages, on the fast path neither.
+  EXPECT_EQ(ram_atomic_cas(ram, 0x10000000, 1, 2), 0);
+  EXPECT_EQ(ram_get_stats(ram).page_count, 1);
+  EXPECT_EQ(ram_atomic_cas(ram, 11, 1, 2), 0);
+  EXPECT_EQ(ram_atomic_cas(ram, 11, 0, 2), 0);
+  EXPECT_EQ(ram_atomic_cas(ram, 11, 0, 3), 2);
+  EXPECT_EQ(ram_atomic_fetch_add(ram, 11, 3), 2);
+  EXPECT_EQ(ram_get(ram, 11), 5);
+  EXPECT_EQ(ram_atomic_cas(ram, 0x10000000, 0, 2), 0);
+  EXPECT_EQ(ram_get(ram, 0x10000000), 2);
+  EXPECT_EQ(ram_get_stats(ram).page_count, 2);
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, concurrent) {
+  ram_config_t config = ram_default_config();
+  config.concurrent = 1;
+  ram_t *ram = ram_create_ex(&config);
+  ASSERT_NE(ram, nullptr);
+
+  // Shared by all the threads, so some of them are copied on write.
+  ram_set(ram, 100, 1);
+  ram_snapshot_t *snapshot = ram_snapshot(ram);
+
+  constexpr int THREAD_COUNT = 4;
+  constexpr addr_t WORDS_PER_THREAD = 100000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREAD_COUNT; ++t) {
+    threads.emplace_back([ram, t] {
+      // The threads write interleaved words, so they race to create and copy
+      // the same pages.
+      for (addr_t i = 0; i < WORDS_PER_THREAD; ++i) {
+        ram_set(ram, i * THREAD_COUNT + t, i);
+        ram_atomic_fetch_add(ram, 0x80000000, 1);
+      }
+      word_t expected = ram_get(ram, 0x90000000);
+      while (true) {
+        const word_t old = ram_atomic_cas(ram, 0x90000000, expected,
+                                          expected + 2);
+        if (old == expected)
+          break;
+        expected = old;
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(ram_get(ram, 0x80000000), THREAD_COUNT * WORDS_PER_THREAD);
+  EXPECT_EQ(ram_get(ram, 0x90000000), THREAD_COUNT * 2);
+  for (int t = 0; t < THREAD_COUNT; ++t) {
+    for (addr_t i = 0; i < WORDS_PER_THREAD; ++i) {
+      ASSERT_EQ(ram_get(ram, i * THREAD_COUNT + t), i);
+    }
+  }
+
+  ram_restore(ram, snapshot);
+  ram_snapshot_destroy(snapshot);
+  EXPECT_EQ(ram_get(ram, 100), 1);
+  EXPECT_EQ(ram_get(ram, 101), 0);
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, concurrent_copy_on_write) {
+  ram_config_t config = ram_default_config();
+  config.concurrent = 1;
+  ram_t *ram = ram_create_ex(&config);
+  ASSERT_NE(ram, nullptr);
+  const addr_t page_size = ram_page_size(ram);
+
+  // All the threads write to the same page just after it is shared, so they
+  // race to copy it. The snapshot must keep the previous content.
+  constexpr int THREAD_COUNT = 4;
+  for (word_t round = 1; round <= 200; ++round) {
+    for (addr_t i = 0; i < page_size; ++i) {
+      ram_set(ram, i, round);
+    }
+    ram_snapshot_t *snapshot = ram_snapshot(ram);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+      threads.emplace_back([ram, t, page_size, round] {
+        for (addr_t i = t; i < page_size; i += THREAD_COUNT) {
+          ram_set(ram, i, round + 1000);
+        }
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+
+    ram_t *saved = ram_create();
+    ASSERT_NE(saved, nullptr);
+    ram_restore(saved, snapshot);
+    ram_snapshot_destroy(snapshot);
+    for (addr_t i = 0; i < page_size; ++i) {
+      ASSERT_EQ(ram_get(saved, i), round);
+      ASSERT_EQ(ram_get(ram, i), round + 1000);
+    }
+    ram_destroy(saved);
+  }
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, block_access) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  // Spans several memory pages, starting in the middle of one.
+  std::vector<word_t> src(10000);
+  for (size_t i = 0; i < src.size(); ++i) {
+    src[i] = (word_t)(i * 7 + 1);
+  }
+  ram_write_block(ram, 1000, src.data(), src.size());
+
+  EXPECT_EQ(ram_get(ram, 999), 0);
+  EXPECT_EQ(ram_get(ram, 1000), 1);
+  EXPECT_EQ(ram_get(ram, 1000 + 9999), 9999 * 7 + 1);
+  EXPECT_EQ(ram_get(ram, 1000 + 10000), 0);
+
+  std::vector<word_t> dst(10002, 0xdead);
+  ram_read_block(ram, 999, dst.data(), dst.size());
+  EXPECT_EQ(dst[0], 0);
+  for (size_t i = 0; i < src.size(); ++i) {
+    EXPECT_EQ(dst[i + 1], src[i]);
+  }
+  EXPECT_EQ(dst[10001], 0);
+
+  // Blocks may end at the last address.
+  const word_t last[] = { 5, 6 };
+  ram_write_block(ram, 0xfffffffe, last, 2);
+  word_t last_read[2] = {};
+  ram_read_block(ram, 0xfffffffe, last_read, 2);
+  EXPECT_EQ(last_read[0], 5);
+  EXPECT_EQ(last_read[1], 6);
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, save_load) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  // Far apart addresses, and a written page that is all zeros again.
+  ram_set(ram, 5, 1);
+  ram_set(ram, 1147483647, 84852);
+  ram_set(ram, 0xffffffff, 3);
+  ram_set(ram, 0x10000, 4);
+  ram_set(ram, 0x10000, 0);
+
+  const std::string filename = testing::TempDir() + "save_load.ram";
+  ASSERT_EQ(ram_save(ram, filename.c_str()), 0);
+  ram_destroy(ram);
+
+  // Only the three non-zero pages are stored.
+  FILE *file = fopen(filename.c_str(), "rb");
+  ASSERT_NE(file, nullptr);
+  fseek(file, 0, SEEK_END);
+  EXPECT_LE(ftell(file), 4 * 64 * 1024);
+  fclose(file);
+
+  ram = ram_load(filename.c_str());
+  ASSERT_NE(ram, nullptr);
+  EXPECT_EQ(ram_get(ram, 5), 1);
+  EXPECT_EQ(ram_get(ram, 4), 0);
+  EXPECT_EQ(ram_get(ram, 1147483647), 84852);
+  EXPECT_EQ(ram_get(ram, 0xffffffff), 3);
+  EXPECT_EQ(ram_get(ram, 0x10000), 0);
+
+  // Writes are not visible to the file.
+  ram_set(ram, 5, 2);
+  ram_t *other_ram = ram_load(filename.c_str());
+  EXPECT_EQ(ram_get(other_ram, 5), 1);
+  ram_destroy(other_ram);
+  ram_destroy(ram);
+
+  std::remove(filename.c_str());
+}
+
+TEST(RamTest, snapshot_restore) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  for (addr_t i = 0; i < 10000; ++i) {
+    ram_set(ram, i * 97, i);
+  }
+  ram_snapshot_t *snapshot = ram_snapshot(ram);
+  ASSERT_NE(snapshot, nullptr);
+
+  // Writes after the snapshot, to existing and new pages.
+  for (addr_t i = 0; i < 10000; ++i) {
+    ram_set(ram, i * 97, i + 1);
+  }
+  ram_set(ram, 0xfffffff0, 42);
+  EXPECT_EQ(ram_get(ram, 97), 2);
+
+  ram_restore(ram, snapshot);
+  for (addr_t i = 0; i < 10000; ++i) {
+    EXPECT_EQ(ram_get(ram, i * 97), i);
+  }
+  EXPECT_EQ(ram_get(ram, 0xfffffff0), 0);
+
+  // The snapshot is not modified by the writes after a restore.
+  ram_set(ram, 97, 0);
+  ram_restore(ram, snapshot);
+  EXPECT_EQ(ram_get(ram, 97), 1);
+
+  ram_snapshot_destroy(snapshot);
+  EXPECT_EQ(ram_get(ram, 97), 1);
+  ram_destroy(ram);
+}
+
+TEST(RamTest, clone) {
+  for (ram_backend_t backend :
+       {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}) {
+    ram_t *ram = ram_create_with_backend(backend);
+    ASSERT_NE(ram, nullptr);
+    for (addr_t i = 0; i < 5000; ++i) {
+      ram_set(ram, i * 3, i);
+    }
+
+    ram_t *clone = ram_clone(ram);
+    ASSERT_NE(clone, nullptr);
+    for (addr_t i = 0; i < 5000; ++i) {
+      EXPECT_EQ(ram_get(clone, i * 3), i);
+    }
+
+    // Both RAM blocks are independent.
+    ram_set(clone, 3, 42);
+    ram_set(ram, 6, 43);
+    EXPECT_EQ(ram_get(ram, 3), 1);
+    EXPECT_EQ(ram_get(clone, 3), 42);
+    EXPECT_EQ(ram_get(ram, 6), 43);
+    EXPECT_EQ(ram_get(clone, 6), 2);
+
+    // A snapshot of the clone can be restored into the original.
+    ram_snapshot_t *snapshot = ram_snapshot(clone);
+    ram_destroy(clone);
+    ram_restore(ram, snapshot);
+    ram_snapshot_destroy(snapshot);
+    EXPECT_EQ(ram_get(ram, 3), 42);
+    EXPECT_EQ(ram_get(ram, 6), 2);
+    EXPECT_EQ(ram_get(ram, 4999 * 3), 4999);
+
+    ram_destroy(ram);
+  }
+}
+
+TEST(RamTest, snapshot_of_file) {
+  std::vector<word_t> data(5000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (word_t)(i * 5 + 2);
+  }
+
+  const std::string filename = testing::TempDir() + "snapshot_of_file.ram";
+  FILE *file = fopen(filename.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  fwrite(data.data(), sizeof(word_t), data.size(), file);
+  fclose(file);
+
+  // The snapshot keeps the file-backed pages alive after the RAM block is
+  // destroyed, and may be restored into an unrelated RAM block.
+  ram_t *ram = ram_from_file(filename.c_str());
+  ram_snapshot_t *snapshot = ram_snapshot(ram);
+  ram_destroy(ram);
+
+  ram_t *other_ram = ram_create();
+  ram_set(other_ram, 100000, 1);
+  ram_restore(other_ram, snapshot);
+  ram_snapshot_destroy(snapshot);
+  for (size_t i = 0; i < data.size(); ++i) {
+    EXPECT_EQ(ram_get(other_ram, i), data[i]);
+  }
+  EXPECT_EQ(ram_get(other_ram, 100000), 0);
+  ram_destroy(other_ram);
+
+  std::remove(filename.c_str());
+}
+
 #ifndef RAM_NO_READ_LISTENER
 bool read_listener_1_was_called = false;
 bool read_listener_2_was_called = false;
 bool read_listener_3_was_called = false;
 
+TEST(RamTest, fill) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+  const addr_t page_size = ram_page_size(ram);
+
+  ram_fill(ram, 5, 42, 3 * page_size);
+  EXPECT_EQ(ram_get(ram, 4), 0);
+  EXPECT_EQ(ram_get(ram, 5), 42);
+  EXPECT_EQ(ram_get(ram, 2 * page_size), 42);
+  EXPECT_EQ(ram_get(ram, 3 * page_size + 4), 42);
+  EXPECT_EQ(ram_get(ram, 3 * page_size + 5), 0);
+  EXPECT_EQ(ram_get_stats(ram).page_count, 4);
+
+  // Filling with zeros does not create the missing pages.
+  ram_fill(ram, 0, 0, 16 * page_size);
+  EXPECT_EQ(ram_get(ram, 5), 0);
+  EXPECT_EQ(ram_get(ram, 3 * page_size + 4), 0);
+  EXPECT_EQ(ram_get_stats(ram).page_count, 4);
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, compare) {
+  ram_config_t config = ram_default_config();
+  config.page_size = 64;
+  ram_t *ram_a = ram_create_ex(&config);
+  config.page_size = 1024;
+  config.backend = RAM_BACKEND_RADIX_TABLE;
+  ram_t *ram_b = ram_create_ex(&config);
+  ASSERT_NE(ram_a, nullptr);
+  ASSERT_NE(ram_b, nullptr);
+
+  // Missing pages compare equal, even to pages of zeros.
+  EXPECT_EQ(ram_compare(ram_a, ram_b, 0, 0xffffffff), 0);
+  ram_fill(ram_a, 1000, 0, 100);
+  ram_set(ram_b, 2000, 0);
+  EXPECT_EQ(ram_compare(ram_a, ram_b, 0, 1 << 20), 0);
+
+  for (addr_t i = 0; i < 5000; ++i) {
+    ram_set(ram_a, 0x10000 + i * 7, i);
+    ram_set(ram_b, 0x10000 + i * 7, i);
+  }
+  EXPECT_EQ(ram_compare(ram_a, ram_b, 0, 0xffffffff), 0);
+
+  ram_set(ram_b, 0x10000 + 4000 * 7 + 1, 1);
+  EXPECT_LT(ram_compare(ram_a, ram_b, 0, 0xffffffff), 0);
+  EXPECT_GT(ram_compare(ram_b, ram_a, 0x10000, 1 << 20), 0);
+  EXPECT_EQ(ram_compare(ram_a, ram_b, 0, 0x10000 + 4000 * 7 + 1), 0);
+
+  // Shared pages are equal.
+  ram_t *clone = ram_clone(ram_b);
+  EXPECT_EQ(ram_compare(clone, ram_b, 0, 0xffffffff), 0);
+  ram_set(clone, 0xfffffffe, 1);
+  EXPECT_GT(ram_compare(clone, ram_b, 0, 0xffffffff), 0);
+
+  ram_destroy(clone);
+  ram_destroy(ram_a);
+  ram_destroy(ram_b);
+}
+
+TEST(RamTest, find_word) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+  const addr_t page_size = ram_page_size(ram);
+
+  ram_fill(ram, 100, 1, 10 * page_size);
+  ram_set(ram, 100 + 5 * page_size + 3, 42);
+  EXPECT_EQ(ram_find_word(ram, 100, 10 * page_size, 42), 5 * page_size + 3);
+  EXPECT_EQ(ram_find_word(ram, 100, 5 * page_size + 3, 42),
+            5 * page_size + 3);
+  EXPECT_EQ(ram_find_word(ram, 0, 0xffffffff, 43), 0xffffffff);
+
+  // Missing pages only contain zeros.
+  EXPECT_EQ(ram_find_word(ram, 100, 10 * page_size, 0), 10 * page_size);
+  EXPECT_EQ(ram_find_word(ram, 0x80000000, 1 << 20, 0), 0);
+  EXPECT_EQ(ram_get_stats(ram).page_count, 11);
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, gather_scatter) {
+  for (ram_backend_t backend :
+       {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}) {
+    ram_t *ram = ram_create_with_backend(backend);
+    ASSERT_NE(ram, nullptr);
+
+    // Many pages, some addresses repeated (the last write wins).
+    std::vector<addr_t> addrs;
+    std::vector<word_t> values;
+    std::vector<word_t> expected(300);
+    for (addr_t i = 0; i < 1000; ++i) {
+      addrs.push_back((i % 300) * 40503);
+      values.push_back(i);
+      expected[i % 300] = i;
+    }
+    ram_scatter(ram, addrs.data(), values.data(), addrs.size());
+    for (addr_t i = 0; i < 300; ++i) {
+      EXPECT_EQ(ram_get(ram, i * 40503), expected[i]);
+    }
+
+    // Including missing pages.
+    addrs.push_back(0xfffffff0);
+    std::vector<word_t> out(addrs.size(), 1);
+    ram_gather(ram, addrs.data(), out.data(), addrs.size());
+    for (size_t i = 0; i < 1000; ++i) {
+      EXPECT_EQ(out[i], expected[i % 300]);
+    }
+    EXPECT_EQ(out[1000], 0);
+
+    ram_destroy(ram);
+  }
+}
+
+TEST(RamTest, discard) {
+  for (ram_backend_t backend :
+       {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}) {
+    ram_t *ram = ram_create_with_backend(backend);
+    ASSERT_NE(ram, nullptr);
+    const addr_t page_size = ram_page_size(ram);
+
+    // The pages partly in the range are only zeroed.
+    ram_fill(ram, 0, 1, 8 * page_size);
+    ram_discard(ram, page_size / 2, 5 * page_size);
+    EXPECT_EQ(ram_get_stats(ram).page_count, 4);
+    EXPECT_EQ(ram_get(ram, page_size / 2 - 1), 1);
+    EXPECT_EQ(ram_get(ram, page_size / 2), 0);
+    EXPECT_EQ(ram_get(ram, 3 * page_size), 0);
+    EXPECT_EQ(ram_get(ram, 5 * page_size + page_size / 2 - 1), 0);
+    EXPECT_EQ(ram_get(ram, 5 * page_size + page_size / 2), 1);
+
+    // A discarded page is created again on its next write.
+    ram_set(ram, 2 * page_size + 1, 5);
+    EXPECT_EQ(ram_get(ram, 2 * page_size + 1), 5);
+    EXPECT_EQ(ram_get(ram, 2 * page_size), 0);
+    EXPECT_EQ(ram_get_stats(ram).page_count, 5);
+
+    // The pages shared with a snapshot are kept alive by it.
+    ram_snapshot_t *snapshot = ram_snapshot(ram);
+    ram_discard(ram, 0, 0xffffffff);
+    EXPECT_EQ(ram_get_stats(ram).page_count, 0);
+    EXPECT_EQ(ram_get(ram, 2 * page_size + 1), 0);
+    ram_restore(ram, snapshot);
+    EXPECT_EQ(ram_get(ram, 2 * page_size + 1), 5);
+    EXPECT_EQ(ram_get(ram, 7 * page_size), 1);
+    ram_snapshot_destroy(snapshot);
+
+    // A heap allocated and freed again and again does not make the hash
+    // table grow.
+    ram_discard(ram, 0, 0xffffffff);
+    for (addr_t round = 0; round < 10; ++round) {
+      for (addr_t i = 0; i < 1000; ++i) {
+        ram_set(ram, (round * 1000 + i) * 7 * page_size, i + 1);
+      }
+      for (addr_t i = 0; i < 1000; ++i) {
+        ASSERT_EQ(ram_get(ram, (round * 1000 + i) * 7 * page_size), i + 1);
+      }
+      ram_discard(ram, 0, 0xffffffff);
+      EXPECT_EQ(ram_get(ram, round * 1000 * 7 * page_size), 0);
+    }
+    const ram_stats_t stats = ram_get_stats(ram);
+    EXPECT_EQ(stats.page_count, 0);
+    if (backend == RAM_BACKEND_HASH_TABLE) {
+      EXPECT_LE(stats.bucket_count, 2048);
+    }
+#ifdef RAM_ENABLE_STATS
+    EXPECT_GE(stats.page_discards, 10000);
+#endif // RAM_ENABLE_STATS
+
+    ram_destroy(ram);
+  }
+}
+
+TEST(RamTest, compact) {
+  for (ram_backend_t backend :
+       {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}) {
+    ram_t *ram = ram_create_with_backend(backend);
+    ASSERT_NE(ram, nullptr);
+    const addr_t page_size = ram_page_size(ram);
+
+    for (addr_t i = 0; i < 1000; ++i) {
+      ram_set(ram, i * 3 * page_size + 1, i + 1);
+    }
+    EXPECT_EQ(ram_compact(ram), 0);
+
+    // Zero all the pages but 9, and create one with a single non-zero word.
+    for (addr_t i = 10; i < 1000; ++i) {
+      ram_set(ram, i * 3 * page_size + 1, 0);
+    }
+    ram_set(ram, 3 * page_size - 1, 1);
+    ram_set(ram, 1, 0);
+    EXPECT_EQ(ram_compact(ram), 991);
+
+    const ram_stats_t stats = ram_get_stats(ram);
+    EXPECT_EQ(stats.page_count, 10);
+    if (backend == RAM_BACKEND_HASH_TABLE) {
+      EXPECT_LE(stats.bucket_count, 64);
+    }
+    EXPECT_EQ(ram_get(ram, 1), 0);
+    EXPECT_EQ(ram_get(ram, 3 * page_size - 1), 1);
+    for (addr_t i = 1; i < 10; ++i) {
+      EXPECT_EQ(ram_get(ram, i * 3 * page_size + 1), i + 1);
+    }
+    for (addr_t i = 10; i < 1000; ++i) {
+      EXPECT_EQ(ram_get(ram, i * 3 * page_size + 1), 0);
+    }
+
+    // The RAM block is still usable.
+    for (addr_t i = 0; i < 1000; ++i) {
+      ram_set(ram, i * 5 * page_size + 2, i);
+    }
+    for (addr_t i = 1; i < 1000; ++i) {
+      EXPECT_EQ(ram_get(ram, i * 5 * page_size + 2), i);
+    }
+
+    ram_destroy(ram);
+  }
+}
+
+static std::vector<addr_t> dirty_pages(ram_t *ram) {
+  std::vector<addr_t> pages;
+  ram_page_iterator_t it;
+  for (int found = ram_dirty_pages_begin(ram, &it); found;
+       found = ram_dirty_pages_next(&it)) {
+    pages.push_back(it.base_addr);
+  }
+  std::sort(pages.begin(), pages.end());
+  return pages;
+}
+
+static void sum_page_visitor(ram_t *ram, addr_t, const word_t *data,
+                             void *user_data) {
+  for (addr_t i = 0; i < ram_page_size(ram); ++i) {
+    *(word_t *)user_data += data[i];
+  }
+}
+
+TEST(RamTest, dirty_pages) {
+  for (ram_backend_t backend :
+       {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}) {
+    ram_t *ram = ram_create_with_backend(backend);
+    ASSERT_NE(ram, nullptr);
+    const addr_t page_size = ram_page_size(ram);
+    EXPECT_TRUE(dirty_pages(ram).empty());
+
+    ram_set(ram, 5, 1);
+    ram_set(ram, 3 * page_size, 2);
+    ram_set(ram, 0xfffffff0, 3);
+    const addr_t last_page = 0xfffffff0 & ~(page_size - 1);
+    EXPECT_EQ(dirty_pages(ram),
+              (std::vector<addr_t>{0, 3 * page_size, last_page}));
+
+    word_t sum = 0;
+    ram_for_each_page(ram, &sum_page_visitor, &sum);
+    EXPECT_EQ(sum, 6);
+
+    // Writes to a cached page mark it as dirty again after a clear.
+    ram_clear_dirty(ram);
+    EXPECT_TRUE(dirty_pages(ram).empty());
+    ram_set(ram, 6, 4);
+    ram_get_set(ram, last_page, 5);
+    EXPECT_EQ(dirty_pages(ram), (std::vector<addr_t>{0, last_page}));
+
+    // Copied on write pages are dirty too.
+    ram_clear_dirty(ram);
+    ram_snapshot_t *snapshot = ram_snapshot(ram);
+    ram_set(ram, 3 * page_size + 1, 6);
+    EXPECT_EQ(dirty_pages(ram), (std::vector<addr_t>{3 * page_size}));
+
+    // And all the restored ones.
+    ram_clear_dirty(ram);
+    ram_restore(ram, snapshot);
+    ram_snapshot_destroy(snapshot);
+    EXPECT_EQ(dirty_pages(ram),
+              (std::vector<addr_t>{0, 3 * page_size, last_page}));
+
+    // The discarded pages are dirty pages of zeros, until created again.
+    ram_clear_dirty(ram);
+    ram_set(ram, 7 * page_size, 7);
+    ram_discard(ram, 0, 4 * page_size);
+    ram_discard(ram, 7 * page_size, 8 * page_size);
+    EXPECT_EQ(dirty_pages(ram),
+              (std::vector<addr_t>{0, 3 * page_size, 7 * page_size}));
+    ram_page_iterator_t it;
+    ASSERT_TRUE(ram_dirty_pages_begin(ram, &it));
+    EXPECT_EQ(it.data[0], 0);
+    ram_set(ram, 1, 8);
+    EXPECT_EQ(dirty_pages(ram),
+              (std::vector<addr_t>{0, 3 * page_size, 7 * page_size}));
+    ram_clear_dirty(ram);
+    EXPECT_TRUE(dirty_pages(ram).empty());
+
+    // And so are the compacted ones, once zeroed.
+    ram_set(ram, page_size, 9);
+    ram_clear_dirty(ram);
+    ram_set(ram, page_size, 0);
+    ram_clear_dirty(ram);
+    EXPECT_EQ(ram_compact(ram), 1);
+    EXPECT_EQ(dirty_pages(ram), (std::vector<addr_t>{page_size}));
+
+    // The pages missing from a restored snapshot too.
+    ram_clear_dirty(ram);
+    snapshot = ram_snapshot(ram);
+    ram_set(ram, 5 * page_size, 10);
+    ram_clear_dirty(ram);
+    ram_restore(ram, snapshot);
+    ram_snapshot_destroy(snapshot);
+    EXPECT_EQ(dirty_pages(ram),
+              (std::vector<addr_t>{0, 5 * page_size, last_page}));
+
+    ram_destroy(ram);
+  }
+}
+
+TEST(RamTest, dirty_pages_of_file) {
+  const char *filename = "ram_test_dirty.ram";
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+  const addr_t page_size = ram_page_size(ram);
+  ram_set(ram, 0, 1);
+  ram_set(ram, page_size, 2);
+  ASSERT_EQ(ram_save(ram, filename), 0);
+  ram_destroy(ram);
+
+  // The mapped pages are clean until written.
+  ram = ram_load(filename);
+  ASSERT_NE(ram, nullptr);
+  EXPECT_TRUE(dirty_pages(ram).empty());
+  ram_set(ram, page_size + 1, 3);
+  EXPECT_EQ(dirty_pages(ram), (std::vector<addr_t>{page_size}));
+  ram_destroy(ram);
+  std::remove(filename);
+}
+
+TEST(RamTest, incremental_resize) {
+  ram_config_t config = ram_default_config();
+  config.backend = RAM_BACKEND_HASH_TABLE;
+  config.page_size = 2;
+  config.initial_bucket_count = 16;
+  ram_t *ram = ram_create_ex(&config);
+  ASSERT_NE(ram, nullptr);
+
+  // Check all the pages after each creation, so the hash table is checked in
+  // the middle of its resizes too.
+  std::vector<addr_t> pages;
+  word_t expected_sum = 0;
+  for (addr_t i = 0; i < 600; ++i) {
+    const addr_t page = (i * 7919) * 2;
+    ram_set(ram, page, i + 1);
+    pages.push_back(page);
+    expected_sum += i + 1;
+
+    for (addr_t j = 0; j <= i; ++j) {
+      ASSERT_EQ(ram_get(ram, pages[j]), j + 1);
+    }
+    EXPECT_EQ(ram_get(ram, page + 2), 0);
+
+    word_t sum = 0;
+    ram_for_each_page(ram, &sum_page_visitor, &sum);
+    EXPECT_EQ(sum, expected_sum);
+    EXPECT_EQ(dirty_pages(ram).size(), i + 1);
+  }
+
+  ram_snapshot_t *snapshot = ram_snapshot(ram);
+  ram_set(ram, 0, 0);
+  ram_restore(ram, snapshot);
+  EXPECT_EQ(ram_get(ram, 0), 1);
+  ram_snapshot_destroy(snapshot);
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, memory_budget) {
+  for (ram_backend_t backend : {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}) {
+    ram_config_t config = ram_default_config();
+    config.backend = backend;
+    config.page_size = 64;
+    config.max_resident_pages = 16;
+    ram_t *ram = ram_create_ex(&config);
+    ASSERT_NE(ram, nullptr);
+
+    // 200 pages, and one page that is all zeros again.
+    for (addr_t i = 0; i < 200; ++i) {
+      ram_set(ram, i * 64 + i % 64, i + 1);
+      const ram_stats_t stats = ram_get_stats(ram);
+      ASSERT_LE(stats.page_count - stats.swapped_page_count, 16);
+    }
+    ram_set(ram, 7 * 64 + 7, 0);
+    EXPECT_EQ(ram_get_stats(ram).page_count, 200);
+    EXPECT_GT(ram_get_stats(ram).swapped_page_count, 150);
+#ifdef RAM_ENABLE_STATS
+    EXPECT_GE(ram_get_stats(ram).page_evictions, 184);
+#endif // RAM_ENABLE_STATS
+
+    for (addr_t i = 0; i < 200; ++i) {
+      const addr_t page = (i * 37) % 200;
+      ASSERT_EQ(ram_get(ram, page * 64 + page % 64),
+                (page == 7) ? 0 : page + 1);
+      ASSERT_EQ(ram_get(ram, page * 64 + (page + 1) % 64), 0);
+    }
+    EXPECT_EQ(dirty_pages(ram).size(), 200);
+
+    word_t sum = 0;
+    ram_for_each_page(ram, &sum_page_visitor, &sum);
+    EXPECT_EQ(sum, 200 * 201 / 2 - 8);
+
+    // The snapshot brings the pages back, and keeps them.
+    ram_snapshot_t *snapshot = ram_snapshot(ram);
+    ram_set(ram, 5 * 64 + 5, 42);
+    ram_restore(ram, snapshot);
+    const ram_stats_t restored_stats = ram_get_stats(ram);
+    EXPECT_EQ(restored_stats.page_count, 200);
+    EXPECT_LE(restored_stats.page_count - restored_stats.swapped_page_count, 16);
+    ram_snapshot_destroy(snapshot);
+    EXPECT_EQ(ram_get(ram, 5 * 64 + 5), 6);
+
+    const std::string filename = testing::TempDir() + "memory_budget.ram";
+    ASSERT_EQ(ram_save(ram, filename.c_str()), 0);
+    ram_t *loaded_ram = ram_load(filename.c_str());
+    ASSERT_NE(loaded_ram, nullptr);
+    EXPECT_EQ(ram_compare(ram, loaded_ram, 0, 200 * 64), 0);
+    ram_destroy(loaded_ram);
+    std::remove(filename.c_str());
+
+    // Evicted pages can be removed without being read back.
+    ram_discard(ram, 0, 100 * 64);
+    EXPECT_EQ(ram_compact(ram), 0);
+    EXPECT_EQ(ram_get_stats(ram).page_count, 100);
+    EXPECT_EQ(ram_get(ram, 150 * 64 + 150 % 64), 151);
+
+    // Even a few ones, which are looked up one by one.
+    for (addr_t i = 300; i < 340; ++i) {
+      ram_set(ram, i * 64, i);
+    }
+#ifdef RAM_ENABLE_STATS
+    const uint64_t swap_ins = ram_get_stats(ram).page_swap_ins;
+#endif // RAM_ENABLE_STATS
+    ram_discard(ram, 300 * 64, 10 * 64);
+#ifdef RAM_ENABLE_STATS
+    EXPECT_EQ(ram_get_stats(ram).page_swap_ins, swap_ins);
+#endif // RAM_ENABLE_STATS
+    EXPECT_EQ(ram_get_stats(ram).page_count, 130);
+    EXPECT_EQ(ram_get(ram, 305 * 64), 0);
+    EXPECT_EQ(ram_get(ram, 310 * 64), 310);
+    ram_destroy(ram);
+  }
+}
+
+TEST(RamTest, named_swap_file) {
+  ram_config_t config = ram_default_config();
+  config.page_size = 16;
+  config.max_resident_pages = 2;
+  const std::string filename = testing::TempDir() + "named_swap_file.swap";
+  config.swap_file = filename.c_str();
+  ram_t *ram = ram_create_ex(&config);
+  ASSERT_NE(ram, nullptr);
+
+  for (addr_t i = 0; i < 64; ++i) {
+    ram_set(ram, 0x80000000 + i * 16, i);
+  }
+  for (addr_t i = 0; i < 64; ++i) {
+    EXPECT_EQ(ram_get(ram, 0x80000000 + i * 16), i);
+  }
+  ram_destroy(ram);
+  std::remove(filename.c_str());
+
+  config.swap_file = "/nonexistent/directory/file.swap";
+  EXPECT_EQ(ram_create_ex(&config), nullptr);
+}
+
+static void expect_ram_equals(ram_t *ram, const std::vector<word_t> &model) {
+  std::vector<word_t> words(model.size());
+  ram_read_block(ram, 0, words.data(), words.size());
+  EXPECT_EQ(words, model);
+}
+
+TEST(RamTest, compressed_pages) {
+  for (ram_backend_t backend : {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}) {
+    ram_config_t config = ram_default_config();
+    config.backend = backend;
+    config.page_size = 256;
+    config.compressed_pages = 1;
+    ram_t *ram = ram_create_ex(&config);
+    ASSERT_NE(ram, nullptr);
+    std::vector<word_t> model(8 * 256, 0);
+    auto set = [&](addr_t addr, word_t value) {
+      ram_set(ram, addr, value);
+      model[addr] = value;
+    };
+
+    // Page 0 stays sparse, page 1 is promoted, pages 2 and 3 are uniform
+    // (and page 2 then sparse), page 4 is written back to zeros.
+    for (addr_t i = 0; i < 20; ++i) {
+      set(i * 11, i + 1);
+      EXPECT_EQ(ram_get(ram, i * 11), i + 1);
+    }
+    for (addr_t i = 0; i < 256; ++i) {
+      set(256 + i, i);
+    }
+    ram_fill(ram, 2 * 256, 7, 2 * 256);
+    std::fill(model.begin() + 2 * 256, model.begin() + 4 * 256, 7);
+    for (addr_t i = 0; i < 5; ++i) {
+      set(2 * 256 + i * 50, 0);
+    }
+    for (addr_t i = 0; i < 10; ++i) {
+      set(4 * 256 + i, 1);
+      set(4 * 256 + i, 0);
+    }
+    expect_ram_equals(ram, model);
+    EXPECT_EQ(ram_get_stats(ram).page_count, 5);
+    EXPECT_EQ(ram_get_stats(ram).compressed_page_count, 4);
+
+    // The other writes promote the pages.
+    const word_t block[] = {9, 8, 7};
+    ram_write_block(ram, 100, block, 3);
+    std::copy(block, block + 3, model.begin() + 100);
+    expect_ram_equals(ram, model);
+    EXPECT_EQ(ram_get_stats(ram).compressed_page_count, 3);
+#ifdef RAM_ENABLE_STATS
+    EXPECT_EQ(ram_get_stats(ram).page_promotions, 2);
+#endif // RAM_ENABLE_STATS
+
+    // Compacting removes page 4 and compresses pages 0 and 1 again.
+    for (addr_t i = 3; i < 256; ++i) {
+      set(256 + i, 0);
+    }
+    EXPECT_EQ(ram_compact(ram), 1);
+    EXPECT_EQ(ram_get_stats(ram).compressed_page_count, 4);
+    expect_ram_equals(ram, model);
+
+    std::vector<addr_t> addrs;
+    for (addr_t i = 0; i < model.size(); i += 37) {
+      addrs.push_back(i);
+    }
+    std::vector<word_t> gathered(addrs.size());
+    ram_gather(ram, addrs.data(), gathered.data(), addrs.size());
+    for (size_t i = 0; i < addrs.size(); ++i) {
+      EXPECT_EQ(gathered[i], model[addrs[i]]);
+    }
+
+    word_t sum = 0;
+    ram_for_each_page(ram, &sum_page_visitor, &sum);
+    word_t expected_sum = 0;
+    for (word_t word : model) {
+      expected_sum += word;
+    }
+    EXPECT_EQ(sum, expected_sum);
+    // The removed page 4 is still dirty.
+    EXPECT_EQ(dirty_pages(ram).size(), 5);
+
+    // The snapshots and clones copy the compressed pages.
+    ram_snapshot_t *snapshot = ram_snapshot(ram);
+    ram_t *clone = ram_clone(ram);
+    ram_set(ram, 2 * 256 + 1, 5);
+    ram_set(clone, 3 * 256 + 1, 5);
+    EXPECT_EQ(ram_get(ram, 3 * 256 + 1), 7);
+    ram_restore(ram, snapshot);
+    ram_snapshot_destroy(snapshot);
+    expect_ram_equals(ram, model);
+    ram_set(clone, 3 * 256 + 1, 7);
+    EXPECT_EQ(ram_compare(ram, clone, 0, model.size()), 0);
+    ram_destroy(clone);
+
+    const std::string filename = testing::TempDir() + "compressed_pages.ram";
+    ASSERT_EQ(ram_save(ram, filename.c_str()), 0);
+    ram_t *loaded_ram = ram_load(filename.c_str());
+    ASSERT_NE(loaded_ram, nullptr);
+    EXPECT_EQ(ram_compare(ram, loaded_ram, 0, model.size()), 0);
+    ram_destroy(loaded_ram);
+    std::remove(filename.c_str());
+    ram_destroy(ram);
+  }
+
+  // The compressed pages do not count in the memory budget.
+  ram_config_t config = ram_default_config();
+  config.page_size = 256;
+  config.compressed_pages = 1;
+  config.max_resident_pages = 2;
+  ram_t *ram = ram_create_ex(&config);
+  ASSERT_NE(ram, nullptr);
+  for (addr_t i = 0; i < 100; ++i) {
+    ram_set(ram, i * 256 + i, i);
+  }
+  for (addr_t i = 0; i < 1000; ++i) {
+    ram_set(ram, 100 * 256 + i, i);
+  }
+  EXPECT_EQ(ram_get_stats(ram).compressed_page_count, 100);
+  EXPECT_EQ(ram_get_stats(ram).swapped_page_count, 2);
+  for (addr_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(ram_get(ram, i * 256 + i), i);
+  }
+  ram_destroy(ram);
+}
+
+TEST(RamTest, compressed_pages_read_before_write) {
+  for (ram_backend_t backend : {RAM_BACKEND_HASH_TABLE, RAM_BACKEND_RADIX_TABLE}) {
+    ram_config_t config = ram_default_config();
+    config.backend = backend;
+    config.page_size = 256;
+    config.compressed_pages = 1;
+    ram_t *ram = ram_create_ex(&config);
+    ASSERT_NE(ram, nullptr);
+    ram_view_t *view = ram_view_create(ram);
+
+    // The missing pages are first cached as the zero page, then created
+    // compressed by ram_set() and ram_fill().
+    EXPECT_EQ(ram_get(ram, 10), 0);
+    EXPECT_EQ(ram_view_get(view, 11), 0);
+    ram_set(ram, 10, 1);
+    EXPECT_EQ(ram_get(ram, 10), 1);
+    EXPECT_EQ(ram_view_get(view, 10), 1);
+
+    EXPECT_EQ(ram_get(ram, 256), 0);
+    ram_fill(ram, 256, 2, 256);
+    EXPECT_EQ(ram_get(ram, 300), 2);
+
+    word_t words[2];
+    ram_read_block(ram, 9, words, 2);
+    EXPECT_EQ(words[0], 0);
+    EXPECT_EQ(words[1], 1);
+
+    ram_view_destroy(view);
+    ram_destroy(ram);
+  }
+}
+
+static void counting_write_listener(ram_t *, addr_t, word_t) {}
+
+TEST(RamTest, stats) {
+  ram_config_t config = ram_default_config();
+  config.initial_bucket_count = 2;
+  ram_t *ram = ram_create_ex(&config);
+  ASSERT_NE(ram, nullptr);
+  const addr_t page_size = ram_page_size(ram);
+#ifndef RAM_NO_WRITE_LISTENER
+  ram_install_write_listener(ram, 0xffff0000, 0xffff0003,
+                             &counting_write_listener);
+#endif // !RAM_NO_WRITE_LISTENER
+
+  for (addr_t i = 0; i < 32; ++i) {
+    ram_set(ram, i * page_size, i);
+  }
+  ram_set(ram, 31 * page_size + 1, 42);
+  EXPECT_EQ(ram_get(ram, 31 * page_size + 1), 42);
+  ram_set(ram, 0xffff0000, 1);
+
+  // The current state is always available.
+  ram_stats_t stats = ram_get_stats(ram);
+  EXPECT_EQ(stats.page_count, 33);
+  EXPECT_GE(stats.bucket_count, 64);
+
+#ifdef RAM_ENABLE_STATS
+  EXPECT_EQ(stats.page_allocations, 33);
+  EXPECT_EQ(stats.page_copies, 0);
+  EXPECT_EQ(stats.ht_resizes, 2);
+  EXPECT_GE(stats.write_cache_hits, 1);
+  EXPECT_EQ(stats.write_cache_hits + stats.write_cache_misses, 34);
+  EXPECT_EQ(stats.read_cache_hits + stats.read_cache_misses, 1);
+  EXPECT_GE(stats.ht_probes, stats.ht_lookups);
+  EXPECT_GE(stats.ht_max_probe_length, 1);
+#ifndef RAM_NO_WRITE_LISTENER
+  EXPECT_EQ(stats.write_listener_calls, 1);
+#endif // !RAM_NO_WRITE_LISTENER
+
+  ram_snapshot_t *snapshot = ram_snapshot(ram);
+  ram_set(ram, 2, 3);
+  EXPECT_EQ(ram_get_stats(ram).page_copies, 1);
+  ram_snapshot_destroy(snapshot);
+
+  ram_reset_stats(ram);
+  stats = ram_get_stats(ram);
+  EXPECT_EQ(stats.page_allocations, 0);
+  EXPECT_EQ(stats.write_listener_calls, 0);
+#else
+  EXPECT_EQ(stats.page_allocations, 0);
+  EXPECT_EQ(stats.write_cache_hits, 0);
+#endif // RAM_ENABLE_STATS
+
+  // The dump always works.
+  FILE *out = tmpfile();
+  ASSERT_NE(out, nullptr);
+  ram_dump_stats(ram, out);
+  EXPECT_GT(ftell(out), 0);
+  fclose(out);
+
+  ram_destroy(ram);
+}
+
 TEST(RamTest, read_listener) {
   ram_t *ram = ram_create();
   ASSERT_NE(ram, nullptr);
@@ -135,6 +1273,38 @@ TEST(RamTest, read_listener) {
 
   ram_destroy(ram);
 }
+
+static int removed_listener_calls = 0;
+
+static void removed_read_listener(ram_t *, addr_t) {
+  ++removed_listener_calls;
+}
+
+TEST(RamTest, remove_read_listener) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  ram_install_read_listener(ram, 0, 10, &removed_read_listener);
+  ram_install_read_listener(ram, 5, 20, &removed_read_listener);
+  ram_install_read_listener(ram, 15, 30, [](auto, auto) {});
+
+  removed_listener_calls = 0;
+  ram_get(ram, 7);
+  EXPECT_EQ(removed_listener_calls, 2);
+
+  // Both ranges are removed, the other listener stays.
+  ram_remove_read_listener(ram, &removed_read_listener);
+  ram_get(ram, 7);
+  ram_get(ram, 18);
+  EXPECT_EQ(removed_listener_calls, 2);
+
+  ram_install_read_listener(ram, 18, 18, &removed_read_listener);
+  ram_get(ram, 7);
+  ram_get(ram, 18);
+  EXPECT_EQ(removed_listener_calls, 3);
+
+  ram_destroy(ram);
+}
 #endif // !RAM_NO_READ_LISTENER
 
 #ifndef RAM_NO_WRITE_LISTENER
@@ -202,3 +1372,167 @@ TEST(RamTest, write_listener) {
   ram_destroy(ram);
 }
 #endif // !RAM_NO_WRITE_LISTENER
+
+#ifndef RAM_NO_WRITE_LISTENER
+static std::vector<std::pair<addr_t, word_t>> block_writes;
+
+TEST(RamTest, block_write_listener) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  ram_install_write_listener(ram, 8, 11, [](auto, auto addr, auto value) {
+    block_writes.emplace_back(addr, value);
+  });
+
+  block_writes.clear();
+  const word_t data[] = { 1, 2, 3, 4, 5, 6 };
+  ram_write_block(ram, 4, data, 6);
+  ASSERT_EQ(block_writes.size(), 2);
+  EXPECT_EQ(block_writes[0], std::make_pair((addr_t)8, (word_t)5));
+  EXPECT_EQ(block_writes[1], std::make_pair((addr_t)9, (word_t)6));
+
+  // With overlapping listeners, the calls are in address order, like for
+  // single writes, then in installation order.
+  ram_install_write_listener(ram, 0, 8, [](auto, auto addr, auto value) {
+    block_writes.emplace_back(addr + 100, value);
+  });
+  block_writes.clear();
+  ram_write_block(ram, 7, data, 3);
+  EXPECT_EQ(block_writes, (std::vector<std::pair<addr_t, word_t>>{
+                              {107, 1}, {8, 2}, {108, 2}, {9, 3}}));
+
+  ram_destroy(ram);
+}
+#endif // !RAM_NO_WRITE_LISTENER
+
+#ifndef RAM_NO_WRITE_LISTENER
+TEST(RamTest, fill_write_listener) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  ram_install_write_listener(ram, 10, 12, [](ram_t *ram, addr_t addr, word_t value) {
+    block_writes.emplace_back(addr, value);
+    // The whole range is already filled.
+    EXPECT_EQ(ram_get(ram, 20), 7);
+  });
+  block_writes.clear();
+  ram_fill(ram, 0, 7, 21);
+  EXPECT_EQ(block_writes, (std::vector<std::pair<addr_t, word_t>>{
+                              {10, 7}, {11, 7}, {12, 7}}));
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, discard_write_listener) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  ram_fill(ram, 0, 7, 21);
+  ram_install_write_listener(ram, 10, 12, [](ram_t *ram, addr_t addr, word_t value) {
+    block_writes.emplace_back(addr, value);
+    // The whole range is already discarded.
+    EXPECT_EQ(ram_get(ram, 20), 0);
+  });
+  block_writes.clear();
+  ram_discard(ram, 0, ram_page_size(ram));
+  EXPECT_EQ(block_writes, (std::vector<std::pair<addr_t, word_t>>{
+                              {10, 0}, {11, 0}, {12, 0}}));
+
+  ram_destroy(ram);
+}
+
+TEST(RamTest, scatter_write_listener) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  ram_install_write_listener(ram, 10, 12, [](ram_t *ram, addr_t addr, word_t value) {
+    block_writes.emplace_back(addr, value);
+    // The writes are done in order.
+    EXPECT_EQ(ram_get(ram, 100), block_writes.size() == 1 ? 0 : 2);
+  });
+  block_writes.clear();
+  const addr_t addrs[] = {11, 100, 10, 12, 11};
+  const word_t values[] = {1, 2, 3, 4, 5};
+  ram_scatter(ram, addrs, values, 5);
+  EXPECT_EQ(block_writes, (std::vector<std::pair<addr_t, word_t>>{
+                              {11, 1}, {10, 3}, {12, 4}, {11, 5}}));
+
+  ram_destroy(ram);
+}
+
+static std::vector<int> listener_calls;
+
+TEST(RamTest, many_write_listeners) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  // Overlapping ranges, listeners must be called in their installation order.
+  ram_install_write_listener(ram, 100, 0xffffffff,
+                             [](auto, auto, auto) { listener_calls.push_back(0); });
+  ram_install_write_listener(ram, 0, 200, [](auto, auto, auto) { listener_calls.push_back(1); });
+  ram_install_write_listener(ram, 150, 150, [](auto, auto, auto) { listener_calls.push_back(2); });
+  ram_install_write_listener(ram, 0, 99, [](auto, auto, auto) { listener_calls.push_back(3); });
+
+  const std::pair<addr_t, std::vector<int>> expected_calls[] = {
+      {0, {1, 3}},      {99, {1, 3}},  {100, {0, 1}}, {149, {0, 1}},
+      {150, {0, 1, 2}}, {151, {0, 1}}, {200, {0, 1}}, {201, {0}},
+      {0xffffffff, {0}},
+  };
+  for (const auto &[addr, calls] : expected_calls) {
+    listener_calls.clear();
+    ram_set(ram, addr, 1);
+    EXPECT_EQ(listener_calls, calls) << "at address " << addr;
+  }
+
+  // Many nested and overlapping ranges, with a single callback.
+  ram_t *other_ram = ram_create();
+  ASSERT_NE(other_ram, nullptr);
+  std::vector<std::pair<addr_t, addr_t>> ranges;
+  for (addr_t i = 0; i < 2000; ++i) {
+    const addr_t addr_low = (i * 7919) % 10000;
+    ranges.emplace_back(addr_low, addr_low + (i * 104729) % 500);
+    ram_install_write_listener(other_ram, ranges.back().first,
+                               ranges.back().second,
+                               [](auto, auto, auto) { listener_calls.push_back(0); });
+  }
+  for (addr_t addr = 0; addr < 10600; addr += 3) {
+    listener_calls.clear();
+    ram_set(other_ram, addr, 1);
+    const size_t count = std::count_if(ranges.begin(), ranges.end(), [&](auto range) {
+      return range.first <= addr && addr <= range.second;
+    });
+    ASSERT_EQ(listener_calls.size(), count) << "at address " << addr;
+  }
+  ram_destroy(other_ram);
+
+  ram_destroy(ram);
+}
+#endif // !RAM_NO_WRITE_LISTENER
+
+#ifndef RAM_NO_READ_LISTENER
+static int cached_read_listener_calls = 0;
+
+TEST(RamTest, read_listener_on_cached_page) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  // Put the page in the page cache before installing the listener.
+  ram_set(ram, 67, 146);
+  EXPECT_EQ(ram_get(ram, 67), 146);
+
+  ram_install_read_listener(ram, 60, 70,
+                            [](auto, auto) { cached_read_listener_calls += 1; });
+
+  cached_read_listener_calls = 0;
+  EXPECT_EQ(ram_get(ram, 67), 146);
+  EXPECT_EQ(ram_get(ram, 67), 146);
+  EXPECT_EQ(ram_get_set(ram, 67, 147), 146);
+  EXPECT_EQ(cached_read_listener_calls, 3);
+
+  // Other addresses of the page do not call the listener.
+  EXPECT_EQ(ram_get(ram, 71), 0);
+  EXPECT_EQ(cached_read_listener_calls, 3);
+
+  ram_destroy(ram);
+}
+#endif // !RAM_NO_READ_LISTENER
@@ -0,0 +1,139 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "memory.h"
+
+TEST(RamViewTest, get_set) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+  ram_view_t *view = ram_view_create(ram);
+  ASSERT_NE(view, nullptr);
+
+  // Missing pages are read as zeros, and pages created by the RAM block are
+  // visible through the view (and the converse).
+  EXPECT_EQ(ram_view_get(view, 4523), 0);
+  ram_set(ram, 4523, 563);
+  EXPECT_EQ(ram_view_get(view, 4523), 563);
+  ram_view_set(view, 4524, 564);
+  EXPECT_EQ(ram_get(ram, 4524), 564);
+  EXPECT_EQ(ram_view_get(view, 4524), 564);
+
+  // The snapshot is not modified by the writes through the view.
+  ram_snapshot_t *snapshot = ram_snapshot(ram);
+  ram_view_set(view, 4524, 1);
+  EXPECT_EQ(ram_view_get(view, 4524), 1);
+  ram_restore(ram, snapshot);
+  EXPECT_EQ(ram_view_get(view, 4524), 564);
+  ram_snapshot_destroy(snapshot);
+
+  ram_view_destroy(view);
+  ram_destroy(ram);
+}
+
+#ifndef RAM_NO_WRITE_LISTENER
+static std::vector<std::pair<addr_t, word_t>> view_writes;
+
+TEST(RamViewTest, batched_write_listeners) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+  ram_view_t *view = ram_view_create(ram);
+
+  // Installed after the page is cached by the view.
+  ram_view_set(view, 10, 1);
+  ram_install_write_listener(ram, 10, 11,
+                             [](ram_t *, addr_t addr, word_t value) {
+                               view_writes.emplace_back(addr, value);
+                             });
+
+  view_writes.clear();
+  ram_view_set(view, 10, 2);
+  ram_view_set(view, 12, 3);
+  ram_view_set(view, 11, 4);
+  EXPECT_EQ(ram_view_get(view, 10), 2);
+  EXPECT_TRUE(view_writes.empty());
+
+  ram_view_flush(view);
+  const std::vector<std::pair<addr_t, word_t>> expected = {{10, 2}, {11, 4}};
+  EXPECT_EQ(view_writes, expected);
+
+  // Many writes are flushed on the way, none is lost.
+  view_writes.clear();
+  for (word_t i = 0; i < 1000; ++i) {
+    ram_view_set(view, 10, i);
+  }
+  ram_view_destroy(view);
+  ASSERT_EQ(view_writes.size(), 1000);
+  EXPECT_EQ(view_writes.back().second, 999);
+
+  ram_destroy(ram);
+}
+#endif // !RAM_NO_WRITE_LISTENER
+
+TEST(RamViewTest, concurrent) {
+  ram_config_t config = ram_default_config();
+  config.concurrent = 1;
+  ram_t *ram = ram_create_ex(&config);
+  ASSERT_NE(ram, nullptr);
+
+  constexpr int THREAD_COUNT = 4;
+  constexpr addr_t WORDS_PER_THREAD = 100000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREAD_COUNT; ++t) {
+    threads.emplace_back([ram, t] {
+      ram_view_t *view = ram_view_create(ram);
+      for (addr_t i = 0; i < WORDS_PER_THREAD; ++i) {
+        ram_view_set(view, i * THREAD_COUNT + t, i);
+      }
+      ram_view_destroy(view);
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  ram_view_t *view = ram_view_create(ram);
+  for (int t = 0; t < THREAD_COUNT; ++t) {
+    for (addr_t i = 0; i < WORDS_PER_THREAD; ++i) {
+      ASSERT_EQ(ram_view_get(view, i * THREAD_COUNT + t), i);
+    }
+  }
+  ram_view_destroy(view);
+  ram_destroy(ram);
+}
+
+TEST(RamViewTest, concurrent_copy_on_write) {
+  ram_config_t config = ram_default_config();
+  config.concurrent = 1;
+  ram_t *ram = ram_create_ex(&config);
+  ASSERT_NE(ram, nullptr);
+  ram_view_t *view = ram_view_create(ram);
+
+  // The view reads a shared page while another thread copies it on write: it
+  // must not cache the data left to the snapshot.
+  for (word_t round = 1; round <= 200; ++round) {
+    ram_set(ram, 0, round);
+    ram_snapshot_t *snapshot = ram_snapshot(ram);
+    std::thread reader([view] {
+      for (int i = 0; i < 1000; ++i) {
+        ram_view_get(view, 0);
+      }
+    });
+    std::thread writer([ram, round] { ram_set(ram, 1, round); });
+    reader.join();
+    writer.join();
+
+    ram_set(ram, 0, round + 1000);
+    ASSERT_EQ(ram_view_get(view, 0), round + 1000);
+    ram_snapshot_destroy(snapshot);
+  }
+
+  ram_view_destroy(view);
+  ram_destroy(ram);
+}
@@ -6,6 +6,11 @@
 
 #include "memory.h"
 
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
 TEST(RomTest, rom_create) {
   static word_t data[8] = {0xab, 0xbc, 0xcd, 0xde, 0x12, 0x23, 0x34, 0x45};
 
@@ -21,5 +26,81 @@ TEST(RomTest, rom_create) {
   EXPECT_EQ(rom_get(rom, 6), 0x34);
   EXPECT_EQ(rom_get(rom, 7), 0x45);
 
+  EXPECT_EQ(rom.data_len, 8);
+  EXPECT_EQ(rom_get_checked(rom, 7), 0x45);
+  EXPECT_EQ(rom_get_checked(rom, 8), 0);
+  EXPECT_EQ(rom_get_checked(rom, 0xffffffff), 0);
+
+  rom_destroy(rom);
+}
+
+TEST(RomTest, rom_from_file) {
+  static word_t data[8] = {0xab, 0xbc, 0xcd, 0xde, 0x12, 0x23, 0x34, 0x45};
+
+  const std::string filename = testing::TempDir() + "rom_from_file.rom";
+  FILE *file = fopen(filename.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  fwrite(data, sizeof(word_t), 8, file);
+  fclose(file);
+
+  rom_t rom = rom_from_file(filename.c_str());
+  ASSERT_NE(rom.data, nullptr);
+  EXPECT_EQ(rom.data_len, 8);
+  for (addr_t i = 0; i < 8; ++i) {
+    EXPECT_EQ(rom_get(rom, i), data[i]);
+  }
+  EXPECT_EQ(rom_get_checked(rom, 8), 0);
+
   rom_destroy(rom);
+  std::remove(filename.c_str());
+}
+
+static void write_rom_file(const std::string &filename,
+                           const std::vector<word_t> &data) {
+  FILE *file = fopen(filename.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  fwrite(data.data(), sizeof(word_t), data.size(), file);
+  fclose(file);
+}
+
+TEST(RomTest, shared_file) {
+  const std::string filename = testing::TempDir() + "shared_file.rom";
+  write_rom_file(filename, {1, 2, 3, 4});
+
+  // The ROMs of the same file share their data until the last one is
+  // destroyed.
+  rom_t rom = rom_from_file(filename.c_str());
+  rom_t other_rom = rom_from_file(filename.c_str());
+  EXPECT_EQ(rom.data, other_rom.data);
+  rom_destroy(rom);
+  EXPECT_EQ(rom_get(other_rom, 3), 4);
+
+  // A modified file is loaded again (the size changes too, as the modification
+  // time may not).
+  std::remove(filename.c_str());
+  write_rom_file(filename, {5, 6, 7, 8, 9});
+  rom_t new_rom = rom_from_file(filename.c_str());
+  EXPECT_NE(new_rom.data, other_rom.data);
+  EXPECT_EQ(new_rom.data_len, 5);
+  EXPECT_EQ(rom_get(new_rom, 4), 9);
+  EXPECT_EQ(rom_get(other_rom, 3), 4);
+  rom_destroy(other_rom);
+  rom_destroy(new_rom);
+
+  // Many instances loading the same firmware at once.
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&filename]() {
+      for (int j = 0; j < 100; ++j) {
+        rom_t thread_rom = rom_from_file(filename.c_str());
+        EXPECT_EQ(rom_get_checked(thread_rom, 4), 9);
+        rom_destroy(thread_rom);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  std::remove(filename.c_str());
 }
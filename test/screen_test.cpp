@@ -0,0 +1,173 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+#include <gtest/gtest.h>
+
+#include "screen.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+// Counts the occurrences of ch in str.
+static size_t count_chars(const std::string &str, char ch) {
+  size_t count = 0;
+  for (char c : str) {
+    count += (c == ch);
+  }
+  return count;
+}
+
+TEST(ScreenTest, buffered) {
+  testing::internal::CaptureStdout();
+  screen_init();
+  screen_set_buffered(1, 0);
+  testing::internal::GetCapturedStdout();
+
+  // Nothing is printed until the frame is presented.
+  testing::internal::CaptureStdout();
+  screen_put_character(0, 0, 'a');
+  screen_put_character(1, 0, 'b');
+  screen_put_character(1, 0, 'c');
+  EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+
+  testing::internal::CaptureStdout();
+  screen_present();
+  const std::string frame = testing::internal::GetCapturedStdout();
+  EXPECT_EQ(count_chars(frame, 'a'), 1);
+  EXPECT_EQ(count_chars(frame, 'b'), 0);
+  EXPECT_EQ(count_chars(frame, 'c'), 1);
+
+  // Unchanged cells are not printed again.
+  testing::internal::CaptureStdout();
+  screen_put_character(0, 0, 'a');
+  screen_present();
+  EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+
+  testing::internal::CaptureStdout();
+  screen_set_buffered(0, 0);
+  screen_terminate();
+  testing::internal::GetCapturedStdout();
+}
+
+// Counts the occurrences of sub in str.
+static size_t count_substrings(const std::string &str, const std::string &sub) {
+  size_t count = 0;
+  for (size_t pos = str.find(sub); pos != std::string::npos;
+       pos = str.find(sub, pos + 1)) {
+    count += 1;
+  }
+  return count;
+}
+
+TEST(ScreenTest, coalesced_runs) {
+  testing::internal::CaptureStdout();
+  screen_init();
+  screen_set_buffered(1, 0);
+  testing::internal::GetCapturedStdout();
+
+  // A run of red characters on the same line.
+  const word_t red = 2 << 8;
+  for (addr_t x = 0; x < 4; ++x) {
+    screen_put_character(x, 2, 'a' | red);
+  }
+  screen_put_character(4, 2, 'b');
+
+  testing::internal::CaptureStdout();
+  screen_present();
+  const std::string frame = testing::internal::GetCapturedStdout();
+  EXPECT_EQ(count_chars(frame, 'a'), 4);
+  EXPECT_EQ(count_chars(frame, 'b'), 1);
+  // A single cursor move and a single SGR command for the whole run, then
+  // a reset for the unstyled character (and none at the end of the frame).
+  EXPECT_EQ(count_chars(frame, 'H'), 1);
+  EXPECT_EQ(count_substrings(frame, "\x1b[0;31;49m"), 1);
+  EXPECT_EQ(count_substrings(frame, "\x1b[0m"), 1);
+  EXPECT_NE(frame.find("aaaa\x1b[0mb"), std::string::npos);
+
+  // Bit 7 alone selects the default style explicitly.
+  screen_put_character(0, 3, 'c' | 0x80);
+  testing::internal::CaptureStdout();
+  screen_present();
+  EXPECT_NE(testing::internal::GetCapturedStdout().find("\x1b[0;39;49mc"),
+            std::string::npos);
+
+  testing::internal::CaptureStdout();
+  screen_set_buffered(0, 0);
+  screen_terminate();
+  testing::internal::GetCapturedStdout();
+}
+
+TEST(ScreenTest, async) {
+  testing::internal::CaptureStdout();
+  screen_init();
+  screen_set_async(1, 1000);
+  for (addr_t x = 0; x < 8; ++x) {
+    screen_put_character(x, 5, 'a');
+  }
+  screen_put_character(0, 6, 'b');
+
+  // Disabling the asynchronous mode presents the pending updates.
+  screen_set_async(0, 0);
+  const std::string output = testing::internal::GetCapturedStdout();
+  EXPECT_EQ(count_chars(output, 'a'), 8);
+  EXPECT_EQ(count_chars(output, 'b'), 1);
+
+  // Initializing the screen again keeps the asynchronous mode.
+  testing::internal::CaptureStdout();
+  screen_set_async(1, 1000);
+  screen_put_character(1, 6, 'c');
+  screen_init();
+  screen_put_character(2, 6, 'd');
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_EQ(count_chars(testing::internal::GetCapturedStdout(), 'd'), 1);
+
+  testing::internal::CaptureStdout();
+  screen_set_async(0, 0);
+  screen_set_buffered(0, 0);
+  screen_terminate();
+  testing::internal::GetCapturedStdout();
+}
+
+#ifndef RAM_NO_WRITE_LISTENER
+TEST(ScreenTest, vsync) {
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  testing::internal::CaptureStdout();
+  screen_init_with_ram_mapping(ram);
+  screen_set_buffered(1, 0);
+  testing::internal::GetCapturedStdout();
+
+  testing::internal::CaptureStdout();
+  ram_set(ram, SCREEN_BASE_ADDR + 3, 'z');
+  EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+
+  testing::internal::CaptureStdout();
+  ram_set(ram, SCREEN_VSYNC_ADDR, 1);
+  EXPECT_EQ(count_chars(testing::internal::GetCapturedStdout(), 'z'), 1);
+
+  // With a maximum frame interval, the updates are presented even if the
+  // output stops in the middle of an interval.
+  testing::internal::CaptureStdout();
+  screen_set_buffered(1, 10);
+  ram_set(ram, SCREEN_BASE_ADDR + 4, 'y');
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_EQ(count_chars(testing::internal::GetCapturedStdout(), 'y'), 1);
+
+  testing::internal::CaptureStdout();
+
+  // And the vsync still presents the frame at once.
+  ram_set(ram, SCREEN_BASE_ADDR + 5, 'x');
+  ram_set(ram, SCREEN_VSYNC_ADDR, 1);
+  screen_set_buffered(1, 0);
+  EXPECT_EQ(count_chars(testing::internal::GetCapturedStdout(), 'x'), 1);
+
+  testing::internal::CaptureStdout();
+  screen_set_buffered(0, 0);
+  screen_terminate();
+  testing::internal::GetCapturedStdout();
+  ram_destroy(ram);
+}
+#endif // !RAM_NO_WRITE_LISTENER
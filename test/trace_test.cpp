@@ -0,0 +1,161 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+#include <gtest/gtest.h>
+
+#include "memory.h"
+#include "trace.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(RAM_NO_READ_LISTENER) && !defined(RAM_NO_WRITE_LISTENER)
+static void collect_record(void *user_data, const ram_trace_record_t *record) {
+  static_cast<std::vector<ram_trace_record_t> *>(user_data)->push_back(*record);
+}
+
+static std::vector<ram_trace_record_t> read_trace(const std::string &filename) {
+  std::vector<ram_trace_record_t> records;
+  const int64_t count =
+      ram_trace_read(filename.c_str(), &collect_record, &records);
+  EXPECT_EQ(count, (int64_t)records.size());
+  return records;
+}
+
+TEST(TraceTest, record_and_read) {
+  const std::string filename = testing::TempDir() + "record_and_read.trace";
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+  ram_set(ram, 5, 1); // not recorded
+
+  ram_trace_t *trace = ram_trace_start(ram, filename.c_str());
+  ASSERT_NE(trace, nullptr);
+  ram_set(ram, 0xffffffff, 0xdeadbeef);
+  ram_set(ram, 0, 0);
+  EXPECT_EQ(ram_get(ram, 5), 1);
+  ram_set(ram, 4, 0xffffffff);
+  // Enough records to wrap around the ring buffer.
+  for (addr_t i = 0; i < 1000000; ++i) {
+    ram_set(ram, (i * 4099) % 100000, i);
+  }
+  EXPECT_EQ(ram_trace_stop(trace), 0);
+  ram_set(ram, 6, 1); // not recorded
+
+  const std::vector<ram_trace_record_t> records = read_trace(filename);
+  ASSERT_EQ(records.size(), 4 + 1000000);
+  EXPECT_EQ(records[0].op, RAM_TRACE_WRITE);
+  EXPECT_EQ(records[0].thread, 0);
+  EXPECT_EQ(records[0].addr, 0xffffffff);
+  EXPECT_EQ(records[0].value, 0xdeadbeef);
+  EXPECT_EQ(records[1].addr, 0);
+  EXPECT_EQ(records[1].value, 0);
+  EXPECT_EQ(records[2].op, RAM_TRACE_READ);
+  EXPECT_EQ(records[2].addr, 5);
+  EXPECT_EQ(records[2].value, 0);
+  EXPECT_EQ(records[3].addr, 4);
+  EXPECT_EQ(records[3].value, 0xffffffff);
+  for (addr_t i = 0; i < 1000000; ++i) {
+    ASSERT_EQ(records[4 + i].op, RAM_TRACE_WRITE);
+    ASSERT_EQ(records[4 + i].addr, (i * 4099) % 100000);
+    ASSERT_EQ(records[4 + i].value, i);
+  }
+
+  // The listeners are removed by ram_trace_stop(), so a new trace can be
+  // recorded.
+  trace = ram_trace_start(ram, filename.c_str());
+  ASSERT_NE(trace, nullptr);
+  ram_get(ram, 7);
+  EXPECT_EQ(ram_trace_stop(trace), 0);
+  EXPECT_EQ(read_trace(filename).size(), 1);
+
+  ram_destroy(ram);
+  std::remove(filename.c_str());
+}
+
+TEST(TraceTest, replay) {
+  const std::string filename = testing::TempDir() + "replay.trace";
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+
+  ram_trace_t *trace = ram_trace_start(ram, filename.c_str());
+  ASSERT_NE(trace, nullptr);
+  ram_fill(ram, 1000, 3, 100);
+  for (addr_t i = 0; i < 10000; ++i) {
+    ram_set(ram, (i * 7919) % 65536, ram_get(ram, i) + i);
+  }
+  EXPECT_EQ(ram_trace_stop(trace), 0);
+
+  ram_t *replayed = ram_create();
+  ASSERT_NE(replayed, nullptr);
+  EXPECT_EQ(ram_trace_replay(replayed, filename.c_str()), 100 + 2 * 10000);
+  EXPECT_EQ(ram_compare(ram, replayed, 0, 65536), 0);
+
+  ram_destroy(replayed);
+  ram_destroy(ram);
+  std::remove(filename.c_str());
+}
+
+TEST(TraceTest, threads) {
+  const std::string filename = testing::TempDir() + "threads.trace";
+  ram_config_t config = ram_default_config();
+  config.concurrent = 1;
+  ram_t *ram = ram_create_ex(&config);
+  ASSERT_NE(ram, nullptr);
+
+  ram_trace_t *trace = ram_trace_start(ram, filename.c_str());
+  ASSERT_NE(trace, nullptr);
+  constexpr int THREAD_COUNT = 4;
+  constexpr addr_t WORDS_PER_THREAD = 200000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREAD_COUNT; ++t) {
+    threads.emplace_back([ram, t] {
+      for (addr_t i = 0; i < WORDS_PER_THREAD; ++i) {
+        ram_set(ram, i * THREAD_COUNT + t, i + t);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(ram_trace_stop(trace), 0);
+
+  // The records of each thread are in order.
+  const std::vector<ram_trace_record_t> records = read_trace(filename);
+  ASSERT_EQ(records.size(), THREAD_COUNT * WORDS_PER_THREAD);
+  std::vector<addr_t> next_index(THREAD_COUNT);
+  std::vector<int> thread_of_index(THREAD_COUNT, -1);
+  for (const ram_trace_record_t &record : records) {
+    ASSERT_LT(record.thread, (uint32_t)THREAD_COUNT);
+    const int t = (int)(record.addr % THREAD_COUNT);
+    if (thread_of_index[record.thread] < 0) {
+      thread_of_index[record.thread] = t;
+    }
+    ASSERT_EQ(thread_of_index[record.thread], t);
+    ASSERT_EQ(record.addr, next_index[t] * THREAD_COUNT + t);
+    ASSERT_EQ(record.value, next_index[t] + t);
+    ++next_index[t];
+  }
+
+  ram_destroy(ram);
+  std::remove(filename.c_str());
+}
+#endif // !RAM_NO_READ_LISTENER && !RAM_NO_WRITE_LISTENER
+
+TEST(TraceTest, invalid_file) {
+  const std::string filename = testing::TempDir() + "invalid.trace";
+  ram_t *ram = ram_create();
+  ASSERT_NE(ram, nullptr);
+  EXPECT_EQ(ram_trace_replay(ram, filename.c_str()), -1);
+
+  FILE *file = fopen(filename.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  fputs("not a trace", file);
+  fclose(file);
+  EXPECT_EQ(ram_trace_replay(ram, filename.c_str()), -1);
+
+  ram_destroy(ram);
+  std::remove(filename.c_str());
+}
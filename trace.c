@@ -0,0 +1,610 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+// Needed for clock_gettime() when compiling with a strict C standard.
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include "trace.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#define IS_POSIX 1
+#else
+#define IS_POSIX 0
+#endif
+
+// The drain thread needs POSIX threads and the GCC atomic builtins, otherwise
+// the accessing threads write their ring buffer themselves.
+#if IS_POSIX && (defined(__GNUC__) || defined(__clang__))
+#define HAS_DRAIN_THREAD 1
+#include <pthread.h>
+#include <sched.h>
+#else
+#define HAS_DRAIN_THREAD 0
+#endif
+
+#if HAS_DRAIN_THREAD
+// A ring buffer has a single producer, its thread, and a single consumer, the
+// drain thread. The records are stored before the head is advanced (with
+// release semantics) and loaded after it is loaded (with acquire semantics),
+// and the other way around for the tail.
+#define LOAD_POSITION(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define STORE_POSITION(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#define THREAD_LOCAL __thread
+#else
+#define LOAD_POSITION(ptr) (*(ptr))
+#define STORE_POSITION(ptr, value) (*(ptr) = (value))
+#define THREAD_LOCAL
+#endif
+
+/* A trace file starts with a header (TRACE_MAGIC and TRACE_VERSION, as 32-bits
+ * words), followed by blocks of records. Each block is the index of its
+ * thread and its size in bytes (two varints) followed by whole records of
+ * this thread.
+ *
+ * A record is a varint of its op (the lowest bit) and of the difference
+ * between its address and the address of the previous record of the thread
+ * (zigzag encoded, so that small negative differences are small too). A
+ * write is followed by a varint of the difference between its value and the
+ * value of the previous write of the thread (zigzag encoded too). So an
+ * access to the same or a close address is usually 1 or 2 bytes. The first
+ * record of a thread is relative to address 0 and value 0.
+ *
+ * Varints are little-endian base 128: 7 bits per byte, the highest bit set on
+ * all bytes but the last one. */
+
+#define TRACE_MAGIC 0x52545053 // "SPTR"
+#define TRACE_VERSION 1
+
+// The size, in bytes, of the ring buffer of each accessing thread (and the
+// maximum size of a block). Must be a power of 2.
+#define TRACE_RING_SIZE (1u << 20)
+// The maximum size, in bytes, of a record: a 33-bits varint and a 32-bits
+// one.
+#define TRACE_RECORD_MAX_SIZE 10
+// The maximum size, in bytes, of a block header: two 32-bits varints.
+#define TRACE_BLOCK_HEADER_MAX_SIZE 10
+// The size, in bytes, of the writes to the trace file. Must be larger than a
+// block.
+#define TRACE_WRITE_BUFFER_SIZE (4u << 20)
+// The interval between two drains of the ring buffers by the drain thread.
+#define TRACE_DRAIN_INTERVAL_MS 10
+
+typedef struct trace_ring_t
+{
+    // Only accessed by the accessing thread (head is also loaded by the drain
+    // thread).
+    uint64_t head;
+    // The last loaded tail, so the tail only has to be loaded again when the
+    // ring buffer seems full.
+    uint64_t cached_tail;
+    addr_t last_addr;
+    word_t last_value;
+
+    // Keeps the tail, which is written by the consumer, on its own cache line.
+    char padding[64];
+    uint64_t tail;
+
+    uint32_t thread;
+    struct trace_ring_t *next;
+    unsigned char data[TRACE_RING_SIZE];
+} trace_ring_t;
+
+struct ram_trace_t
+{
+    ram_t *ram;
+    FILE *file;
+    int failed;
+    // Identifies the trace among all the recorded ones, see thread_ring.
+    uint64_t generation;
+
+    // The ring buffers, most recent first. Rings are added with the lock held
+    // and only destroyed with the trace.
+    trace_ring_t *rings;
+    uint32_t ring_count;
+
+    // The records waiting to be written, only accessed by the consumer.
+    unsigned char *buffer;
+    size_t buffer_size;
+
+#if HAS_DRAIN_THREAD
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int thread_running;
+    int stop;
+    int drain_requested;
+#endif // HAS_DRAIN_THREAD
+};
+
+static ram_trace_t *active_trace = NULL;
+static uint64_t last_generation = 0;
+
+#if !defined(RAM_NO_READ_LISTENER) || !defined(RAM_NO_WRITE_LISTENER)
+// The ring buffer of the current thread, valid if thread_ring_generation is
+// the generation of the active trace.
+static THREAD_LOCAL trace_ring_t *thread_ring = NULL;
+static THREAD_LOCAL uint64_t thread_ring_generation = 0;
+
+static uint32_t zigzag_encode(uint32_t difference)
+{
+    return (difference << 1) ^ (0u - (difference >> 31));
+}
+#endif // !RAM_NO_READ_LISTENER || !RAM_NO_WRITE_LISTENER
+
+static uint32_t zigzag_decode(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+static unsigned char *put_varint(unsigned char *it, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *it++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+
+    *it++ = (unsigned char)value;
+    return it;
+}
+
+// Decodes the varint at *it, of at most max_bits bits, and advances *it.
+// Returns -1 if the varint is truncated or too large.
+static int get_varint(const unsigned char **it, const unsigned char *end, unsigned max_bits, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (unsigned shift = 0; *it != end && shift < max_bits; shift += 7)
+    {
+        const unsigned char byte = *(*it)++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            if (max_bits < 64 && (result >> max_bits) != 0)
+                return -1;
+
+            *value = result;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static void lock_trace(ram_trace_t *trace)
+{
+#if HAS_DRAIN_THREAD
+    pthread_mutex_lock(&trace->lock);
+#else
+    (void)trace;
+#endif // HAS_DRAIN_THREAD
+}
+
+static void unlock_trace(ram_trace_t *trace)
+{
+#if HAS_DRAIN_THREAD
+    pthread_mutex_unlock(&trace->lock);
+#else
+    (void)trace;
+#endif // HAS_DRAIN_THREAD
+}
+
+// Writes the records buffered by the consumer to the trace file.
+static void flush_trace_buffer(ram_trace_t *trace)
+{
+    if (trace->buffer_size != 0 && fwrite(trace->buffer, 1, trace->buffer_size, trace->file) != trace->buffer_size)
+        trace->failed = 1;
+    trace->buffer_size = 0;
+}
+
+// Moves the records of the given ring buffer to the write buffer of the trace,
+// as a block. Must only be called by the consumer of the ring buffer.
+static void drain_ring(ram_trace_t *trace, trace_ring_t *ring)
+{
+    const uint64_t head = LOAD_POSITION(&ring->head);
+    const uint64_t tail = ring->tail;
+    if (head == tail)
+        return;
+
+    const size_t size = (size_t)(head - tail);
+    if (trace->buffer_size + TRACE_BLOCK_HEADER_MAX_SIZE + size > TRACE_WRITE_BUFFER_SIZE)
+        flush_trace_buffer(trace);
+
+    unsigned char *it = trace->buffer + trace->buffer_size;
+    it = put_varint(it, ring->thread);
+    it = put_varint(it, size);
+
+    // The records may wrap around the end of the ring buffer.
+    const size_t offset = (size_t)(tail & (TRACE_RING_SIZE - 1));
+    const size_t first_size = (offset + size <= TRACE_RING_SIZE) ? size : TRACE_RING_SIZE - offset;
+    memcpy(it, ring->data + offset, first_size);
+    memcpy(it + first_size, ring->data, size - first_size);
+    trace->buffer_size = (size_t)(it + size - trace->buffer);
+
+    STORE_POSITION(&ring->tail, head);
+}
+
+static void drain_rings(ram_trace_t *trace)
+{
+    lock_trace(trace);
+    trace_ring_t *rings = trace->rings;
+    unlock_trace(trace);
+
+    for (trace_ring_t *ring = rings; ring != NULL; ring = ring->next)
+        drain_ring(trace, ring);
+}
+
+#if HAS_DRAIN_THREAD
+static void *drain_main(void *arg)
+{
+    ram_trace_t *trace = (ram_trace_t *)arg;
+
+    pthread_mutex_lock(&trace->lock);
+    while (!trace->stop)
+    {
+        trace->drain_requested = 0;
+        pthread_mutex_unlock(&trace->lock);
+        drain_rings(trace);
+        pthread_mutex_lock(&trace->lock);
+
+        // Wait for the next drain, unless a ring buffer is full.
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)TRACE_DRAIN_INTERVAL_MS * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        while (!trace->stop && !trace->drain_requested)
+        {
+            if (pthread_cond_timedwait(&trace->cond, &trace->lock, &deadline) == ETIMEDOUT)
+                break;
+        }
+    }
+    pthread_mutex_unlock(&trace->lock);
+    return NULL;
+}
+#endif // HAS_DRAIN_THREAD
+
+#if !defined(RAM_NO_READ_LISTENER) || !defined(RAM_NO_WRITE_LISTENER)
+static int ring_has_space(const trace_ring_t *ring, size_t size)
+{
+    return ring->head + size - ring->cached_tail <= TRACE_RING_SIZE;
+}
+
+// Waits until the given ring buffer of the current thread has room for size
+// more bytes.
+static void wait_for_ring_space(ram_trace_t *trace, trace_ring_t *ring, size_t size)
+{
+#if HAS_DRAIN_THREAD
+    if (trace->thread_running)
+    {
+        ring->cached_tail = LOAD_POSITION(&ring->tail);
+        while (!ring_has_space(ring, size))
+        {
+            pthread_mutex_lock(&trace->lock);
+            trace->drain_requested = 1;
+            pthread_cond_signal(&trace->cond);
+            pthread_mutex_unlock(&trace->lock);
+
+            sched_yield();
+            ring->cached_tail = LOAD_POSITION(&ring->tail);
+        }
+        return;
+    }
+#endif // HAS_DRAIN_THREAD
+
+    // Without the drain thread, each thread is the consumer of its own ring
+    // buffer, but the write buffer is shared.
+    lock_trace(trace);
+    drain_ring(trace, ring);
+    unlock_trace(trace);
+    ring->cached_tail = ring->tail;
+}
+
+static trace_ring_t *create_thread_ring(ram_trace_t *trace)
+{
+    trace_ring_t *ring = (trace_ring_t *)malloc(sizeof(trace_ring_t));
+    check_alloc(ring);
+    ring->head = 0;
+    ring->cached_tail = 0;
+    ring->last_addr = 0;
+    ring->last_value = 0;
+    ring->tail = 0;
+
+    lock_trace(trace);
+    ring->thread = trace->ring_count++;
+    ring->next = trace->rings;
+    trace->rings = ring;
+    unlock_trace(trace);
+
+    thread_ring = ring;
+    thread_ring_generation = trace->generation;
+    return ring;
+}
+
+static void append_record(ram_trace_t *trace, ram_trace_op_t op, addr_t addr, word_t value)
+{
+    trace_ring_t *ring = thread_ring;
+    if (!RAM_LIKELY(ring != NULL && thread_ring_generation == trace->generation))
+        ring = create_thread_ring(trace);
+
+    unsigned char record[TRACE_RECORD_MAX_SIZE];
+    unsigned char *it = put_varint(record, ((uint64_t)zigzag_encode(addr - ring->last_addr) << 1) | op);
+    ring->last_addr = addr;
+    if (op == RAM_TRACE_WRITE)
+    {
+        it = put_varint(it, zigzag_encode(value - ring->last_value));
+        ring->last_value = value;
+    }
+
+    const size_t size = (size_t)(it - record);
+    if (!RAM_LIKELY(ring_has_space(ring, size)))
+        wait_for_ring_space(trace, ring, size);
+
+    const size_t offset = (size_t)(ring->head & (TRACE_RING_SIZE - 1));
+    if (RAM_LIKELY(offset + size <= TRACE_RING_SIZE))
+    {
+        memcpy(ring->data + offset, record, size);
+    }
+    else
+    {
+        const size_t first_size = TRACE_RING_SIZE - offset;
+        memcpy(ring->data + offset, record, first_size);
+        memcpy(ring->data, record + first_size, size - first_size);
+    }
+
+    STORE_POSITION(&ring->head, ring->head + size);
+}
+#endif // !RAM_NO_READ_LISTENER || !RAM_NO_WRITE_LISTENER
+
+#ifndef RAM_NO_READ_LISTENER
+static void trace_read_listener(ram_t *ram, addr_t addr)
+{
+    assert(active_trace != NULL && active_trace->ram == ram);
+    (void)ram;
+    append_record(active_trace, RAM_TRACE_READ, addr, 0);
+}
+#endif // !RAM_NO_READ_LISTENER
+
+#ifndef RAM_NO_WRITE_LISTENER
+static void trace_write_listener(ram_t *ram, addr_t addr, word_t value)
+{
+    assert(active_trace != NULL && active_trace->ram == ram);
+    (void)ram;
+    append_record(active_trace, RAM_TRACE_WRITE, addr, value);
+}
+#endif // !RAM_NO_WRITE_LISTENER
+
+ram_trace_t *ram_trace_start(ram_t *ram, const char *filename)
+{
+    assert(ram != NULL && filename != NULL);
+    assert(active_trace == NULL && "only one RAM trace can be recorded at a time");
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+        return NULL;
+    // The records are already written in large blocks.
+    setvbuf(file, NULL, _IONBF, 0);
+
+    ram_trace_t *trace = (ram_trace_t *)malloc(sizeof(ram_trace_t));
+    check_alloc(trace);
+    trace->ram = ram;
+    trace->file = file;
+    trace->failed = 0;
+    trace->generation = ++last_generation;
+    trace->rings = NULL;
+    trace->ring_count = 0;
+    trace->buffer = (unsigned char *)malloc(TRACE_WRITE_BUFFER_SIZE);
+    check_alloc(trace->buffer);
+
+    const uint32_t header[2] = {TRACE_MAGIC, TRACE_VERSION};
+    memcpy(trace->buffer, header, sizeof(header));
+    trace->buffer_size = sizeof(header);
+
+#if HAS_DRAIN_THREAD
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->cond, NULL);
+    trace->stop = 0;
+    trace->drain_requested = 0;
+    // Without a thread, fall back to the synchronous writes.
+    trace->thread_running = (pthread_create(&trace->thread, NULL, &drain_main, trace) == 0);
+#endif // HAS_DRAIN_THREAD
+
+    active_trace = trace;
+#ifndef RAM_NO_READ_LISTENER
+    ram_install_read_listener(ram, 0, 0xffffffff, &trace_read_listener);
+#endif // !RAM_NO_READ_LISTENER
+#ifndef RAM_NO_WRITE_LISTENER
+    ram_install_write_listener(ram, 0, 0xffffffff, &trace_write_listener);
+#endif // !RAM_NO_WRITE_LISTENER
+    return trace;
+}
+
+int ram_trace_stop(ram_trace_t *trace)
+{
+    assert(trace != NULL && trace == active_trace);
+
+#ifndef RAM_NO_READ_LISTENER
+    ram_remove_read_listener(trace->ram, &trace_read_listener);
+#endif // !RAM_NO_READ_LISTENER
+#ifndef RAM_NO_WRITE_LISTENER
+    ram_remove_write_listener(trace->ram, &trace_write_listener);
+#endif // !RAM_NO_WRITE_LISTENER
+    active_trace = NULL;
+
+#if HAS_DRAIN_THREAD
+    if (trace->thread_running)
+    {
+        pthread_mutex_lock(&trace->lock);
+        trace->stop = 1;
+        pthread_cond_signal(&trace->cond);
+        pthread_mutex_unlock(&trace->lock);
+        pthread_join(trace->thread, NULL);
+    }
+#endif // HAS_DRAIN_THREAD
+
+    // Write the records appended since the last drain.
+    drain_rings(trace);
+    flush_trace_buffer(trace);
+
+    int failed = trace->failed;
+    if (fclose(trace->file) != 0)
+        failed = 1;
+
+    trace_ring_t *ring = trace->rings;
+    while (ring != NULL)
+    {
+        trace_ring_t *next = ring->next;
+        free(ring);
+        ring = next;
+    }
+
+#if HAS_DRAIN_THREAD
+    pthread_mutex_destroy(&trace->lock);
+    pthread_cond_destroy(&trace->cond);
+#endif // HAS_DRAIN_THREAD
+    free(trace->buffer);
+    free(trace);
+    return failed ? -1 : 0;
+}
+
+// Reads a varint of at most 32 bits from the given file. Returns 1 on success,
+// 0 at the end of the file (before the varint) and -1 on error.
+static int read_file_varint(FILE *file, uint32_t *value)
+{
+    uint32_t result = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7)
+    {
+        const int byte = fgetc(file);
+        if (byte == EOF)
+            return (shift == 0) ? 0 : -1;
+
+        result |= (uint32_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *value = result;
+            return (shift == 28 && byte > 0x0f) ? -1 : 1;
+        }
+    }
+
+    return -1;
+}
+
+// The decoding state of a thread of a trace file.
+typedef struct trace_thread_state_t
+{
+    addr_t last_addr;
+    word_t last_value;
+} trace_thread_state_t;
+
+int64_t ram_trace_read(const char *filename, ram_trace_visitor_fn_t visitor, void *user_data)
+{
+    assert(filename != NULL && visitor != NULL);
+
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+        return -1;
+
+    uint32_t header[2];
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != TRACE_MAGIC || header[1] != TRACE_VERSION)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    unsigned char *block = (unsigned char *)malloc(TRACE_RING_SIZE);
+    check_alloc(block);
+    trace_thread_state_t *threads = NULL;
+    uint32_t thread_count = 0;
+
+    int64_t record_count = 0;
+    int failed = 0;
+    for (;;)
+    {
+        uint32_t thread, size;
+        const int status = read_file_varint(file, &thread);
+        if (status == 0)
+            break;
+        if (status < 0 || read_file_varint(file, &size) != 1 || size > TRACE_RING_SIZE ||
+            fread(block, 1, size, file) != size)
+        {
+            failed = 1;
+            break;
+        }
+
+        if (thread >= thread_count)
+        {
+            // The threads are numbered from 0, so they are few.
+            threads = (trace_thread_state_t *)realloc(threads, sizeof(trace_thread_state_t) * ((size_t)thread + 1));
+            check_alloc(threads);
+            memset(threads + thread_count, 0, sizeof(trace_thread_state_t) * (thread + 1 - thread_count));
+            thread_count = thread + 1;
+        }
+
+        trace_thread_state_t *state = &threads[thread];
+        const unsigned char *it = block;
+        const unsigned char *end = block + size;
+        while (it != end)
+        {
+            uint64_t op_and_addr, value = 0;
+            if (get_varint(&it, end, 33, &op_and_addr) != 0)
+            {
+                failed = 1;
+                break;
+            }
+
+            ram_trace_record_t record;
+            record.op = (ram_trace_op_t)(op_and_addr & 1);
+            if (record.op == RAM_TRACE_WRITE && get_varint(&it, end, 32, &value) != 0)
+            {
+                failed = 1;
+                break;
+            }
+
+            record.thread = thread;
+            record.addr = state->last_addr + zigzag_decode((uint32_t)(op_and_addr >> 1));
+            record.value = (record.op == RAM_TRACE_WRITE) ? state->last_value + zigzag_decode((uint32_t)value) : 0;
+            state->last_addr = record.addr;
+            if (record.op == RAM_TRACE_WRITE)
+                state->last_value = record.value;
+
+            visitor(user_data, &record);
+            ++record_count;
+        }
+
+        if (failed)
+            break;
+    }
+
+    free(block);
+    free(threads);
+    fclose(file);
+    return failed ? -1 : record_count;
+}
+
+static void replay_visitor(void *user_data, const ram_trace_record_t *record)
+{
+    ram_t *ram = (ram_t *)user_data;
+    if (record->op == RAM_TRACE_WRITE)
+        ram_set(ram, record->addr, record->value);
+    else
+        (void)ram_get(ram, record->addr);
+}
+
+int64_t ram_trace_replay(ram_t *ram, const char *filename)
+{
+    assert(ram != NULL);
+    return ram_trace_read(filename, &replay_visitor, ram);
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2024 Hubert Gruniaux
+// This file is part of SparseMemory which is released under the MIT license.
+// See file LICENSE.txt for full license details.
+
+#ifndef CPULM_TRACE_H
+#define CPULM_TRACE_H
+
+#include "memory.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/*
+ * RAM access traces.
+ */
+
+typedef struct ram_trace_t ram_trace_t;
+
+/** Starts recording the accesses of the given @a ram block in the file
+ * @a filename, or returns NULL if the file can not be created.
+ *
+ * The trace is recorded by a read and a write listener of the whole address
+ * space (so the accesses take the slow path of the RAM block). Each accessing
+ * thread appends its records to its own ring buffer, without locks, and a
+ * background thread writes them to the file in large blocks. A thread only
+ * waits if its ring buffer is full. Where threads are not supported, the
+ * accessing thread writes its ring buffer itself when it is full.
+ *
+ * Only one trace can be recorded at a time. Like the listener installation,
+ * this must not be called while the RAM block is accessed by other threads. */
+ram_trace_t* ram_trace_start(ram_t* ram, const char* filename);
+/** Stops recording the given @a trace, writes its last records, closes its
+ * file and destroys it. Returns 0 on success or -1 if the file could not be
+ * written. Must not be called while the RAM block is accessed. */
+int ram_trace_stop(ram_trace_t* trace);
+
+typedef enum ram_trace_op_t {
+    RAM_TRACE_READ,
+    RAM_TRACE_WRITE,
+} ram_trace_op_t;
+
+/** An access of a RAM trace. */
+typedef struct ram_trace_record_t {
+    ram_trace_op_t op;
+    /** The index of the accessing thread, in the order of their first
+     * access. */
+    uint32_t thread;
+    addr_t addr;
+    /** The written word (0 for a read). */
+    word_t value;
+} ram_trace_record_t;
+
+typedef void (*ram_trace_visitor_fn_t)(void*, const ram_trace_record_t*);
+/** Calls @a visitor, with @a user_data, for each record of the trace file
+ * @a filename and returns the count of records, or -1 if the file could not
+ * be read or is not a valid trace (after the records before the error were
+ * visited).
+ *
+ * The records of a thread are in their order. The records of different
+ * threads are interleaved in blocks (the order in which they were written)
+ * as their actual interleaving is not recorded. */
+int64_t ram_trace_read(const char* filename, ram_trace_visitor_fn_t visitor, void* user_data);
+/** Replays the trace file @a filename on the given @a ram block: a ram_get()
+ * for each read and a ram_set() for each write, in the order given by
+ * ram_trace_read(). Returns the count of records or -1 like
+ * ram_trace_read(). */
+int64_t ram_trace_replay(ram_t* ram, const char* filename);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // !CPULM_TRACE_H